@@ -0,0 +1,358 @@
+#include <glob/batch_status.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <system_error>
+#include <thread>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <cerrno>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+// IORING_OP_STATX and IORING_REGISTER_PROBE first appeared in the same kernel version as
+// IORING_FEAT_CUR_PERSONALITY (5.6).
+#if defined(IORING_FEAT_CUR_PERSONALITY) && defined(STATX_TYPE) && defined(__NR_io_uring_setup)
+#define GLOB_HAVE_IO_URING
+#endif
+#endif
+#endif
+
+namespace glob {
+
+namespace {
+
+// Batches smaller than this are queried one path at a time on the calling thread.
+constexpr std::size_t MIN_CONCURRENT_BATCH_SIZE = 32;
+// Number of paths a thread of the pool takes at a time.
+constexpr std::size_t THREAD_CHUNK_SIZE = 64;
+
+fs::file_status query_status(const fs::path &path, bool follow_symlinks) {
+  std::error_code error;
+  return follow_symlinks ? fs::status(path, error) : fs::symlink_status(path, error);
+}
+
+void status_each_sequentially(const std::vector<fs::path> &paths, bool follow_symlinks,
+                              std::vector<fs::file_status> &result) {
+  for (std::size_t i = 0; i < paths.size(); ++i) {
+    result[i] = query_status(paths[i], follow_symlinks);
+  }
+}
+
+void status_each_on_threads(const std::vector<fs::path> &paths, bool follow_symlinks,
+                            unsigned max_concurrency, std::vector<fs::file_status> &result) {
+  const std::size_t max_useful_threads =
+      (paths.size() + THREAD_CHUNK_SIZE - 1) / THREAD_CHUNK_SIZE;
+  const unsigned num_threads = static_cast<unsigned>(std::min<std::size_t>(
+      max_concurrency > 0 ? max_concurrency : std::thread::hardware_concurrency(),
+      max_useful_threads));
+  if (num_threads <= 1) {
+    status_each_sequentially(paths, follow_symlinks, result);
+    return;
+  }
+
+  std::atomic<std::size_t> next_chunk{0};
+  const auto work = [&] {
+    while (true) {
+      const std::size_t begin = next_chunk.fetch_add(THREAD_CHUNK_SIZE);
+      if (begin >= paths.size()) {
+        break;
+      }
+      const std::size_t end = std::min(begin + THREAD_CHUNK_SIZE, paths.size());
+      for (std::size_t i = begin; i < end; ++i) {
+        result[i] = query_status(paths[i], follow_symlinks);
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (unsigned t = 1; t < num_threads; ++t) {
+    threads.emplace_back(work);
+  }
+  work();
+  for (auto &thread : threads) {
+    thread.join();
+  }
+}
+
+#ifdef GLOB_HAVE_IO_URING
+
+// Number of statx requests kept in flight if no limit is given.
+constexpr unsigned DEFAULT_QUEUE_DEPTH = 128;
+
+fs::file_type file_type_from_mode(mode_t mode) {
+  switch (mode & S_IFMT) {
+  case S_IFREG:
+    return fs::file_type::regular;
+  case S_IFDIR:
+    return fs::file_type::directory;
+  case S_IFLNK:
+    return fs::file_type::symlink;
+  case S_IFBLK:
+    return fs::file_type::block;
+  case S_IFCHR:
+    return fs::file_type::character;
+  case S_IFIFO:
+    return fs::file_type::fifo;
+  case S_IFSOCK:
+    return fs::file_type::socket;
+  default:
+    return fs::file_type::unknown;
+  }
+}
+
+// An io_uring instance used from a single thread, with just enough of the liburing
+// functionality to submit statx requests and reap their completions.
+class StatxRing {
+public:
+  // Creates a ring with room for at least `depth` requests. Check `ok()` before use.
+  explicit StatxRing(unsigned depth) {
+    io_uring_params params{};
+    fd_ = static_cast<int>(syscall(__NR_io_uring_setup, depth, &params));
+    if (fd_ < 0) {
+      return;
+    }
+    if (!supports_statx() || !map_rings(params)) {
+      return;
+    }
+    capacity_ = std::min(params.sq_entries, params.cq_entries);
+    ok_ = true;
+  }
+
+  ~StatxRing() {
+    if (sqes_ != MAP_FAILED) {
+      munmap(sqes_, sqes_size_);
+    }
+    if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) {
+      munmap(cq_ring_, cq_ring_size_);
+    }
+    if (sq_ring_ != MAP_FAILED) {
+      munmap(sq_ring_, sq_ring_size_);
+    }
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+  }
+
+  StatxRing(const StatxRing &) = delete;
+  StatxRing &operator=(const StatxRing &) = delete;
+
+  bool ok() const { return ok_; }
+
+  // Maximum number of requests in flight.
+  unsigned capacity() const { return capacity_; }
+
+  // Queues a statx request for `path`, to be submitted by the next call to `submit_and_wait`.
+  void prepare_statx(const char *path, bool follow_symlinks, struct statx *buffer,
+                     std::uint64_t user_data) {
+    const unsigned tail = *sq_tail_;
+    const unsigned index = tail & *sq_mask_;
+    io_uring_sqe &sqe = sqes_[index];
+    sqe = io_uring_sqe{};
+    sqe.opcode = IORING_OP_STATX;
+    sqe.fd = AT_FDCWD;
+    sqe.addr = reinterpret_cast<std::uint64_t>(path);
+    sqe.len = STATX_TYPE | STATX_MODE;
+    sqe.off = reinterpret_cast<std::uint64_t>(buffer);
+    sqe.statx_flags = follow_symlinks ? 0 : AT_SYMLINK_NOFOLLOW;
+    sqe.user_data = user_data;
+    sq_array_[index] = index;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    ++num_unsubmitted_;
+  }
+
+  // Submits the queued requests and waits until at least one completion is available.
+  // Returns false if the ring has failed.
+  bool submit_and_wait() {
+    while (true) {
+      const int submitted = static_cast<int>(syscall(__NR_io_uring_enter, fd_, num_unsubmitted_,
+                                                     1, IORING_ENTER_GETEVENTS, nullptr, 0));
+      if (submitted >= 0) {
+        num_unsubmitted_ -= static_cast<unsigned>(submitted);
+        return true;
+      }
+      if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+        return false;
+      }
+      if (has_completions()) {
+        return true;
+      }
+    }
+  }
+
+  // Calls `on_completion(user_data, result)` for each available completion.
+  template <typename OnCompletion> void reap(OnCompletion &&on_completion) {
+    unsigned head = *cq_head_;
+    const unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+      const io_uring_cqe &cqe = cqes_[head & *cq_mask_];
+      on_completion(cqe.user_data, cqe.res);
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+  }
+
+private:
+  bool supports_statx() const {
+    constexpr unsigned num_ops = 256;
+    std::vector<unsigned char> buffer(sizeof(io_uring_probe) +
+                                      num_ops * sizeof(io_uring_probe_op));
+    auto *probe = reinterpret_cast<io_uring_probe *>(buffer.data());
+    if (syscall(__NR_io_uring_register, fd_, IORING_REGISTER_PROBE, probe, num_ops) < 0) {
+      return false;
+    }
+    return probe->last_op >= IORING_OP_STATX &&
+           (probe->ops[IORING_OP_STATX].flags & IO_URING_OP_SUPPORTED);
+  }
+
+  bool map_rings(const io_uring_params &params) {
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+      sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+    sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    fd_, IORING_OFF_SQ_RING);
+    if (sq_ring_ == MAP_FAILED) {
+      return false;
+    }
+    cq_ring_ = single_mmap ? sq_ring_
+                           : mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+                                  MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+    if (cq_ring_ == MAP_FAILED) {
+      return false;
+    }
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    void *sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      fd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+      return false;
+    }
+    sqes_ = static_cast<io_uring_sqe *>(sqes);
+
+    char *sq = static_cast<char *>(sq_ring_);
+    sq_tail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sq_mask_ = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    char *cq = static_cast<char *>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cq_mask_ = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+    return true;
+  }
+
+  bool has_completions() const {
+    return *cq_head_ != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+  }
+
+  int fd_ = -1;
+  bool ok_ = false;
+  unsigned capacity_ = 0;
+  unsigned num_unsubmitted_ = 0;
+
+  void *sq_ring_ = MAP_FAILED;
+  void *cq_ring_ = MAP_FAILED;
+  std::size_t sq_ring_size_ = 0;
+  std::size_t cq_ring_size_ = 0;
+  io_uring_sqe *sqes_ = static_cast<io_uring_sqe *>(MAP_FAILED);
+  std::size_t sqes_size_ = 0;
+
+  unsigned *sq_tail_ = nullptr;
+  unsigned *sq_mask_ = nullptr;
+  unsigned *sq_array_ = nullptr;
+  unsigned *cq_head_ = nullptr;
+  unsigned *cq_tail_ = nullptr;
+  unsigned *cq_mask_ = nullptr;
+  io_uring_cqe *cqes_ = nullptr;
+};
+
+// Set once io_uring turns out to be unusable (e.g. disabled by a seccomp filter, or a kernel
+// without statx support), so later batches go straight to the thread pool.
+std::atomic<bool> io_uring_unavailable{false};
+
+// Queries the paths through an io_uring. Returns false, leaving `result` unspecified, if
+// io_uring cannot be used.
+bool status_each_with_io_uring(const std::vector<fs::path> &paths, bool follow_symlinks,
+                               unsigned max_concurrency, std::vector<fs::file_status> &result) {
+  if (io_uring_unavailable.load(std::memory_order_relaxed)) {
+    return false;
+  }
+  StatxRing ring(max_concurrency > 0 ? max_concurrency : DEFAULT_QUEUE_DEPTH);
+  if (!ring.ok()) {
+    io_uring_unavailable.store(true, std::memory_order_relaxed);
+    return false;
+  }
+
+  // Each request in flight owns a slot holding its statx buffer and the index of its path.
+  const unsigned num_slots = ring.capacity();
+  auto buffers = std::make_unique<struct statx[]>(num_slots);
+  std::vector<std::size_t> slot_paths(num_slots);
+  std::vector<unsigned> free_slots(num_slots);
+  for (unsigned slot = 0; slot < num_slots; ++slot) {
+    free_slots[slot] = num_slots - 1 - slot;
+  }
+
+  std::size_t next_path = 0;
+  std::size_t num_completed = 0;
+  while (num_completed < paths.size()) {
+    while (next_path < paths.size() && !free_slots.empty()) {
+      const unsigned slot = free_slots.back();
+      free_slots.pop_back();
+      slot_paths[slot] = next_path;
+      ring.prepare_statx(paths[next_path].c_str(), follow_symlinks, &buffers[slot], slot);
+      ++next_path;
+    }
+    if (!ring.submit_and_wait()) {
+      // Requests may still be in flight and write to the buffers later, so these are leaked.
+      buffers.release();
+      io_uring_unavailable.store(true, std::memory_order_relaxed);
+      return false;
+    }
+    ring.reap([&](std::uint64_t slot, int res) {
+      const std::size_t index = slot_paths[slot];
+      if (res == 0) {
+        const struct statx &buffer = buffers[slot];
+        result[index] = fs::file_status(file_type_from_mode(buffer.stx_mode),
+                                        static_cast<fs::perms>(buffer.stx_mode & 07777));
+      } else if (res == -ENOENT || res == -ENOTDIR) {
+        result[index] = fs::file_status(fs::file_type::not_found);
+      } else {
+        // Let the standard library report any other error the way it usually does.
+        result[index] = query_status(paths[index], follow_symlinks);
+      }
+      free_slots.push_back(static_cast<unsigned>(slot));
+      ++num_completed;
+    });
+  }
+  return true;
+}
+
+#endif // GLOB_HAVE_IO_URING
+
+} // namespace
+
+std::vector<fs::file_status> status_each(const std::vector<fs::path> &paths,
+                                         bool follow_symlinks, const TraversalOptions &options) {
+  std::vector<fs::file_status> result(paths.size());
+  if (paths.size() < MIN_CONCURRENT_BATCH_SIZE) {
+    status_each_sequentially(paths, follow_symlinks, result);
+    return result;
+  }
+#ifdef GLOB_HAVE_IO_URING
+  if (options.use_io_uring &&
+      status_each_with_io_uring(paths, follow_symlinks, options.max_concurrency, result)) {
+    return result;
+  }
+#endif
+  status_each_on_threads(paths, follow_symlinks, options.max_concurrency, result);
+  return result;
+}
+
+} // namespace glob
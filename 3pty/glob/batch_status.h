@@ -0,0 +1,22 @@
+#pragma once
+#include <vector>
+
+#include "ghc/fs_std_fwd.hpp"
+#include "glob/glob.h"
+
+namespace glob {
+
+/// Returns the status of each of `paths`, like `fs::status` (or `fs::symlink_status` if
+/// `follow_symlinks` is false) but without throwing: paths that do not exist get the type
+/// `not_found` and paths that cannot be queried for another reason get the type `none`.
+///
+/// Large batches are queried concurrently, so that the latency of each query is paid once
+/// per batch rather than once per path. On Linux the queries are submitted as `statx`
+/// requests to an io_uring, keeping up to `options.max_concurrency` of them in flight (0
+/// means a default queue depth); elsewhere, or if io_uring is unavailable or disabled by
+/// `options.use_io_uring`, they are spread over up to `options.max_concurrency` threads (0
+/// means one per hardware thread).
+std::vector<fs::file_status> status_each(const std::vector<fs::path> &paths,
+                                         bool follow_symlinks, const TraversalOptions &options);
+
+} // namespace glob
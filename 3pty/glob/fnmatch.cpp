@@ -0,0 +1,431 @@
+#include <glob/fnmatch.h>
+#include <map>
+#include <regex>
+
+namespace glob {
+
+namespace {
+
+bool string_replace(std::wstring &str, const std::wstring &from, const std::wstring &to) {
+  std::size_t start_pos = str.find(from);
+  if (start_pos == std::wstring::npos)
+    return false;
+  str.replace(start_pos, from.length(), to);
+  return true;
+}
+
+std::map<int, std::wstring> make_special_characters_map(const std::wstring& special_characters)
+{
+  std::map<int, std::wstring> special_characters_map;
+  for (auto& sc : special_characters)
+  {
+    special_characters_map.insert(
+      std::make_pair(static_cast<int>(sc), std::wstring{L"\\"} + std::wstring(1, sc)));
+  }
+  return special_characters_map;
+}
+
+} // namespace
+
+Matcher::Matcher(const std::wstring &pattern) {
+  std::size_t i = 0, n = pattern.size();
+
+  while (i < n) {
+    auto c = pattern[i];
+    i += 1;
+    if (c == '*') {
+      append_star();
+    } else if (c == '?') {
+      append_any_char();
+    } else if (c == '[') {
+      auto j = i;
+      if (j < n && pattern[j] == '!') {
+        j += 1;
+      }
+      if (j < n && pattern[j] == ']') {
+        j += 1;
+      }
+      while (j < n && pattern[j] != ']') {
+        j += 1;
+      }
+      if (j >= n) {
+        append_literal('[');
+      } else {
+        CharClass char_class;
+        auto k = i;
+        if (pattern[k] == '!') {
+          char_class.negated = true;
+          k += 1;
+        }
+        while (k < j) {
+          if (k + 2 < j && pattern[k + 1] == '-') {
+            char_class.add_range(pattern[k], pattern[k + 2]);
+            k += 3;
+          } else {
+            char_class.add_range(pattern[k], pattern[k]);
+            k += 1;
+          }
+        }
+        append_char_class(std::move(char_class));
+        i = j + 1;
+      }
+    } else {
+      append_literal(c);
+    }
+  }
+}
+
+bool Matcher::match(std::wstring_view name) const {
+  const Segment &first = segments_.front();
+  if (segments_.size() == 1) {
+    return name.size() == first.width && match_segment_at(first, name, 0);
+  }
+
+  const Segment &last = segments_.back();
+  if (name.size() < first.width + last.width) {
+    return false;
+  }
+  const std::size_t tail = name.size() - last.width;
+  if (!match_segment_at(first, name, 0) || !match_segment_at(last, name, tail)) {
+    return false;
+  }
+
+  // Placing each inner segment as far left as possible leaves the most room for the rest.
+  std::size_t pos = first.width;
+  for (std::size_t i = 1; i + 1 < segments_.size(); ++i) {
+    pos = find_segment(segments_[i], name, pos, tail);
+    if (pos == std::wstring_view::npos) {
+      return false;
+    }
+    pos += segments_[i].width;
+  }
+  return true;
+}
+
+bool Matcher::match(std::wstring_view name, Capture *captures) const {
+  const Segment &first = segments_.front();
+  if (segments_.size() == 1) {
+    if (name.size() != first.width || !match_segment_at(first, name, 0)) {
+      return false;
+    }
+    capture_segment(first, 0, captures);
+    return true;
+  }
+
+  const Segment &last = segments_.back();
+  if (name.size() < first.width + last.width) {
+    return false;
+  }
+  const std::size_t tail = name.size() - last.width;
+  if (!match_segment_at(first, name, 0) || !match_segment_at(last, name, tail)) {
+    return false;
+  }
+
+  // Placing each inner segment as far right as possible lets every star match as many
+  // characters as it can, the leftmost star first. Segments are placed from right to left.
+  std::size_t next_start = tail;
+  capture_segment(last, tail, captures);
+  for (std::size_t i = segments_.size() - 2; i > 0; --i) {
+    const Segment &segment = segments_[i];
+    if (next_start < first.width + segment.width) {
+      return false;
+    }
+    const std::size_t start =
+      rfind_segment(segment, name, first.width, next_start - segment.width);
+    if (start == std::wstring_view::npos) {
+      return false;
+    }
+    captures[segments_[i + 1].first_capture - 1] =
+      Capture{start + segment.width, next_start - start - segment.width};
+    capture_segment(segment, start, captures);
+    next_start = start;
+  }
+  captures[segments_[1].first_capture - 1] = Capture{first.width, next_start - first.width};
+  capture_segment(first, 0, captures);
+  return true;
+}
+
+void Matcher::substitute(const std::wstring_view *values, std::wstring &name) const {
+  for (std::size_t s = 0; s < segments_.size(); ++s) {
+    const Segment &segment = segments_[s];
+    if (s > 0) {
+      // The star preceding the segment.
+      name += values[segment.first_capture - 1];
+    }
+    std::size_t value = segment.first_capture;
+    for (auto a = segment.begin_atom; a < segment.end_atom; ++a) {
+      const Atom &atom = atoms_[a];
+      switch (atom.kind) {
+      case AtomKind::literal:
+        name.append(literals_, atom.index, atom.length);
+        break;
+      case AtomKind::any_char:
+        for (std::size_t i = 0; i < atom.length; ++i) {
+          name += values[value++];
+        }
+        break;
+      case AtomKind::char_class:
+        name += values[value++];
+        break;
+      }
+    }
+  }
+}
+
+bool Matcher::CharClass::contains(wchar_t c) const {
+  const auto code = static_cast<std::uint32_t>(c);
+  bool found = false;
+  if (code < 256) {
+    found = (low_bits[code >> 6] >> (code & 63)) & 1;
+  } else {
+    for (auto &[first, last] : high_ranges) {
+      if (first <= c && c <= last) {
+        found = true;
+        break;
+      }
+    }
+  }
+  return found != negated;
+}
+
+void Matcher::CharClass::add_range(wchar_t first, wchar_t last) {
+  if (first > last) {
+    return;
+  }
+  const auto first_code = static_cast<std::uint32_t>(first);
+  const auto last_code = static_cast<std::uint32_t>(last);
+  for (auto code = first_code; code <= last_code && code < 256; ++code) {
+    low_bits[code >> 6] |= std::uint64_t{1} << (code & 63);
+  }
+  if (last_code >= 256) {
+    high_ranges.emplace_back(first_code < 256 ? static_cast<wchar_t>(256) : first, last);
+  }
+}
+
+void Matcher::append_literal(wchar_t c) {
+  Segment &segment = segments_.back();
+  if (segment.end_atom > segment.begin_atom && atoms_.back().kind == AtomKind::literal) {
+    atoms_.back().length += 1;
+  } else {
+    atoms_.push_back(
+      Atom{AtomKind::literal, static_cast<std::uint32_t>(literals_.size()), 1});
+  }
+  literals_ += c;
+  segment.end_atom = static_cast<std::uint32_t>(atoms_.size());
+  segment.width += 1;
+}
+
+void Matcher::append_any_char() {
+  Segment &segment = segments_.back();
+  if (segment.end_atom > segment.begin_atom && atoms_.back().kind == AtomKind::any_char) {
+    atoms_.back().length += 1;
+  } else {
+    atoms_.push_back(Atom{AtomKind::any_char, 0, 1});
+  }
+  segment.end_atom = static_cast<std::uint32_t>(atoms_.size());
+  segment.width += 1;
+  has_non_literal_atoms_ = true;
+  num_wildcards_ += 1;
+}
+
+void Matcher::append_char_class(CharClass char_class) {
+  Segment &segment = segments_.back();
+  atoms_.push_back(
+    Atom{AtomKind::char_class, static_cast<std::uint32_t>(classes_.size()), 1});
+  classes_.push_back(std::move(char_class));
+  segment.end_atom = static_cast<std::uint32_t>(atoms_.size());
+  segment.width += 1;
+  has_non_literal_atoms_ = true;
+  num_wildcards_ += 1;
+}
+
+void Matcher::append_star() {
+  // Consecutive stars are equivalent to a single one.
+  if (segments_.size() > 1 && segments_.back().width == 0) {
+    return;
+  }
+  num_wildcards_ += 1;
+  const auto next_atom = static_cast<std::uint32_t>(atoms_.size());
+  segments_.push_back(Segment{next_atom, next_atom, 0, num_wildcards_});
+}
+
+bool Matcher::match_segment_at(const Segment &segment, std::wstring_view name,
+                               std::size_t pos) const {
+  for (auto a = segment.begin_atom; a < segment.end_atom; ++a) {
+    const Atom &atom = atoms_[a];
+    switch (atom.kind) {
+    case AtomKind::literal:
+      if (name.compare(pos, atom.length,
+                       std::wstring_view(literals_).substr(atom.index, atom.length)) != 0) {
+        return false;
+      }
+      break;
+    case AtomKind::any_char:
+      break;
+    case AtomKind::char_class:
+      if (!classes_[atom.index].contains(name[pos])) {
+        return false;
+      }
+      break;
+    }
+    pos += atom.length;
+  }
+  return true;
+}
+
+std::size_t Matcher::find_segment(const Segment &segment, std::wstring_view name,
+                                  std::size_t from, std::size_t to) const {
+  const Atom &head = atoms_[segment.begin_atom];
+  const std::wstring_view window = name.substr(0, to);
+  while (from + segment.width <= to) {
+    if (head.kind == AtomKind::literal) {
+      // Skip straight to the next occurrence of the segment's leading literal run.
+      from = window.find(std::wstring_view(literals_).substr(head.index, head.length), from);
+      if (from == std::wstring_view::npos || from + segment.width > to) {
+        return std::wstring_view::npos;
+      }
+    }
+    if (match_segment_at(segment, name, from)) {
+      return from;
+    }
+    from += 1;
+  }
+  return std::wstring_view::npos;
+}
+
+std::size_t Matcher::rfind_segment(const Segment &segment, std::wstring_view name,
+                                   std::size_t from, std::size_t to) const {
+  const Atom &head = atoms_[segment.begin_atom];
+  std::size_t pos = to;
+  while (true) {
+    if (head.kind == AtomKind::literal) {
+      // Skip straight to the previous occurrence of the segment's leading literal run.
+      pos = name.rfind(std::wstring_view(literals_).substr(head.index, head.length), pos);
+      if (pos == std::wstring_view::npos || pos < from) {
+        return std::wstring_view::npos;
+      }
+    }
+    if (match_segment_at(segment, name, pos)) {
+      return pos;
+    }
+    if (pos == from) {
+      return std::wstring_view::npos;
+    }
+    pos -= 1;
+  }
+}
+
+void Matcher::capture_segment(const Segment &segment, std::size_t pos,
+                              Capture *captures) const {
+  std::size_t capture = segment.first_capture;
+  for (auto a = segment.begin_atom; a < segment.end_atom; ++a) {
+    const Atom &atom = atoms_[a];
+    if (atom.kind == AtomKind::any_char) {
+      for (std::size_t i = 0; i < atom.length; ++i) {
+        captures[capture++] = Capture{pos + i, 1};
+      }
+    } else if (atom.kind == AtomKind::char_class) {
+      captures[capture++] = Capture{pos, 1};
+    }
+    pos += atom.length;
+  }
+}
+
+std::wstring translate(const std::wstring &pattern) {
+  std::size_t i = 0, n = pattern.size();
+  std::wstring result_string;
+
+  while (i < n) {
+    auto c = pattern[i];
+    i += 1;
+    if (c == '*') {
+      result_string += L".*";
+    } else if (c == '?') {
+      result_string += L".";
+    } else if (c == '[') {
+      auto j = i;
+      if (j < n && pattern[j] == '!') {
+        j += 1;
+      }
+      if (j < n && pattern[j] == ']') {
+        j += 1;
+      }
+      while (j < n && pattern[j] != ']') {
+        j += 1;
+      }
+      if (j >= n) {
+        result_string += L"\\[";
+      } else {
+        auto stuff = std::wstring(pattern.begin() + i, pattern.begin() + j);
+        if (stuff.find(L"--") == std::wstring::npos) {
+          string_replace(stuff, std::wstring{L"\\"}, std::wstring{LR"(\\)"});
+        } else {
+          std::vector<std::wstring> chunks;
+          std::size_t k = 0;
+          if (pattern[i] == '!') {
+            k = i + 2;
+          } else {
+            k = i + 1;
+          }
+
+          while (true) {
+            k = pattern.find(L"-", k, j);
+            if (k == std::wstring::npos) {
+              break;
+            }
+            chunks.push_back(std::wstring(pattern.begin() + i, pattern.begin() + k));
+            i = k + 1;
+            k = k + 3;
+          }
+
+          chunks.push_back(std::wstring(pattern.begin() + i, pattern.begin() + j));
+          // Escape backslashes and hyphens for set difference (--).
+          // Hyphens that create ranges shouldn't be escaped.
+          bool first = true;
+          for (auto &s : chunks) {
+            string_replace(s, std::wstring{L"\\"}, std::wstring{LR"(\\)"});
+            string_replace(s, std::wstring{L"-"}, std::wstring{LR"(\-)"});
+            if (first) {
+              stuff += s;
+              first = false;
+            } else {
+              stuff += L"-" + s;
+            }
+          }
+        }
+
+        // Escape set operations (&&, ~~ and ||).
+        std::wstring result;
+        std::regex_replace(std::back_inserter(result),          // ressult
+                           stuff.begin(), stuff.end(),          // string
+                           std::wregex(std::wstring{LR"([&~|])"}), // pattern
+                           std::wstring{LR"(\\\1)"});             // repl
+        stuff = result;
+        i = j + 1;
+        if (stuff[0] == '!') {
+          stuff = L"^" + std::wstring(stuff.begin() + 1, stuff.end());
+        } else if (stuff[0] == '^' || stuff[0] == '[') {
+          stuff = L"\\\\" + stuff;
+        }
+        result_string = result_string + L"[" + stuff + L"]";
+      }
+    } else {
+      // SPECIAL_CHARS
+      // closing ')', '}' and ']'
+      // '-' (a range in character set)
+      // '&', '~', (extended character set operations)
+      // '#' (comment) and WHITESPACE (ignored) in verbose mode
+      static const std::wstring special_characters = L"()[]{}?*+-|^$\\.&~# \t\n\r\v\f";
+      static const std::map<int, std::wstring> special_characters_map = make_special_characters_map(special_characters);
+
+      if (special_characters.find(c) != std::wstring::npos) {
+        result_string += special_characters_map.at(static_cast<int>(c));
+      } else {
+        result_string += c;
+      }
+    }
+  }
+  return std::wstring{L"(("} + result_string + std::wstring{LR"()|[\r\n])$)"};
+}
+
+} // namespace glob
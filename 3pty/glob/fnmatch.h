@@ -0,0 +1,112 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace glob {
+
+/// Position of the text matched by a wildcard.
+struct Capture {
+  std::size_t offset = 0;
+  std::size_t length = 0;
+};
+
+/// A shell-style wildcard pattern for a single path component, compiled once and then
+/// matched against any number of names.
+///
+/// Supported wildcards: `*` (any run of characters), `?` (any single character) and bracket
+/// expressions such as `[abc]`, `[a-z]` or `[!abc]`. An unterminated `[` is a literal.
+///
+/// The pattern is stored as literal runs, `?` runs and bracket classes separated by stars.
+/// Matching anchors the first and last of these segments at the ends of the name and places
+/// the remaining ones at their leftmost positions, so it never backtracks across a star and
+/// never allocates.
+class Matcher {
+public:
+  Matcher() = default;
+  explicit Matcher(const std::wstring &pattern);
+
+  /// Returns true if `name` matches the whole pattern.
+  bool match(std::wstring_view name) const;
+
+  /// Returns true if `name` matches the whole pattern and, if so, stores the position of the
+  /// text matched by each wildcard in `captures`, which must have room for `num_wildcards()`
+  /// elements.
+  ///
+  /// Every run of stars, `?` and bracket expression counts as one wildcard. As in a greedy
+  /// regular expression, each star matches as many characters as it can, earlier stars
+  /// taking precedence over later ones.
+  bool match(std::wstring_view name, Capture *captures) const;
+
+  /// Appends to `name` the pattern with each wildcard replaced by the corresponding element of
+  /// `values`, which must have `num_wildcards()` elements.
+  ///
+  /// The result matches the pattern only if each value is matched by its wildcard; for
+  /// instance, a value substituted for `?` may consist of several characters.
+  void substitute(const std::wstring_view *values, std::wstring &name) const;
+
+  /// Returns the number of wildcards in the pattern.
+  std::size_t num_wildcards() const { return num_wildcards_; }
+
+  /// Returns true if the pattern contains no wildcards.
+  bool is_literal() const { return segments_.size() == 1 && !has_non_literal_atoms_; }
+
+private:
+  enum class AtomKind : std::uint8_t { literal, any_char, char_class };
+
+  struct Atom {
+    AtomKind kind;
+    // literal: offset into literals_; char_class: index into classes_.
+    std::uint32_t index;
+    // Number of characters consumed by the atom.
+    std::uint32_t length;
+  };
+
+  /// Sequence of atoms between two stars (or a pattern end and a star).
+  struct Segment {
+    std::uint32_t begin_atom;
+    std::uint32_t end_atom;
+    std::size_t width;
+    // Index of the capture of the first wildcard in the segment.
+    std::size_t first_capture;
+  };
+
+  struct CharClass {
+    bool contains(wchar_t c) const;
+    void add_range(wchar_t first, wchar_t last);
+
+    // One bit per code unit below 256.
+    std::uint64_t low_bits[4] = {0, 0, 0, 0};
+    // Inclusive ranges of code units of 256 and above.
+    std::vector<std::pair<wchar_t, wchar_t>> high_ranges;
+    bool negated = false;
+  };
+
+  void append_literal(wchar_t c);
+  void append_any_char();
+  void append_char_class(CharClass char_class);
+  void append_star();
+
+  bool match_segment_at(const Segment &segment, std::wstring_view name, std::size_t pos) const;
+  std::size_t find_segment(const Segment &segment, std::wstring_view name, std::size_t from,
+                           std::size_t to) const;
+  std::size_t rfind_segment(const Segment &segment, std::wstring_view name, std::size_t from,
+                            std::size_t to) const;
+  void capture_segment(const Segment &segment, std::size_t pos, Capture *captures) const;
+
+  std::vector<Atom> atoms_;
+  std::vector<Segment> segments_{Segment{0, 0, 0, 0}};
+  std::vector<CharClass> classes_;
+  std::wstring literals_;
+  bool has_non_literal_atoms_ = false;
+  std::size_t num_wildcards_ = 0;
+};
+
+/// Translates a shell-style wildcard pattern into an equivalent ECMAScript regular expression.
+///
+/// This is the regex-based formulation `Matcher` replaces in the directory traversal; it is
+/// kept for reference and for benchmarking.
+std::wstring translate(const std::wstring &pattern);
+
+} // namespace glob
@@ -1,140 +1,35 @@
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <glob/batch_status.h>
+#include <glob/fnmatch.h>
 #include <glob/glob.h>
+#include <glob/listing_cache.h>
+#include <glob/parallel_walk.h>
 #include <iostream>
-#include <map>
+#include <limits>
 #include <regex>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
 
 namespace glob {
 
 namespace {
 
-bool string_replace(std::wstring &str, const std::wstring &from, const std::wstring &to) {
-  std::size_t start_pos = str.find(from);
-  if (start_pos == std::wstring::npos)
-    return false;
-  str.replace(start_pos, from.length(), to);
-  return true;
-}
-
-std::map<int, std::wstring> make_special_characters_map(const std::wstring& special_characters)
-{
-  std::map<int, std::wstring> special_characters_map;
-  for (auto& sc : special_characters)
-  {
-    special_characters_map.insert(
-      std::make_pair(static_cast<int>(sc), std::wstring{L"\\"} + std::wstring(1, sc)));
-  }
-  return special_characters_map;
-}
-
-std::wstring translate(const std::wstring &pattern) {
-  std::size_t i = 0, n = pattern.size();
-  std::wstring result_string;
-
-  while (i < n) {
-    auto c = pattern[i];
-    i += 1;
-    if (c == '*') {
-      result_string += L".*";
-    } else if (c == '?') {
-      result_string += L".";
-    } else if (c == '[') {
-      auto j = i;
-      if (j < n && pattern[j] == '!') {
-        j += 1;
-      }
-      if (j < n && pattern[j] == ']') {
-        j += 1;
-      }
-      while (j < n && pattern[j] != ']') {
-        j += 1;
-      }
-      if (j >= n) {
-        result_string += L"\\[";
-      } else {
-        auto stuff = std::wstring(pattern.begin() + i, pattern.begin() + j);
-        if (stuff.find(L"--") == std::wstring::npos) {
-          string_replace(stuff, std::wstring{L"\\"}, std::wstring{LR"(\\)"});
-        } else {
-          std::vector<std::wstring> chunks;
-          std::size_t k = 0;
-          if (pattern[i] == '!') {
-            k = i + 2;
-          } else {
-            k = i + 1;
-          }
-
-          while (true) {
-            k = pattern.find(L"-", k, j);
-            if (k == std::wstring::npos) {
-              break;
-            }
-            chunks.push_back(std::wstring(pattern.begin() + i, pattern.begin() + k));
-            i = k + 1;
-            k = k + 3;
-          }
-
-          chunks.push_back(std::wstring(pattern.begin() + i, pattern.begin() + j));
-          // Escape backslashes and hyphens for set difference (--).
-          // Hyphens that create ranges shouldn't be escaped.
-          bool first = true;
-          for (auto &s : chunks) {
-            string_replace(s, std::wstring{L"\\"}, std::wstring{LR"(\\)"});
-            string_replace(s, std::wstring{L"-"}, std::wstring{LR"(\-)"});
-            if (first) {
-              stuff += s;
-              first = false;
-            } else {
-              stuff += L"-" + s;
-            }
-          }
-        }
-
-        // Escape set operations (&&, ~~ and ||).
-        std::wstring result;
-        std::regex_replace(std::back_inserter(result),          // ressult
-                           stuff.begin(), stuff.end(),          // string
-                           std::wregex(std::wstring{LR"([&~|])"}), // pattern
-                           std::wstring{LR"(\\\1)"});             // repl
-        stuff = result;
-        i = j + 1;
-        if (stuff[0] == '!') {
-          stuff = L"^" + std::wstring(stuff.begin() + 1, stuff.end());
-        } else if (stuff[0] == '^' || stuff[0] == '[') {
-          stuff = L"\\\\" + stuff;
-        }
-        result_string = result_string + L"[" + stuff + L"]";
-      }
-    } else {
-      // SPECIAL_CHARS
-      // closing ')', '}' and ']'
-      // '-' (a range in character set)
-      // '&', '~', (extended character set operations)
-      // '#' (comment) and WHITESPACE (ignored) in verbose mode
-      static const std::wstring special_characters = L"()[]{}?*+-|^$\\.&~# \t\n\r\v\f";
-      static const std::map<int, std::wstring> special_characters_map = make_special_characters_map(special_characters);
-
-      if (special_characters.find(c) != std::wstring::npos) {
-        result_string += special_characters_map.at(static_cast<int>(c));
-      } else {
-        result_string += c;
-      }
-    }
-  }
-  return std::wstring{L"(("} + result_string + std::wstring{LR"()|[\r\n])$)"};
-}
-
-std::wregex compile_pattern(const std::wstring &pattern) {
-  return std::wregex(translate(pattern), std::wregex::ECMAScript);
-}
-
-/// Returns true if the input path matche the glob pattern
-bool fnmatch(const fs::path &name, const std::wstring &pattern) {
-  return std::regex_match(name.wstring(), compile_pattern(pattern));
-}
-
 fs::path expand_tilde(fs::path path) {
   if (path.empty()) return path;
 
@@ -169,90 +64,643 @@ bool is_hidden(const std::wstring &pathname) { return pathname[0] == '.'; }
 
 bool is_recursive(const std::wstring &pattern) { return pattern == L"**"; }
 
-std::vector<PathInfo> iter_directory(const fs::path &dirname, bool dironly,
-                                     const std::function<void()> &onFilesystemTraversalProgress) {
-  std::vector<PathInfo> result;
+bool is_excluded(const PathInfo &info, const TraversalOptions &options) {
+  if (options.exclude.empty()) {
+    return false;
+  }
+  const std::wstring name = info.path.filename().wstring();
+  return std::any_of(options.exclude.begin(), options.exclude.end(),
+                     [&name](const Matcher &matcher) { return matcher.match(name); });
+}
+
+bool is_cancelled(const TraversalOptions &options) {
+  return options.cancelled != nullptr && options.cancelled->load(std::memory_order_relaxed);
+}
 
-  auto current_directory = dirname;
-  if (current_directory.empty()) {
-    current_directory = fs::current_path();
+// Returns the prefix of the paths of the entries of `dirname`: `dirname` itself if it is
+// absolute, otherwise `dirname` made lexically relative to the current directory.
+fs::path entry_path_prefix(const fs::path &dirname) {
+  if (dirname.is_absolute()) {
+    return dirname;
   }
+  fs::path prefix = dirname.lexically_normal();
+  if (prefix == ".") {
+    prefix.clear();
+  }
+  return prefix;
+}
 
-  if (fs::exists(current_directory)) {
-    try {
-      for (auto &entry : fs::directory_iterator(
-              current_directory, fs::directory_options::follow_directory_symlink |
-                                      fs::directory_options::skip_permission_denied)) {
-        if (!dironly || entry.is_directory()) {
-          if (dirname.is_absolute()) {
-            result.emplace_back(entry.path(), entry.status());
-          } else {
-            result.emplace_back(fs::relative(entry.path()), entry.status());
+// Listings of directories changed more recently than this many nanoseconds before they are
+// read are not cached, and their stamps are not trusted: a change made right after the listing
+// was read could leave the directory's timestamps unchanged if they are coarse.
+constexpr std::int64_t MIN_STAMP_AGE_NS = 2000000000;
+
+#ifdef __linux__
+
+// Identifies a directory independently of the path it is reached by.
+struct DirectoryId {
+  dev_t device;
+  ino_t inode;
+
+  bool operator==(const DirectoryId &other) const {
+    return device == other.device && inode == other.inode;
+  }
+};
+
+struct DirectoryIdHash {
+  std::size_t operator()(const DirectoryId &id) const {
+    return std::hash<std::uint64_t>()(static_cast<std::uint64_t>(id.inode) * 31 +
+                                      static_cast<std::uint64_t>(id.device));
+  }
+};
+
+DirectoryStamp stamp_from_stat(const struct stat &dir_stat) {
+  return DirectoryStamp{
+      static_cast<std::uint64_t>(dir_stat.st_dev), static_cast<std::uint64_t>(dir_stat.st_ino),
+      dir_stat.st_mtim.tv_sec * std::int64_t(1000000000) + dir_stat.st_mtim.tv_nsec,
+      dir_stat.st_ctim.tv_sec * std::int64_t(1000000000) + dir_stat.st_ctim.tv_nsec};
+}
+
+// Returns true if the directory with stamp `stamp` has not changed for MIN_STAMP_AGE_NS.
+bool is_settled(const DirectoryStamp &stamp) {
+  const std::int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                               std::chrono::system_clock::now().time_since_epoch())
+                               .count();
+  return now - std::max(stamp.modification_time, stamp.change_time) >= MIN_STAMP_AGE_NS;
+}
+
+std::optional<DirectoryStamp> settled_stamp(const fs::path &dirname) {
+  const fs::path directory = dirname.empty() ? fs::path(".") : dirname;
+  struct stat dir_stat;
+  if (stat(directory.c_str(), &dir_stat) != 0 || !S_ISDIR(dir_stat.st_mode)) {
+    return std::nullopt;
+  }
+  const DirectoryStamp stamp = stamp_from_stat(dir_stat);
+  if (!is_settled(stamp)) {
+    return std::nullopt;
+  }
+  return stamp;
+}
+
+// Returns the type of a directory entry reported by `readdir`, or `none` if it is unknown
+// or the entry is a symbolic link, which needs to be followed.
+fs::file_type file_type_from_dirent(unsigned char d_type) {
+  switch (d_type) {
+  case DT_REG:
+    return fs::file_type::regular;
+  case DT_DIR:
+    return fs::file_type::directory;
+  case DT_FIFO:
+    return fs::file_type::fifo;
+  case DT_SOCK:
+    return fs::file_type::socket;
+  case DT_CHR:
+    return fs::file_type::character;
+  case DT_BLK:
+    return fs::file_type::block;
+  default:
+    return fs::file_type::none;
+  }
+}
+
+// Lists a directory with readdir, which reports the type of most entries without a stat per
+// entry; only symbolic links and entries of unknown type are stat'ed. Once the directory is
+// open, calls `on_open` with its identity (null if unknown) and stops if it returns false;
+// otherwise calls `on_entry` with each entry other than "." and "..".
+//
+// If `cache` is not null, the directory is stat'ed first, and its entries are taken from the
+// cache without opening it if its stamp has not changed since they were stored.
+template <typename OnOpen, typename OnEntry>
+void for_each_entry(const fs::path &dirname, ListingCache *cache, OnOpen &&on_open,
+                    OnEntry &&on_entry,
+                    const std::function<void()> &onFilesystemTraversalProgress) {
+  const fs::path directory = dirname.empty() ? fs::path(".") : dirname;
+  const fs::path prefix = entry_path_prefix(dirname);
+  const auto visit = [&](const char *name, fs::file_type type) {
+    fs::file_status status(type);
+    if (type == fs::file_type::none) {
+      std::error_code error;
+      status = fs::status(directory / name, error);
+    }
+    on_entry(PathInfo(prefix / name, status));
+    onFilesystemTraversalProgress();
+  };
+
+  fs::path cache_key;
+  std::optional<DirectoryStamp> stamp;
+  std::vector<CachedEntry> entries;
+  if (cache) {
+    struct stat dir_stat;
+    if (stat(directory.c_str(), &dir_stat) != 0 || !S_ISDIR(dir_stat.st_mode)) {
+      // not a directory, or not accessible
+      return;
+    }
+    const DirectoryId id{dir_stat.st_dev, dir_stat.st_ino};
+    if (!on_open(&id)) {
+      return;
+    }
+    std::error_code error;
+    cache_key = fs::absolute(directory, error).lexically_normal();
+    const DirectoryStamp current = stamp_from_stat(dir_stat);
+    if (!error) {
+      if (auto cached = cache->find(cache_key, current)) {
+        for (const CachedEntry &entry : *cached) {
+          visit(entry.name.c_str(), entry.type);
+        }
+        return;
+      }
+      if (is_settled(current)) {
+        stamp = current;
+      }
+    }
+  }
+
+  DIR *dir = opendir(directory.c_str());
+  if (dir == nullptr) {
+    // not a directory, or not accessible
+    return;
+  }
+  std::unique_ptr<DIR, int (*)(DIR *)> dir_closer(dir, &closedir);
+
+  if (!cache) {
+    // The descriptor is already open, so this costs no path lookup.
+    struct stat dir_stat;
+    if (fstat(dirfd(dir), &dir_stat) == 0) {
+      const DirectoryId id{dir_stat.st_dev, dir_stat.st_ino};
+      if (!on_open(&id)) {
+        return;
+      }
+    } else if (!on_open(static_cast<const DirectoryId *>(nullptr))) {
+      return;
+    }
+  }
+
+  while (true) {
+    errno = 0;
+    const dirent *entry = readdir(dir);
+    if (entry == nullptr) {
+      // An incomplete listing must not be cached.
+      if (errno != 0) {
+        stamp.reset();
+      }
+      break;
+    }
+    const char *name = entry->d_name;
+    if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+      continue;
+    }
+    const fs::file_type type = file_type_from_dirent(entry->d_type);
+    if (stamp) {
+      entries.push_back({name, type});
+    }
+    visit(name, type);
+  }
+  if (stamp) {
+    cache->store(cache_key, *stamp, std::move(entries));
+  }
+}
+
+#else
+
+// Identifies a directory by its canonical path; std::filesystem does not expose inodes.
+struct DirectoryId {
+  fs::path::string_type canonical_path;
+
+  bool operator==(const DirectoryId &other) const {
+    return canonical_path == other.canonical_path;
+  }
+};
+
+struct DirectoryIdHash {
+  std::size_t operator()(const DirectoryId &id) const {
+    return std::hash<fs::path::string_type>()(id.canonical_path);
+  }
+};
+
+DirectoryStamp stamp_from_write_time(const fs::file_time_type &write_time) {
+  return DirectoryStamp{
+      0, 0,
+      std::chrono::duration_cast<std::chrono::nanoseconds>(write_time.time_since_epoch()).count(),
+      0};
+}
+
+// Returns true if the directory last written at `write_time` has not changed for
+// MIN_STAMP_AGE_NS.
+bool is_settled(const fs::file_time_type &write_time) {
+  return fs::file_time_type::clock::now() - write_time >=
+         std::chrono::nanoseconds(MIN_STAMP_AGE_NS);
+}
+
+std::optional<DirectoryStamp> settled_stamp(const fs::path &dirname) {
+  const fs::path directory = dirname.empty() ? fs::current_path() : dirname;
+  std::error_code error;
+  if (!fs::is_directory(directory, error)) {
+    return std::nullopt;
+  }
+  const fs::file_time_type write_time = fs::last_write_time(directory, error);
+  if (error || !is_settled(write_time)) {
+    return std::nullopt;
+  }
+  return stamp_from_write_time(write_time);
+}
+
+// Calls `on_open` with the identity of a directory (null if unknown) and, unless it returns
+// false, `on_entry` with each entry of the directory.
+//
+// If `cache` is not null, the entries are taken from the cache if the directory's last write
+// time has not changed since they were stored.
+template <typename OnOpen, typename OnEntry>
+void for_each_entry(const fs::path &dirname, ListingCache *cache, OnOpen &&on_open,
+                    OnEntry &&on_entry,
+                    const std::function<void()> &onFilesystemTraversalProgress) {
+  const fs::path directory = dirname.empty() ? fs::current_path() : dirname;
+  const fs::path prefix = entry_path_prefix(dirname);
+  std::error_code error;
+  const fs::path canonical = fs::canonical(directory, error);
+  if (!error) {
+    const DirectoryId id{canonical.native()};
+    if (!on_open(&id)) {
+      return;
+    }
+  } else if (!on_open(static_cast<const DirectoryId *>(nullptr))) {
+    return;
+  }
+
+  std::optional<DirectoryStamp> stamp;
+  std::vector<CachedEntry> entries;
+  if (cache && !error) {
+    const fs::file_time_type write_time = fs::last_write_time(canonical, error);
+    if (!error) {
+      const DirectoryStamp current = stamp_from_write_time(write_time);
+      if (auto cached = cache->find(canonical, current)) {
+        for (const CachedEntry &entry : *cached) {
+          fs::file_status status(entry.type);
+          if (entry.type == fs::file_type::none) {
+            std::error_code status_error;
+            status = fs::status(directory / entry.name, status_error);
           }
+          on_entry(PathInfo(prefix / entry.name, status));
+          onFilesystemTraversalProgress();
         }
-        onFilesystemTraversalProgress();
+        return;
+      }
+      if (is_settled(write_time)) {
+        stamp = current;
       }
-    } catch (std::exception&) {
-      // not a directory
-      // do nothing
     }
   }
 
+  for (fs::directory_iterator it(directory,
+                                 fs::directory_options::follow_directory_symlink |
+                                     fs::directory_options::skip_permission_denied,
+                                 error);
+       !error && it != fs::directory_iterator(); it.increment(error)) {
+    std::error_code status_error;
+    const fs::file_status status = it->status(status_error);
+    if (stamp) {
+      const bool is_symlink = it->is_symlink(status_error);
+      entries.push_back({it->path().filename().native(),
+                         is_symlink ? fs::file_type::none : status.type()});
+    }
+    on_entry(PathInfo(prefix / it->path().filename(), status));
+    onFilesystemTraversalProgress();
+  }
+  if (stamp && !error) {
+    cache->store(canonical, *stamp, std::move(entries));
+  }
+}
+
+#endif
+
+std::vector<PathInfo> iter_directory(const fs::path &dirname, bool dironly, ListingCache *cache,
+                                     const std::function<void()> &onFilesystemTraversalProgress) {
+  std::vector<PathInfo> result;
+  for_each_entry(
+      dirname, cache, [](const DirectoryId *) { return true; },
+      [&](PathInfo &&info) {
+        if (!dironly || fs::is_directory(info.status)) {
+          result.push_back(std::move(info));
+        }
+      },
+      onFilesystemTraversalProgress);
   return result;
 }
 
-// Recursively yields relative pathnames inside a literal directory.
-std::vector<PathInfo> rlistdir(const fs::path &dirname, bool dironly,
-                               const std::function<void()> &onFilesystemTraversalProgress) {
+// Components following a "**" whose matches glob2 collects while walking the directory tree,
+// so that the directories it finds need not be listed again to match them.
+struct PushedDownComponents {
+  struct Filter {
+    const Matcher *matcher;
+    bool dironly;
+  };
+  std::vector<Filter> filters;
+  /// For each path found by glob2, the entries of that directory selected by `filters`.
+  std::vector<std::vector<PathInfo>> listings;
+
+  /// Returns true if `info`, an entry of a directory being walked, is matched by a filter.
+  bool selects(const PathInfo &info) const {
+    if (is_hidden(info.path.wstring())) {
+      return false;
+    }
+    const std::wstring name = info.path.filename().wstring();
+    for (const Filter &filter : filters) {
+      if ((!filter.dironly || fs::is_directory(info.status)) && filter.matcher->match(name)) {
+        return true;
+      }
+    }
+    return false;
+  }
+};
+
+// The entries listed by glob2's walk of a directory tree, in depth-first preorder, indexed by
+// the directory they were listed from.
+struct WalkedTree {
+  std::vector<PathInfo> entries;
+  /// For each directory listed, the index in `entries` of its first entry and the number of
+  /// its entries.
+  std::unordered_map<fs::path::string_type, std::pair<std::size_t, std::size_t>> listings;
+  /// next_sibling[i] is the index of the first entry following entries[i] and the entries
+  /// below it.
+  std::vector<std::size_t> next_sibling;
+
+  /// Indexes the entries of `dirname`, which start at `begin`, and of the directories below
+  /// it, and returns the index following them.
+  std::size_t index(const fs::path::string_type &dirname, std::size_t begin) {
+    auto it = listings.find(dirname);
+    if (it == listings.end()) {
+      return begin;
+    }
+    it->second.first = begin;
+    const std::size_t num_entries = it->second.second;
+    std::size_t next = begin;
+    for (std::size_t k = 0; k < num_entries; ++k) {
+      const std::size_t entry = next;
+      next = index(entries[entry].path.native(), entry + 1);
+      next_sibling[entry] = next;
+    }
+    return next;
+  }
+};
+
+// A directory listed by glob2, identified by the path it was listed by.
+struct ListedDirectory {
+  fs::path::string_type dirname;
+  // Number of levels below the directory the walk started from.
+  unsigned depth;
+};
+
+// Collects the results of glob2 from a walked tree in which each directory is listed only
+// once, however many paths lead to it. Each directory is reported under the path to it that
+// comes first in depth-first preorder with the entries of each directory sorted by name, i.e.
+// the lexicographically smallest one, whichever the walk happened to list it by; the other
+// paths to it are reported, but not the entries below them.
+struct AliasedTreeCollector {
+  AliasedTreeCollector(
+      WalkedTree &tree,
+      const std::unordered_map<fs::path::string_type, std::optional<DirectoryId>> &opened,
+      const std::unordered_map<DirectoryId, ListedDirectory, DirectoryIdHash> &listed,
+      const std::function<bool(const PathInfo &, unsigned)> &should_descend, unsigned max_depth)
+      : tree(tree), opened(opened), listed(listed), should_descend(should_descend),
+        max_depth(max_depth) {}
+
+  WalkedTree &tree;
+  // Identity of each directory the walk opened, keyed by the path it was opened by; null if
+  // it is unknown.
+  const std::unordered_map<fs::path::string_type, std::optional<DirectoryId>> &opened;
+  const std::unordered_map<DirectoryId, ListedDirectory, DirectoryIdHash> &listed;
+  const std::function<bool(const PathInfo &, unsigned)> &should_descend;
+  unsigned max_depth;
+
+  std::unordered_set<DirectoryId, DirectoryIdHash> reported;
   std::vector<PathInfo> result;
-  auto infos = iter_directory(dirname, dironly, onFilesystemTraversalProgress);
-  for (auto &x : infos) {
-    if (!is_hidden(x.path.wstring())) {
-      result.push_back(x);
-      for (auto &y : rlistdir(x.path, dironly, onFilesystemTraversalProgress)) {
-        result.push_back(y);
+  // sources[i] is the directory whose listing holds the entries of result[i], if any.
+  std::vector<std::optional<fs::path::string_type>> sources;
+
+  /// Returns the directory whose listing holds the entries of `path`, an entry the walk may
+  /// have descended into, unless they are reported under another path.
+  std::optional<fs::path::string_type> source_of(const fs::path::string_type &path) {
+    auto it = opened.find(path);
+    if (it == opened.end()) {
+      return std::nullopt;
+    }
+    if (!it->second) {
+      return path;
+    }
+    if (!reported.insert(*it->second).second) {
+      return std::nullopt;
+    }
+    auto listed_it = listed.find(*it->second);
+    if (listed_it == listed.end()) {
+      return std::nullopt;
+    }
+    return listed_it->second.dirname;
+  }
+
+  /// Reports the entries listed from `source`, found `depth` levels below the root, as entries
+  /// of `dirname`.
+  void collect(const fs::path::string_type &source, const fs::path &dirname, unsigned depth) {
+    if (depth >= max_depth) {
+      return;
+    }
+    auto it = tree.listings.find(source);
+    if (it == tree.listings.end()) {
+      return;
+    }
+    std::vector<std::pair<fs::path::string_type, std::size_t>> entries;
+    entries.reserve(it->second.second);
+    for (std::size_t k = 0, entry = it->second.first; k < it->second.second;
+         ++k, entry = tree.next_sibling[entry]) {
+      entries.emplace_back(tree.entries[entry].path.filename().native(), entry);
+    }
+    std::sort(entries.begin(), entries.end());
+
+    const bool moved = dirname.native() != source;
+    const fs::path prefix = moved ? entry_path_prefix(dirname) : fs::path();
+    for (const auto &[name, entry] : entries) {
+      PathInfo info = std::move(tree.entries[entry]);
+      std::optional<fs::path::string_type> child_source;
+      if (should_descend(info, depth + 1)) {
+        child_source = source_of(info.path.native());
+      }
+      if (moved) {
+        info.path = prefix / info.path.filename();
+      }
+      result.push_back(std::move(info));
+      sources.push_back(child_source);
+      if (child_source) {
+        const fs::path child = result.back().path;
+        collect(*child_source, child, depth + 1);
       }
     }
   }
-  return result;
-}
+};
 
 // This helper function recursively yields relative pathnames inside a literal
 // directory.
+//
+// If `pushed_down` is not null, the entries of each directory walked that its filters select
+// are stored in its `listings`, and the other entries are dropped as soon as they are read.
+//
+// Each directory is listed only once, however many symbolic links or bind mounts lead to it,
+// and its entries are reported under the lexicographically smallest path to it, so that the
+// results do not depend on the order in which the concurrent walk lists directories. A link
+// to a directory leading to it (a cycle) is therefore never followed.
 std::vector<PathInfo> glob2(const PathInfo &dirinfo, [[maybe_unused]] const fs::path &pattern,
-                            bool dironly,
-                            const std::function<void()> &onFilesystemTraversalProgress) {
+                            bool dironly, PushedDownComponents *pushed_down,
+                            const std::function<void()> &onFilesystemTraversalProgress,
+                            const TraversalOptions &options) {
   // std::cout << "In glob2\n";
-  std::vector<PathInfo> result{{".", dirinfo.status}};
   assert(is_recursive(pattern.wstring()));
-  for (auto &dir : rlistdir(dirinfo.path, dironly, onFilesystemTraversalProgress)) {
-    result.push_back(dir);
+
+  // Entries deeper than this are not results. Directories at this depth are still listed if
+  // the components following "**" need their entries.
+  const unsigned max_depth =
+      options.max_recursive_depth.value_or(std::numeric_limits<unsigned>::max());
+
+  std::mutex selected_mutex;
+  std::unordered_map<fs::path::string_type, std::vector<PathInfo>> selected_by_directory;
+
+  // Listing anything but a directory yields nothing.
+  const std::function<bool(const PathInfo &, unsigned)> should_descend =
+      [&](const PathInfo &info, unsigned depth) {
+        return fs::is_directory(info.status) &&
+               (depth < max_depth || (pushed_down && depth == max_depth)) &&
+               (!options.should_search || options.should_search(info.path));
+      };
+
+  // The directories opened and listed so far, shared by all the workers of the walk.
+  std::mutex listed_mutex;
+  std::unordered_map<fs::path::string_type, std::optional<DirectoryId>> opened;
+  std::unordered_map<DirectoryId, ListedDirectory, DirectoryIdHash> listed;
+  WalkedTree tree;
+
+  const auto list_directory = [&](const fs::path &dirname, unsigned depth,
+                                  const std::function<void()> &on_entry_visited) {
+    std::vector<PathInfo> infos;
+    if (is_cancelled(options)) {
+      return infos;
+    }
+    std::vector<PathInfo> selected;
+    bool skipped = false;
+    const auto on_open = [&](const DirectoryId *id) {
+      {
+        std::lock_guard<std::mutex> lock(listed_mutex);
+        opened.emplace(dirname.native(),
+                       id ? std::optional<DirectoryId>(*id) : std::optional<DirectoryId>());
+        if (id != nullptr) {
+          auto [it, inserted] = listed.try_emplace(*id, ListedDirectory{dirname.native(), depth});
+          if (!inserted) {
+            // Another path leads to a directory already listed. Reached at a shallower depth,
+            // it is listed again only if the depth is limited, as more of its subtree then lies
+            // within the limit.
+            if (it->second.depth <= depth ||
+                max_depth == std::numeric_limits<unsigned>::max()) {
+              if (options.num_skipped_cycles) {
+                ++*options.num_skipped_cycles;
+              }
+              skipped = true;
+              return false;
+            }
+            it->second = ListedDirectory{dirname.native(), depth};
+          }
+        }
+      }
+      // Reported before any entry is read, so that a change made meanwhile is not missed by
+      // a caller recording the state of the directory.
+      if (options.on_directory_searched) {
+        options.on_directory_searched(dirname);
+      }
+      return true;
+    };
+    for_each_entry(
+        dirname, options.listing_cache, on_open,
+        [&](PathInfo &&info) {
+          if (is_excluded(info, options)) {
+            return;
+          }
+          if (pushed_down && pushed_down->selects(info)) {
+            selected.push_back(info);
+          }
+          if ((!dironly || fs::is_directory(info.status)) && !is_hidden(info.path.wstring())) {
+            infos.push_back(std::move(info));
+          }
+        },
+        on_entry_visited);
+    if (skipped) {
+      return infos;
+    }
+    {
+      std::lock_guard<std::mutex> lock(listed_mutex);
+      tree.listings[dirname.native()] = {0, infos.size()};
+    }
+    if (pushed_down) {
+      std::lock_guard<std::mutex> lock(selected_mutex);
+      selected_by_directory[dirname.native()] = std::move(selected);
+    }
+    return infos;
+  };
+  tree.entries = walk(dirinfo.path, list_directory, should_descend, onFilesystemTraversalProgress,
+                      options.max_concurrency);
+  tree.next_sibling.resize(tree.entries.size());
+  tree.index(dirinfo.path.native(), 0);
+
+  AliasedTreeCollector collector{tree, opened, listed, should_descend, max_depth};
+  collector.result.push_back({".", dirinfo.status});
+  collector.sources.push_back(collector.source_of(dirinfo.path.native()));
+  if (collector.sources.back()) {
+    collector.collect(*collector.sources.back(), dirinfo.path, 0);
   }
-  return result;
+
+  if (pushed_down) {
+    pushed_down->listings.clear();
+    for (std::size_t i = 0; i < collector.result.size(); ++i) {
+      std::vector<PathInfo> selected;
+      if (collector.sources[i]) {
+        auto it = selected_by_directory.find(*collector.sources[i]);
+        if (it != selected_by_directory.end()) {
+          selected = std::move(it->second);
+        }
+      }
+      const fs::path &dirname = i == 0 ? dirinfo.path : collector.result[i].path;
+      if (collector.sources[i] && dirname.native() != *collector.sources[i]) {
+        const fs::path prefix = entry_path_prefix(dirname);
+        for (PathInfo &info : selected) {
+          info.path = prefix / info.path.filename();
+        }
+      }
+      pushed_down->listings.push_back(std::move(selected));
+    }
+  }
+  return std::move(collector.result);
 }
 
 // These 2 helper functions non-recursively glob inside a literal directory.
 // They return a list of basenames.  _glob1 accepts a pattern while _glob0
 // takes a literal basename (so it only has to check for its existence).
 
-std::vector<PathInfo> glob1(const PathInfo &dirinfo, const fs::path &pattern,
-                            bool dironly,
-                            const std::function<void()> &onFilesystemTraversalProgress) {
+std::vector<PathInfo> glob1(const std::vector<PathInfo> &infos, const Matcher &matcher,
+                            bool dironly, const TraversalOptions &options) {
   // std::cout << "In glob1\n";
-  auto infos = iter_directory(dirinfo.path, dironly, onFilesystemTraversalProgress);
   std::vector<PathInfo> result;
   for (auto &info : infos) {
+    if (dironly && !fs::is_directory(info.status)) {
+      continue;
+    }
+    if (is_excluded(info, options)) {
+      continue;
+    }
     if (!is_hidden(info.path.wstring())) {
-      if (fnmatch(info.path.filename(), pattern.wstring()))
+      if (matcher.match(info.path.filename().wstring()))
         result.push_back(info);
     }
   }
   return result;
 }
 
+// `status` is the status of `dirinfo.path / basename`, checked beforehand together with the
+// other literal paths.
 std::vector<PathInfo> glob0(const PathInfo &dirinfo, const fs::path &basename,
-                            bool /*dironly*/, 
-                            const std::function<void()> &onFilesystemTraversalProgress) {
+                            const fs::file_status &status, bool /*dironly*/) {
   // std::cout << "In glob0\n";
   std::vector<PathInfo> result;
   if (basename.empty()) {
@@ -261,106 +709,489 @@ std::vector<PathInfo> glob0(const PathInfo &dirinfo, const fs::path &basename,
       result = {{basename, dirinfo.status}};
     }
   } else {
-    if (fs::file_status status = fs::status(dirinfo.path / basename); fs::exists(status)) {
+    if (fs::exists(status)) {
       result = {{basename, status}};
     }
   }
-  onFilesystemTraversalProgress();  
   return result;
 }
 
-std::vector<PathInfo> glob(const fs::path &inpath, 
-                           const std::function<void()> &onFilesystemTraversalProgress,
-                           bool recursive = false,
-                           bool dironly = false) {
-  std::vector<PathInfo> result;
+// Number of paths whose existence is checked between two calls of the progress callback.
+constexpr std::size_t STATUS_BATCH_SIZE = 4096;
 
-  const auto pathname = inpath.wstring();
-  auto path = fs::path(pathname);
+// Number of directories a thread stamps at a time in `directory_stamps`.
+constexpr std::size_t STAMP_CHUNK_SIZE = 64;
 
-  if (pathname[0] == '~') {
-    // expand tilde
-    path = expand_tilde(path);
+// Returns the status of each of `paths`, checked in large concurrent batches, and calls
+// `onFilesystemTraversalProgress` once per path.
+std::vector<fs::file_status>
+status_in_batches(const std::vector<fs::path> &paths,
+                  const std::function<void()> &onFilesystemTraversalProgress,
+                  const TraversalOptions &options) {
+  std::vector<fs::file_status> result;
+  result.reserve(paths.size());
+  for (std::size_t begin = 0; begin < paths.size(); begin += STATUS_BATCH_SIZE) {
+    if (is_cancelled(options)) {
+      result.resize(paths.size(), fs::file_status(fs::file_type::not_found));
+      break;
+    }
+    const std::size_t end = std::min(begin + STATUS_BATCH_SIZE, paths.size());
+    const std::vector<fs::path> batch(paths.begin() + begin, paths.begin() + end);
+    for (auto &status : status_each(batch, true, options)) {
+      result.push_back(status);
+      onFilesystemTraversalProgress();
+    }
+  }
+  return result;
+}
+
+// Returns true if the `index`th path found by globbing `component` would also have been found
+// if only directories had been requested.
+bool found_if_dironly(const Pattern::Component &component, const std::vector<PathInfo> &found,
+                      std::size_t index) {
+  if (!component.magic) {
+    // glob0 ignores `dironly`.
+    return true;
+  }
+  if (component.recursive && index == 0) {
+    // glob2 always yields the directory itself first.
+    return true;
+  }
+  return fs::is_directory(found[index].status);
+}
+
+// Returns a path found by globbing a component in `dirinfo`, prefixed with the path of
+// `dirinfo`.
+PathInfo joined_path(const PathInfo &dirinfo, PathInfo info) {
+  if (dirinfo.path.empty()) {
+    // Paths found in the current directory are already relative to it.
+    return info;
   }
+  // Paths found by glob0 and the "." found by glob2 are relative to `dirinfo`. Their status
+  // is already known unless `dirinfo` is not a directory, in which case the joined path
+  // refers to nothing.
+  if (info.path.parent_path().empty()) {
+    info.path = dirinfo.path / info.path;
+    if (!fs::is_directory(dirinfo.status)) {
+      info.status = fs::status(info.path);
+    }
+  }
+  info.path = info.path.lexically_normal();
+  return info;
+}
 
-  auto dirname = path.parent_path();
-  const auto basename = path.filename();
+// Calls `options.on_directory_searched` with the nearest ancestor of `dirname` that is a
+// directory, `dirname` not being one: it can only become one through a change to that ancestor.
+void report_nearest_existing_directory(const fs::path &dirname, const TraversalOptions &options) {
+  fs::path ancestor = dirname;
+  std::error_code error;
+  do {
+    if (ancestor.empty() || ancestor == ancestor.parent_path()) {
+      return;
+    }
+    ancestor = ancestor.parent_path();
+  } while (!fs::is_directory(ancestor.empty() ? fs::path(".") : ancestor, error));
+  options.on_directory_searched(ancestor);
+}
 
-  if (!has_magic(pathname)) {
-    assert(!dironly);
-    if (!basename.empty()) {
-      if (fs::file_status status = fs::status(path); fs::exists(status)) {
-        result.emplace_back(path, status);
+// A node of the trie formed by the components of a set of patterns, starting from the first
+// component containing wildcards. Patterns with the same base and leading components share
+// nodes, so the directories these components match are globbed only once.
+struct TrieNode {
+  // Null for the root.
+  const Pattern::Component *component = nullptr;
+  // Indices of the patterns ending with this node's component.
+  std::vector<std::size_t> patterns;
+  std::vector<std::unique_ptr<TrieNode>> children;
+};
+
+TrieNode &child_node(TrieNode &node, const Pattern::Component &component) {
+  for (auto &child : node.children) {
+    if (child->component->text == component.text &&
+        child->component->recursive == component.recursive) {
+      return *child;
+    }
+  }
+  node.children.push_back(std::make_unique<TrieNode>());
+  node.children.back()->component = &component;
+  return *node.children.back();
+}
+
+// Globs the components of the children of `node` in each of `dirinfos`, then recursively the
+// components of their children in the paths found, passing the paths found for each pattern
+// to `sink`.
+//
+// If `listings` is not null, it holds the entries of each of `dirinfos` that the wildcard
+// components of the children may match, collected by the glob2 call that found `dirinfos`;
+// these directories are then not listed again.
+//
+// Directories rejected by `options.should_search` are skipped.
+void glob_children(const TrieNode &node, std::vector<PathInfo> dirinfos,
+                   std::vector<std::vector<PathInfo>> *listings, const PathSink &sink,
+                   const std::function<void()> &onFilesystemTraversalProgress,
+                   const TraversalOptions &options) {
+  if (options.should_search) {
+    std::size_t num_kept = 0;
+    for (std::size_t d = 0; d < dirinfos.size(); ++d) {
+      if (!options.should_search(dirinfos[d].path)) {
+        continue;
       }
-    } else {
-      // Patterns ending with a slash should match only directories
-      if (fs::file_status status = fs::status(dirname); fs::is_directory(dirname)) {
-        result.emplace_back(path, status);
+      if (num_kept != d) {
+        dirinfos[num_kept] = std::move(dirinfos[d]);
+        if (listings) {
+          (*listings)[num_kept] = std::move((*listings)[d]);
+        }
       }
+      ++num_kept;
+    }
+    dirinfos.erase(dirinfos.begin() + num_kept, dirinfos.end());
+    if (listings) {
+      listings->resize(num_kept);
     }
-    return result;
   }
 
-  if (dirname.empty()) {
-    PathInfo dirinfo{dirname, fs::status(dirname)};
-    if (recursive && is_recursive(basename.wstring())) {
-      return glob2(dirinfo, basename, dironly, onFilesystemTraversalProgress);
-    } else {
-      return glob1(dirinfo, basename, dironly, onFilesystemTraversalProgress);
+  const std::size_t num_children = node.children.size();
+  // Paths found by each child that are to be globbed further. Only these are kept; the others
+  // go straight to the sink.
+  std::vector<std::vector<PathInfo>> dirs_found_by_child(num_children);
+  // For the children matching "**", the components after it that can be matched while walking
+  // the directory tree, and the entries they select in each of `dirs_found_by_child`.
+  std::vector<PushedDownComponents> pushed_down_by_child(num_children);
+  std::vector<std::vector<std::vector<PathInfo>>> listings_by_child(num_children);
+  for (std::size_t i = 0; i < num_children; ++i) {
+    const TrieNode &child = *node.children[i];
+    if (child.component->recursive) {
+      for (auto &grandchild : child.children) {
+        const Pattern::Component &component = *grandchild->component;
+        if (component.magic && !component.recursive) {
+          pushed_down_by_child[i].filters.push_back(
+              {&component.matcher, grandchild->patterns.empty()});
+        }
+      }
     }
   }
 
-  std::vector<PathInfo> dirinfos;
-  if (dirname != fs::path(pathname) && has_magic(dirname.wstring())) {
-    dirinfos = glob(dirname, onFilesystemTraversalProgress, recursive, true);
-  } else {
-    dirinfos = {{dirname, fs::status(dirname)}};
+  // Each directory is listed at most once, however many wildcard components are matched
+  // against its entries.
+  bool listing_dironly = true;
+  for (auto &child : node.children) {
+    if (child->component->magic && !child->component->recursive && !child->patterns.empty()) {
+      listing_dironly = false;
+    }
   }
 
-  std::function<std::vector<PathInfo>(const PathInfo &, const fs::path &, bool, const std::function<void()> &)>
-      glob_in_dir;
-  if (has_magic(basename.wstring())) {
-    if (recursive && is_recursive(basename.wstring())) {
-      glob_in_dir = glob2;
-    } else {
-      glob_in_dir = glob1;
+  // The literal components are looked up in all the directories at once, so that the checks
+  // can run concurrently. literal_statuses[i][d] is the status of the path formed by the
+  // component of child i in dirinfos[d].
+  std::vector<std::vector<fs::file_status>> literal_statuses(num_children);
+  {
+    std::vector<fs::path> literal_paths;
+    for (std::size_t i = 0; i < num_children; ++i) {
+      const Pattern::Component &component = *node.children[i]->component;
+      if (!component.magic && !component.text.empty()) {
+        for (auto &dirinfo : dirinfos) {
+          literal_paths.push_back(dirinfo.path / component.text);
+        }
+      }
+    }
+    const std::vector<fs::file_status> statuses =
+        status_in_batches(literal_paths, onFilesystemTraversalProgress, options);
+    auto next_status = statuses.begin();
+    for (std::size_t i = 0; i < num_children; ++i) {
+      const Pattern::Component &component = *node.children[i]->component;
+      if (!component.magic && !component.text.empty()) {
+        literal_statuses[i].assign(next_status, next_status + dirinfos.size());
+        next_status += dirinfos.size();
+      }
     }
-  } else {
-    glob_in_dir = glob0;
   }
 
-  for (auto &dirinfo : dirinfos) {
-    for (auto &info : glob_in_dir(dirinfo, basename, dironly, onFilesystemTraversalProgress)) {
-      PathInfo subresult = info;
-      if (info.path.parent_path().empty()) {
-        subresult.path = dirinfo.path / info.path;
-        subresult.status = fs::status(subresult.path);
+  for (std::size_t d = 0; d < dirinfos.size(); ++d) {
+    if (is_cancelled(options)) {
+      return;
+    }
+    const PathInfo &dirinfo = dirinfos[d];
+    if (options.on_directory_searched) {
+      if (fs::is_directory(dirinfo.status)) {
+        options.on_directory_searched(dirinfo.path);
+      } else {
+        // The base of a pattern that does not exist (yet).
+        report_nearest_existing_directory(dirinfo.path, options);
+      }
+    }
+    std::vector<PathInfo> listing;
+    bool listed = false;
+    for (std::size_t i = 0; i < num_children; ++i) {
+      const TrieNode &child = *node.children[i];
+      const Pattern::Component &component = *child.component;
+      // Only directories can be globbed further; if no pattern ends here, nothing else is needed.
+      const bool dironly = child.patterns.empty();
+
+      std::vector<PathInfo> found;
+      if (!component.magic) {
+        if (component.text.empty()) {
+          found = glob0(dirinfo, component.text, fs::file_status(), dironly);
+          onFilesystemTraversalProgress();
+        } else {
+          found = glob0(dirinfo, component.text, literal_statuses[i][d], dironly);
+        }
+      } else if (component.recursive) {
+        PushedDownComponents *pushed_down =
+            pushed_down_by_child[i].filters.empty() ? nullptr : &pushed_down_by_child[i];
+        found = glob2(dirinfo, component.text, dironly, pushed_down, onFilesystemTraversalProgress,
+                      options);
+      } else {
+        if (!listed) {
+          if (listings) {
+            listing = std::move((*listings)[d]);
+          } else {
+            listing =
+                iter_directory(dirinfo.path, listing_dironly, options.listing_cache,
+                               onFilesystemTraversalProgress);
+          }
+          listed = true;
+        }
+        found = glob1(listing, component.matcher, dironly, options);
+      }
+
+      for (std::size_t k = 0; k < found.size(); ++k) {
+        const bool globbed_further =
+            !child.children.empty() && (dironly || found_if_dironly(component, found, k));
+        PathInfo info = joined_path(dirinfo, std::move(found[k]));
+        if (globbed_further) {
+          dirs_found_by_child[i].push_back(info);
+          if (!pushed_down_by_child[i].filters.empty()) {
+            listings_by_child[i].push_back(std::move(pushed_down_by_child[i].listings[k]));
+          }
+        }
+        for (std::size_t p = 0; p < child.patterns.size(); ++p) {
+          if (p + 1 < child.patterns.size()) {
+            sink(child.patterns[p], PathInfo(info));
+          } else {
+            sink(child.patterns[p], std::move(info));
+          }
+        }
       }
-      subresult.path = subresult.path.lexically_normal();
-      result.push_back(std::move(subresult));
     }
   }
 
-  return result;
+  for (std::size_t i = 0; i < num_children; ++i) {
+    const TrieNode &child = *node.children[i];
+    if (!child.children.empty()) {
+      glob_children(child, std::move(dirs_found_by_child[i]),
+                    pushed_down_by_child[i].filters.empty() ? nullptr : &listings_by_child[i],
+                    sink, onFilesystemTraversalProgress, options);
+      dirs_found_by_child[i] = {};
+      listings_by_child[i] = {};
+    }
+  }
+}
+
+bool is_separator(wchar_t c) {
+  return c == '/' || c == static_cast<wchar_t>(fs::path::preferred_separator);
 }
 
 } // namespace end
 
+Pattern::Pattern(const std::wstring &pathname, bool recursive) : path_(pathname) {
+  if (pathname[0] == '~') {
+    // expand tilde
+    path_ = expand_tilde(path_);
+  }
+
+  const std::wstring expanded = path_.wstring();
+  first_magic_component_ = std::wstring::npos;
+  std::size_t begin = 0;
+  while (true) {
+    std::size_t end = begin;
+    while (end < expanded.size() && !is_separator(expanded[end])) {
+      end += 1;
+    }
+
+    Component component;
+    component.text = expanded.substr(begin, end - begin);
+    component.magic = has_magic(component.text);
+    component.recursive = component.magic && recursive && is_recursive(component.text);
+    if (component.magic && !component.recursive) {
+      component.matcher = Matcher(component.text);
+    }
+    if (component.magic && first_magic_component_ == std::wstring::npos) {
+      first_magic_component_ = components_.size();
+      base_ = fs::path(expanded.substr(0, end)).parent_path();
+    }
+
+    const bool redundant = component.text.empty() && end < expanded.size() &&
+                           first_magic_component_ != std::wstring::npos;
+    if (!redundant) {
+      components_.push_back(std::move(component));
+    }
+    if (end == expanded.size()) {
+      break;
+    }
+    begin = end + 1;
+  }
+
+  if (first_magic_component_ == std::wstring::npos) {
+    first_magic_component_ = components_.size();
+  }
+}
+
+std::vector<std::optional<DirectoryStamp>> directory_stamps(const std::vector<fs::path> &dirnames,
+                                                           const TraversalOptions &options) {
+  std::vector<std::optional<DirectoryStamp>> result(dirnames.size());
+  const unsigned num_threads = static_cast<unsigned>(std::min<std::size_t>(
+      options.max_concurrency > 0 ? options.max_concurrency : std::thread::hardware_concurrency(),
+      (dirnames.size() + STAMP_CHUNK_SIZE - 1) / STAMP_CHUNK_SIZE));
+
+  std::atomic<std::size_t> next_chunk{0};
+  const auto work = [&] {
+    while (true) {
+      const std::size_t begin = next_chunk.fetch_add(STAMP_CHUNK_SIZE);
+      if (begin >= dirnames.size()) {
+        break;
+      }
+      const std::size_t end = std::min(begin + STAMP_CHUNK_SIZE, dirnames.size());
+      for (std::size_t i = begin; i < end; ++i) {
+        result[i] = settled_stamp(dirnames[i]);
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (unsigned t = 1; t < num_threads; ++t) {
+    try {
+      threads.emplace_back(work);
+    } catch (const std::system_error &) {
+      // Make do with the threads started so far.
+      break;
+    }
+  }
+  work();
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  return result;
+}
+
+void glob_each_streamed(const std::vector<const Pattern *> &patterns, const PathSink &sink,
+                        const std::function<void()> &onFilesystemTraversalProgress,
+                        const TraversalOptions &options) {
+
+  // Patterns with the same base form one trie.
+  std::vector<std::pair<fs::path, std::unique_ptr<TrieNode>>> roots;
+
+  // Patterns without wildcards are checked together once the others have been sorted out.
+  std::vector<std::size_t> literal_patterns;
+  std::vector<fs::path> literal_paths;
+
+  for (std::size_t i = 0; i < patterns.size(); ++i) {
+    const Pattern &pattern = *patterns[i];
+    const auto &path = pattern.path();
+    const auto &components = pattern.components();
+
+    if (pattern.first_magic_component() == components.size()) {
+      auto dirname = path.parent_path();
+      const auto basename = path.filename();
+      if (options.should_search && !options.should_search(dirname)) {
+        continue;
+      }
+      if (!basename.empty()) {
+        literal_patterns.push_back(i);
+        literal_paths.push_back(path);
+        if (options.on_directory_searched) {
+          std::error_code error;
+          if (fs::is_directory(dirname.empty() ? fs::path(".") : dirname, error)) {
+            options.on_directory_searched(dirname);
+          } else {
+            report_nearest_existing_directory(dirname, options);
+          }
+        }
+      } else {
+        // Patterns ending with a slash should match only directories
+        if (fs::file_status status = fs::status(dirname); fs::is_directory(dirname)) {
+          sink(i, PathInfo(path, status));
+        }
+      }
+      continue;
+    }
+
+    auto root = std::find_if(roots.begin(), roots.end(),
+                             [&pattern](const auto &root) { return root.first == pattern.base(); });
+    if (root == roots.end()) {
+      roots.emplace_back(pattern.base(), std::make_unique<TrieNode>());
+      root = roots.end() - 1;
+    }
+    TrieNode *node = root->second.get();
+    for (std::size_t c = pattern.first_magic_component(); c < components.size(); ++c) {
+      node = &child_node(*node, components[c]);
+    }
+    node->patterns.push_back(i);
+  }
+
+  const std::vector<fs::file_status> literal_statuses =
+      status_in_batches(literal_paths, onFilesystemTraversalProgress, options);
+  for (std::size_t k = 0; k < literal_patterns.size(); ++k) {
+    if (fs::exists(literal_statuses[k])) {
+      sink(literal_patterns[k], PathInfo(literal_paths[k], literal_statuses[k]));
+    }
+  }
+
+  // Glob the components one by one, starting from the directory containing the first
+  // one with wildcards. All components but the last must match directories.
+  for (auto &[dirname, root] : roots) {
+    const std::vector<PathInfo> dirinfos{{dirname, fs::status(dirname)}};
+    glob_children(*root, dirinfos, nullptr, sink, onFilesystemTraversalProgress, options);
+  }
+}
+
+std::vector<std::vector<PathInfo>>
+glob_each(const std::vector<const Pattern *> &patterns,
+          const std::function<void()> &onFilesystemTraversalProgress,
+          const TraversalOptions &options) {
+  std::vector<std::vector<PathInfo>> results(patterns.size());
+  glob_each_streamed(
+      patterns,
+      [&results](std::size_t pattern_index, PathInfo &&info) {
+        results[pattern_index].push_back(std::move(info));
+      },
+      onFilesystemTraversalProgress, options);
+  return results;
+}
+
+void glob_streamed(const Pattern &pattern, const std::function<void(PathInfo &&)> &sink,
+                   const std::function<void()> &onFilesystemTraversalProgress,
+                   const TraversalOptions &options) {
+  glob_each_streamed(
+      {&pattern}, [&sink](std::size_t /*pattern_index*/, PathInfo &&info) { sink(std::move(info)); },
+      onFilesystemTraversalProgress, options);
+}
+
+std::vector<PathInfo> glob(const Pattern &pattern,
+                           const std::function<void()> &onFilesystemTraversalProgress,
+                           const TraversalOptions &options) {
+  return std::move(glob_each({&pattern}, onFilesystemTraversalProgress, options).front());
+}
+
 std::vector<PathInfo> glob(const std::wstring &pathname, 
                            const std::function<void()> &onFilesystemTraversalProgress) {
-  return glob(pathname, onFilesystemTraversalProgress, false);
+  return glob(Pattern(pathname, false), onFilesystemTraversalProgress);
 }
 
 std::vector<PathInfo> rglob(const std::wstring &pathname,
                             const std::function<void()> &onFilesystemTraversalProgress) {
-  return glob(pathname, onFilesystemTraversalProgress, true);
+  return glob(Pattern(pathname, true), onFilesystemTraversalProgress);
+}
+
+void rglob(const std::wstring &pathname, const std::function<void(PathInfo &&)> &sink,
+           const std::function<void()> &onFilesystemTraversalProgress) {
+  glob_streamed(Pattern(pathname, true), sink, onFilesystemTraversalProgress);
 }
 
 std::vector<PathInfo> glob(const std::vector<std::wstring> &pathnames,
                            const std::function<void()> &onFilesystemTraversalProgress) {
   std::vector<PathInfo> result;
   for (auto &pathname : pathnames) {
-    for (auto &match : glob(pathname, onFilesystemTraversalProgress, false)) {
+    for (auto &match : glob(Pattern(pathname, false), onFilesystemTraversalProgress)) {
       result.push_back(std::move(match));
     }
   }
@@ -371,7 +1202,7 @@ std::vector<PathInfo> rglob(const std::vector<std::wstring> &pathnames,
                             const std::function<void()> &onFilesystemTraversalProgress) {
   std::vector<PathInfo> result;
   for (auto &pathname : pathnames) {
-    for (auto &match : glob(pathname, onFilesystemTraversalProgress, true)) {
+    for (auto &match : glob(Pattern(pathname, true), onFilesystemTraversalProgress)) {
       result.push_back(std::move(match));
     }
   }
@@ -1,9 +1,14 @@
 
 #pragma once
+#include <atomic>
+#include <functional>
+#include <optional>
 #include <string>
 #include <vector>
 
 #include "ghc/fs_std_fwd.hpp"
+#include "glob/fnmatch.h"
+#include "glob/listing_cache.h"
 
 namespace glob {
 
@@ -14,9 +19,134 @@ struct PathInfo
   {}
 
   fs::path path;
+  /// Status of the file `path` refers to (following symbolic links). The type is always set,
+  /// but the permissions may be unknown if the type was obtained without a stat call.
   fs::file_status status;
 };
 
+/// A path specification split at directory separators, with the components containing
+/// wildcards compiled once.
+///
+/// A Pattern can be globbed any number of times. Its components are also available to
+/// callers, e.g. to find out which part of a matching path each wildcard matched.
+class Pattern {
+public:
+  struct Component {
+    std::wstring text;
+    /// True if `text` contains wildcards.
+    bool magic = false;
+    /// True if `text` is "**" and the pattern is recursive.
+    bool recursive = false;
+    /// Compiled `text`; used only if `magic` is true and `recursive` is false.
+    Matcher matcher;
+  };
+
+  /// \param pathname string containing a path specification
+  /// \param recursive whether "**" components should match zero or more directories
+  Pattern(const std::wstring &pathname, bool recursive);
+
+  /// Returns the path specification, with any leading `~` expanded.
+  const fs::path &path() const { return path_; }
+
+  /// Returns the components of `path()`. Empty components produced by redundant separators
+  /// are dropped except before the first component containing wildcards.
+  const std::vector<Component> &components() const { return components_; }
+
+  /// Returns the index of the first component containing wildcards, or the number of
+  /// components if there is none.
+  std::size_t first_magic_component() const { return first_magic_component_; }
+
+  /// Returns the directory containing the first component containing wildcards.
+  const fs::path &base() const { return base_; }
+
+private:
+  fs::path path_;
+  std::vector<Component> components_;
+  std::size_t first_magic_component_ = 0;
+  fs::path base_;
+};
+
+/// Options controlling the traversal of the directory trees matched by "**" and the
+/// existence checks of literal paths.
+struct TraversalOptions {
+  /// Maximum number of directories listed, or paths checked, concurrently; 0 means a
+  /// default depending on the hardware. A low limit avoids flooding network filesystems
+  /// with requests.
+  unsigned max_concurrency = 0;
+  /// Whether existence checks may be submitted to the kernel through io_uring where it is
+  /// available (on Linux) instead of being run on a pool of threads.
+  bool use_io_uring = true;
+  /// Patterns matched against the names of the entries of the directories listed to match
+  /// wildcards. Entries matching any of them are skipped, and excluded directories are never
+  /// opened. Components without wildcards are not affected.
+  std::vector<Matcher> exclude;
+  /// Maximum number of directories a "**" component may match; entries deeper below the
+  /// directory it starts from are not listed.
+  std::optional<unsigned> max_recursive_depth;
+  /// If not null, incremented each time a "**" component reaches a directory it has already
+  /// listed, e.g. through a symbolic link to one of its parents or a second link to it, and
+  /// skips it instead of listing it again (or recursing forever). Being updated as the tree is
+  /// walked, it can be read by the progress callback.
+  std::atomic<std::size_t> *num_skipped_cycles = nullptr;
+  /// If not null, checked before each directory is listed and each batch of paths is checked;
+  /// once it is set, globbing stops and returns the (incomplete) results found so far. This
+  /// lets another thread cancel globbing without waiting for the next progress callback.
+  const std::atomic<bool> *cancelled = nullptr;
+  /// If not null, directories whose listing is stored in this cache and have not changed since
+  /// are not read again, and the listings of the others are stored in it once read.
+  ListingCache *listing_cache = nullptr;
+  /// If set, called with each directory searched for entries matching a pattern component:
+  /// listed, or checked for an entry with a literal name. A directory to be searched that does
+  /// not exist, such as the missing base of a pattern, is reported as its nearest ancestor that
+  /// does. A path matching one of the patterns can only appear or disappear through a change to
+  /// one of these directories. It is called before the entries of the directory are read,
+  /// possibly concurrently from several threads and more than once for the same directory.
+  std::function<void(const fs::path &dirname)> on_directory_searched;
+  /// If set, only the directories for which it returns true are searched; the others are
+  /// treated as if they were empty. It may be called concurrently from several threads.
+  std::function<bool(const fs::path &dirname)> should_search;
+};
+
+/// Returns the stamp of each of `dirnames`, as a ListingCache would record it, or nothing for
+/// those that are not accessible directories or have changed so recently that their stamp
+/// might not move on a further change. The directories are queried concurrently, on up to
+/// `options.max_concurrency` threads (0 means one per hardware thread).
+std::vector<std::optional<DirectoryStamp>> directory_stamps(const std::vector<fs::path> &dirnames,
+                                                           const TraversalOptions &options = {});
+
+/// \return vector of paths that match the pattern
+std::vector<PathInfo> glob(const Pattern &pattern,
+                           const std::function<void()> &onFilesystemTraversalProgress = [](){},
+                           const TraversalOptions &options = {});
+
+/// Globs each of `patterns`, listing every directory at most once even if several patterns
+/// traverse it, e.g. `run/*/input.png` and `run/*/output.png`.
+///
+/// \return for each pattern, the vector of paths that `glob` would return for it
+std::vector<std::vector<PathInfo>>
+glob_each(const std::vector<const Pattern *> &patterns,
+          const std::function<void()> &onFilesystemTraversalProgress = [](){},
+          const TraversalOptions &options = {});
+
+/// Receives a path found by globbing, with the index of the pattern it matches.
+using PathSink = std::function<void(std::size_t pattern_index, PathInfo &&info)>;
+
+/// Globs each of `patterns` like `glob_each`, but passes each path to `sink` as soon as it is
+/// found instead of collecting them. The paths matching each pattern arrive in the order in
+/// which `glob_each` would return them; those matching different patterns may be interleaved.
+///
+/// Only the directories still to be globbed are kept in memory, so memory use is governed by
+/// what the sink keeps. `sink` is called on the calling thread and may throw to stop globbing.
+void glob_each_streamed(const std::vector<const Pattern *> &patterns, const PathSink &sink,
+                        const std::function<void()> &onFilesystemTraversalProgress = [](){},
+                        const TraversalOptions &options = {});
+
+/// Streaming counterpart of `glob(const Pattern &, ...)`: passes each path matching `pattern`
+/// to `sink` as soon as it is found.
+void glob_streamed(const Pattern &pattern, const std::function<void(PathInfo &&)> &sink,
+                   const std::function<void()> &onFilesystemTraversalProgress = [](){},
+                   const TraversalOptions &options = {});
+
 /// \param pathname string containing a path specification
 /// \return vector of paths that match the pathname
 ///
@@ -35,6 +165,11 @@ std::vector<PathInfo> glob(const std::wstring &pathname,
 std::vector<PathInfo> rglob(const std::wstring &pathname, 
                             const std::function<void()> &onFilesystemTraversalProgress = [](){});
 
+/// Streaming counterpart of `rglob`: passes each path matching `pathname` to `sink` as soon
+/// as it is found.
+void rglob(const std::wstring &pathname, const std::function<void(PathInfo &&)> &sink,
+           const std::function<void()> &onFilesystemTraversalProgress = [](){});
+
 /// Runs `glob` against each pathname in `pathnames` and accumulates the results
 std::vector<PathInfo> glob(const std::vector<std::wstring> &pathnames, 
                            const std::function<void()> &onFilesystemTraversalProgress = [](){});
@@ -0,0 +1,53 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "ghc/fs_std_fwd.hpp"
+
+namespace glob {
+
+/// The state of a directory a listing was taken in. The entries of a directory cannot have
+/// changed unless its stamp has.
+struct DirectoryStamp {
+  std::uint64_t device = 0;
+  std::uint64_t inode = 0;
+  /// Nanoseconds since the epoch.
+  std::int64_t modification_time = 0;
+  /// Nanoseconds since the epoch; 0 where unavailable.
+  std::int64_t change_time = 0;
+
+  bool operator==(const DirectoryStamp &other) const {
+    return device == other.device && inode == other.inode &&
+           modification_time == other.modification_time && change_time == other.change_time;
+  }
+  bool operator!=(const DirectoryStamp &other) const { return !(*this == other); }
+};
+
+struct CachedEntry {
+  fs::path::string_type name;
+  /// Type of the entry, or `none` for symbolic links and entries whose type is unknown; the
+  /// status of these is queried again whenever the listing is used, since their targets can
+  /// change without the directory's stamp changing.
+  fs::file_type type = fs::file_type::none;
+};
+
+/// Keeps the listings of directories between traversals, so that directories whose stamp has
+/// not changed need not be read again. Used concurrently by the threads walking the directory
+/// tree, so implementations must be thread-safe.
+class ListingCache {
+public:
+  virtual ~ListingCache() = default;
+
+  /// Returns the entries of the directory `directory` (an absolute path) if they were stored
+  /// with the stamp `stamp`, or null otherwise.
+  virtual std::shared_ptr<const std::vector<CachedEntry>> find(const fs::path &directory,
+                                                               const DirectoryStamp &stamp) = 0;
+
+  /// Stores the entries of the directory `directory` (an absolute path), read when its stamp
+  /// was `stamp`.
+  virtual void store(const fs::path &directory, const DirectoryStamp &stamp,
+                     std::vector<CachedEntry> entries) = 0;
+};
+
+} // namespace glob
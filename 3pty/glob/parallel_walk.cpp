@@ -0,0 +1,249 @@
+#include <glob/parallel_walk.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <thread>
+
+namespace glob {
+
+namespace {
+
+// A directory of the tree being walked.
+struct Node {
+  Node(fs::path dirname, unsigned depth) : dirname(std::move(dirname)), depth(depth) {}
+
+  fs::path dirname;
+  // Number of levels below the root.
+  unsigned depth;
+  std::vector<PathInfo> entries;
+  // children[i] is the node of entries[i], or null if the walk does not descend into it.
+  std::vector<std::unique_ptr<Node>> children;
+};
+
+void flatten(Node &node, std::vector<PathInfo> &result) {
+  for (std::size_t i = 0; i < node.entries.size(); ++i) {
+    result.push_back(std::move(node.entries[i]));
+    if (node.children[i]) {
+      flatten(*node.children[i], result);
+    }
+  }
+}
+
+void walk_sequentially(const fs::path &dirname, unsigned depth,
+                       const ListDirectory &list_directory, const ShouldDescend &should_descend,
+                       const std::function<void()> &on_progress, std::vector<PathInfo> &result) {
+  for (auto &info : list_directory(dirname, depth, on_progress)) {
+    if (should_descend(info, depth + 1)) {
+      const fs::path subdirname = info.path;
+      result.push_back(std::move(info));
+      walk_sequentially(subdirname, depth + 1, list_directory, should_descend, on_progress,
+                        result);
+    } else {
+      result.push_back(std::move(info));
+    }
+  }
+}
+
+// Lists the nodes of a tree on a pool of threads. Each worker pushes the subdirectories it
+// finds onto the back of its own queue and pops from the back too, so it tends to stay
+// within one subtree; idle workers steal from the front of the other queues, where the
+// directories closest to the root (and so probably the largest subtrees) are.
+class ParallelWalker {
+public:
+  ParallelWalker(const ListDirectory &list_directory, const ShouldDescend &should_descend,
+                 unsigned num_workers)
+      : list_directory_(list_directory), should_descend_(should_descend), queues_(num_workers) {}
+
+  void run(Node &root, const std::function<void()> &on_progress);
+
+private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Node *> nodes;
+  };
+
+  void work(std::size_t worker);
+  void process(Node &node, std::size_t worker);
+  Node *pop(std::size_t worker);
+  void push(std::size_t worker, Node *node);
+  void stop(std::exception_ptr error);
+
+  const ListDirectory &list_directory_;
+  const ShouldDescend &should_descend_;
+  std::vector<Queue> queues_;
+
+  // Number of nodes queued or being processed.
+  std::atomic<std::size_t> num_pending_{0};
+  // Number of nodes queued.
+  std::atomic<std::size_t> num_queued_{0};
+  std::atomic<std::size_t> num_visited_entries_{0};
+  std::atomic<bool> stopped_{false};
+
+  std::mutex mutex_;
+  std::condition_variable work_available_;
+  std::condition_variable finished_;
+  // First exception thrown by a worker; guarded by mutex_.
+  std::exception_ptr error_;
+};
+
+void ParallelWalker::run(Node &root, const std::function<void()> &on_progress) {
+  push(0, &root);
+
+  std::vector<std::thread> threads;
+  try {
+    for (std::size_t worker = 0; worker < queues_.size(); ++worker) {
+      threads.emplace_back(&ParallelWalker::work, this, worker);
+    }
+  } catch (const std::system_error &) {
+    // Make do with the threads started so far, if any.
+    if (threads.empty()) {
+      throw;
+    }
+  }
+
+  // Report progress until all workers have run out of work. This is the only place where
+  // the walk can be cancelled.
+  std::exception_ptr cancellation;
+  std::size_t num_reported_entries = 0;
+  bool finished = false;
+  while (!finished) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      finished = finished_.wait_for(lock, std::chrono::milliseconds(10),
+                                    [this] { return num_pending_ == 0; });
+    }
+    if (!cancellation) {
+      try {
+        const std::size_t num_visited_entries = num_visited_entries_;
+        for (; num_reported_entries < num_visited_entries; ++num_reported_entries) {
+          on_progress();
+        }
+      } catch (...) {
+        cancellation = std::current_exception();
+        stopped_ = true;
+      }
+    }
+  }
+
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  if (cancellation) {
+    std::rethrow_exception(cancellation);
+  }
+  if (error_) {
+    std::rethrow_exception(error_);
+  }
+}
+
+void ParallelWalker::work(std::size_t worker) {
+  while (true) {
+    if (Node *node = pop(worker)) {
+      process(*node, worker);
+      if (--num_pending_ == 0) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        finished_.notify_all();
+        work_available_.notify_all();
+      }
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    work_available_.wait(lock, [this] { return num_queued_ > 0 || num_pending_ == 0; });
+    if (num_pending_ == 0) {
+      return;
+    }
+  }
+}
+
+void ParallelWalker::process(Node &node, std::size_t worker) {
+  if (stopped_) {
+    return;
+  }
+  try {
+    node.entries =
+        list_directory_(node.dirname, node.depth, [this] { ++num_visited_entries_; });
+    node.children.resize(node.entries.size());
+    for (std::size_t i = 0; i < node.entries.size(); ++i) {
+      if (should_descend_(node.entries[i], node.depth + 1)) {
+        node.children[i] = std::make_unique<Node>(node.entries[i].path, node.depth + 1);
+        push(worker, node.children[i].get());
+      }
+    }
+  } catch (...) {
+    stop(std::current_exception());
+  }
+}
+
+Node *ParallelWalker::pop(std::size_t worker) {
+  Node *node = nullptr;
+  {
+    Queue &queue = queues_[worker];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (!queue.nodes.empty()) {
+      node = queue.nodes.back();
+      queue.nodes.pop_back();
+    }
+  }
+  for (std::size_t i = 1; node == nullptr && i < queues_.size(); ++i) {
+    Queue &queue = queues_[(worker + i) % queues_.size()];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (!queue.nodes.empty()) {
+      node = queue.nodes.front();
+      queue.nodes.pop_front();
+    }
+  }
+  if (node != nullptr) {
+    --num_queued_;
+  }
+  return node;
+}
+
+void ParallelWalker::push(std::size_t worker, Node *node) {
+  ++num_pending_;
+  {
+    Queue &queue = queues_[worker];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.nodes.push_back(node);
+  }
+  ++num_queued_;
+  std::lock_guard<std::mutex> lock(mutex_);
+  work_available_.notify_one();
+}
+
+void ParallelWalker::stop(std::exception_ptr error) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!error_) {
+    error_ = error;
+  }
+  stopped_ = true;
+}
+
+} // namespace
+
+std::vector<PathInfo> walk(const fs::path &root, const ListDirectory &list_directory,
+                           const ShouldDescend &should_descend,
+                           const std::function<void()> &on_progress, unsigned max_concurrency) {
+  std::vector<PathInfo> result;
+
+  const unsigned num_workers =
+      max_concurrency > 0 ? max_concurrency : std::thread::hardware_concurrency();
+  if (num_workers <= 1) {
+    walk_sequentially(root, 0, list_directory, should_descend, on_progress, result);
+    return result;
+  }
+
+  Node root_node(root, 0);
+  ParallelWalker(list_directory, should_descend, num_workers).run(root_node, on_progress);
+  flatten(root_node, result);
+  return result;
+}
+
+} // namespace glob
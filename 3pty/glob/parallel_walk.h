@@ -0,0 +1,37 @@
+#pragma once
+#include <functional>
+#include <vector>
+
+#include "ghc/fs_std_fwd.hpp"
+#include "glob/glob.h"
+
+namespace glob {
+
+/// Lists the entries of a directory `depth` levels below the root of the walk (0 for the root
+/// itself), calling `on_entry_visited` once for each entry read (including those left out of
+/// the returned vector).
+using ListDirectory = std::function<std::vector<PathInfo>(
+    const fs::path &dirname, unsigned depth, const std::function<void()> &on_entry_visited)>;
+
+/// Returns true if the walk should descend into the given entry, found `depth` levels below the
+/// root of the walk (1 for the entries of the root).
+using ShouldDescend = std::function<bool(const PathInfo &info, unsigned depth)>;
+
+/// Lists `root` and, recursively, every entry of a listed directory for which `should_descend`
+/// returns true, and returns all the listed entries (excluding `root`) in depth-first
+/// preorder -- the order in which a sequential recursive walk would produce them.
+///
+/// Directories are listed concurrently by up to `max_concurrency` worker threads (0 means
+/// one per hardware thread), each taking work from its own queue and stealing from the
+/// others when it runs out. `list_directory` and `should_descend` must therefore be
+/// thread-safe.
+///
+/// `on_progress` is called on the calling thread, once per visited entry, and is the
+/// only place where the walk may be cancelled: if it throws, the workers stop picking up
+/// new directories and the exception is rethrown once they have all finished. Exceptions
+/// thrown by `list_directory` or `should_descend` are rethrown in the same way.
+std::vector<PathInfo> walk(const fs::path &root, const ListDirectory &list_directory,
+                           const ShouldDescend &should_descend,
+                           const std::function<void()> &on_progress, unsigned max_concurrency);
+
+} // namespace glob
@@ -0,0 +1,152 @@
+// This file is part of Caméléon.
+//
+// Copyright (C) 2024 Wojciech Śmigaj
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "BookmarkSet.h"
+
+#include <QtAlgorithms>
+
+#include <algorithm>
+
+namespace
+{
+uint64_t bit(size_t index)
+{
+  return uint64_t(1) << (index % 64);
+}
+} // namespace
+
+BookmarkSet::BookmarkSet(std::initializer_list<size_t> indices)
+{
+  for (size_t index : indices)
+    insert(index);
+}
+
+bool BookmarkSet::contains(size_t index) const
+{
+  const size_t wordIndex = index / BITS_PER_WORD;
+  return wordIndex < words_.size() && (words_[wordIndex] & bit(index)) != 0;
+}
+
+void BookmarkSet::insert(size_t index)
+{
+  const size_t wordIndex = index / BITS_PER_WORD;
+  if (wordIndex >= words_.size())
+    words_.resize(wordIndex + 1);
+  if ((words_[wordIndex] & bit(index)) == 0)
+  {
+    words_[wordIndex] |= bit(index);
+    ++size_;
+  }
+}
+
+void BookmarkSet::erase(size_t index)
+{
+  if (contains(index))
+  {
+    words_[index / BITS_PER_WORD] &= ~bit(index);
+    --size_;
+  }
+}
+
+void BookmarkSet::toggle(size_t index)
+{
+  if (contains(index))
+    erase(index);
+  else
+    insert(index);
+}
+
+void BookmarkSet::clear()
+{
+  words_.clear();
+  size_ = 0;
+}
+
+void BookmarkSet::insert(const BookmarkSet& other)
+{
+  if (other.words_.size() > words_.size())
+    words_.resize(other.words_.size());
+  size_ = 0;
+  for (size_t i = 0; i < words_.size(); ++i)
+  {
+    if (i < other.words_.size())
+      words_[i] |= other.words_[i];
+    size_ += qPopulationCount(words_[i]);
+  }
+}
+
+void BookmarkSet::erase(const BookmarkSet& other)
+{
+  size_ = 0;
+  for (size_t i = 0; i < words_.size(); ++i)
+  {
+    if (i < other.words_.size())
+      words_[i] &= ~other.words_[i];
+    size_ += qPopulationCount(words_[i]);
+  }
+}
+
+std::optional<size_t> BookmarkSet::findFrom(size_t index) const
+{
+  size_t wordIndex = index / BITS_PER_WORD;
+  if (wordIndex >= words_.size())
+    return std::nullopt;
+
+  // Ignore the bits of the first word preceding `index`.
+  uint64_t word = words_[wordIndex] & (~uint64_t(0) << (index % BITS_PER_WORD));
+  while (word == 0)
+  {
+    if (++wordIndex == words_.size())
+      return std::nullopt;
+    word = words_[wordIndex];
+  }
+  return wordIndex * BITS_PER_WORD + qCountTrailingZeroBits(word);
+}
+
+std::optional<size_t> BookmarkSet::previous(size_t index) const
+{
+  index = std::min(index, words_.size() * BITS_PER_WORD);
+  if (index == 0)
+    return std::nullopt;
+
+  // Look for the last bit set at or before `index - 1`, ignoring the bits of its word following it.
+  const size_t lastIndex = index - 1;
+  size_t wordIndex = lastIndex / BITS_PER_WORD;
+  uint64_t word =
+    words_[wordIndex] & (~uint64_t(0) >> (BITS_PER_WORD - 1 - lastIndex % BITS_PER_WORD));
+  while (word == 0)
+  {
+    if (wordIndex == 0)
+      return std::nullopt;
+    word = words_[--wordIndex];
+  }
+  return wordIndex * BITS_PER_WORD + BITS_PER_WORD - 1 - qCountLeadingZeroBits(word);
+}
+
+bool operator==(const BookmarkSet& a, const BookmarkSet& b)
+{
+  if (a.size_ != b.size_)
+    return false;
+  // The bitmaps may differ in length if indices were erased from one of them.
+  const size_t numCommonWords = std::min(a.words_.size(), b.words_.size());
+  return std::equal(a.words_.begin(), a.words_.begin() + numCommonWords, b.words_.begin());
+}
+
+bool operator!=(const BookmarkSet& a, const BookmarkSet& b)
+{
+  return !(a == b);
+}
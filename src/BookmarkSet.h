@@ -0,0 +1,114 @@
+// This file is part of Caméléon.
+//
+// Copyright (C) 2024 Wojciech Śmigaj
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstdint>
+#include <initializer_list>
+#include <iterator>
+#include <optional>
+#include <vector>
+
+/// A set of instance indices, such as the bookmarked pages of an album, stored as a bitmap with
+/// one bit per instance.
+///
+/// Adding and removing indices and counting them take constant time; finding the index following
+/// or preceding a given one scans the bitmap a 64-bit word at a time.
+class BookmarkSet
+{
+public:
+  /// Iterates over the indices in the set in increasing order.
+  class const_iterator
+  {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = size_t;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const size_t*;
+    using reference = size_t;
+
+    const_iterator() = default;
+
+    size_t operator*() const { return *index_; }
+    const_iterator& operator++()
+    {
+      index_ = set_->next(*index_);
+      return *this;
+    }
+    const_iterator operator++(int)
+    {
+      const_iterator result = *this;
+      ++*this;
+      return result;
+    }
+    bool operator==(const const_iterator& other) const { return index_ == other.index_; }
+    bool operator!=(const const_iterator& other) const { return index_ != other.index_; }
+
+  private:
+    friend class BookmarkSet;
+    const_iterator(const BookmarkSet* set, std::optional<size_t> index) : set_(set), index_(index)
+    {
+    }
+
+    const BookmarkSet* set_ = nullptr;
+    std::optional<size_t> index_;
+  };
+
+  BookmarkSet() = default;
+  BookmarkSet(std::initializer_list<size_t> indices);
+
+  bool empty() const { return size_ == 0; }
+  /// Returns the number of indices in the set.
+  size_t size() const { return size_; }
+
+  bool contains(size_t index) const;
+  void insert(size_t index);
+  void erase(size_t index);
+  /// Inserts `index` if it is not in the set and erases it otherwise.
+  void toggle(size_t index);
+  void clear();
+
+  /// Inserts all indices of `other`.
+  void insert(const BookmarkSet& other);
+  /// Erases all indices of `other`.
+  void erase(const BookmarkSet& other);
+
+  /// Returns the smallest index in the set, if any.
+  std::optional<size_t> first() const { return findFrom(0); }
+  /// Returns the largest index in the set, if any.
+  std::optional<size_t> last() const { return previous(words_.size() * BITS_PER_WORD); }
+  /// Returns the smallest index in the set greater than `index`, if any.
+  std::optional<size_t> next(size_t index) const { return findFrom(index + 1); }
+  /// Returns the largest index in the set less than `index`, if any.
+  std::optional<size_t> previous(size_t index) const;
+
+  const_iterator begin() const { return const_iterator(this, first()); }
+  const_iterator end() const { return const_iterator(this, std::nullopt); }
+
+  friend bool operator==(const BookmarkSet& a, const BookmarkSet& b);
+
+private:
+  static constexpr size_t BITS_PER_WORD = 64;
+
+  /// Returns the smallest index in the set greater than or equal to `index`, if any.
+  std::optional<size_t> findFrom(size_t index) const;
+
+  std::vector<uint64_t> words_;
+  size_t size_ = 0;
+};
+
+bool operator!=(const BookmarkSet& a, const BookmarkSet& b);
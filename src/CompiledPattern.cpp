@@ -0,0 +1,165 @@
+// This file is part of Caméléon.
+//
+// Copyright (C) 2024 Wojciech Śmigaj
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "CompiledPattern.h"
+
+#include <algorithm>
+
+namespace
+{
+bool isSeparator(wchar_t c)
+{
+  return c == '/' || c == static_cast<wchar_t>(fs::path::preferred_separator);
+}
+
+size_t componentEnd(std::wstring_view path, size_t pos)
+{
+  while (pos < path.size() && !isSeparator(path[pos]))
+    ++pos;
+  return pos;
+}
+
+size_t numComponents(std::wstring_view path, size_t pos)
+{
+  if (pos > path.size())
+    return 0;
+  return 1 + std::count_if(path.begin() + pos, path.end(), isSeparator);
+}
+} // namespace
+
+CompiledPattern::CompiledPattern(const QString& pattern)
+  : globPattern_(QDir::toNativeSeparators(pattern).toStdWString(), true /*recursive*/)
+{
+  const std::vector<glob::Pattern::Component>& components = globPattern_.components();
+
+  for (const glob::Pattern::Component& component : components)
+  {
+    firstMagicExpressions_.push_back(numMagicExpressions_);
+    if (component.recursive)
+      numMagicExpressions_ += 1;
+    else if (component.magic)
+      numMagicExpressions_ += component.matcher.num_wildcards();
+  }
+
+  numFixedComponentsAfter_.resize(components.size());
+  size_t numFixedComponents = 0;
+  for (size_t i = components.size(); i-- > 0;)
+  {
+    numFixedComponentsAfter_[i] = numFixedComponents;
+    if (!components[i].recursive)
+      ++numFixedComponents;
+  }
+}
+
+bool CompiledPattern::match(std::wstring_view path,
+                            std::vector<glob::Capture>& magicExpressionMatches) const
+{
+  magicExpressionMatches.resize(numMagicExpressions_);
+  return matchComponents(0, path, 0, magicExpressionMatches.data());
+}
+
+bool CompiledPattern::matchComponents(size_t componentIndex, std::wstring_view path, size_t pos,
+                                      glob::Capture* magicExpressionMatches) const
+{
+  // `pos` is the start of the next unmatched path component, or path.size() + 1 if there is none.
+  const std::vector<glob::Pattern::Component>& components = globPattern_.components();
+  if (componentIndex == components.size())
+    return pos == path.size() + 1;
+
+  const glob::Pattern::Component& component = components[componentIndex];
+  glob::Capture* componentMatches = magicExpressionMatches + firstMagicExpressions_[componentIndex];
+
+  if (component.recursive)
+  {
+    // Try the longest run of path components first; the components after `**` that aren't
+    // `**` themselves need at least one path component each.
+    const size_t numAvailableComponents = numComponents(path, pos);
+    const size_t numFixedComponents = numFixedComponentsAfter_[componentIndex];
+    if (numAvailableComponents < numFixedComponents)
+      return false;
+    for (size_t n = numAvailableComponents - numFixedComponents; n > 0; --n)
+    {
+      size_t end = componentEnd(path, pos);
+      for (size_t i = 1; i < n; ++i)
+        end = componentEnd(path, end + 1);
+      *componentMatches = glob::Capture{pos, end - pos};
+      if (matchComponents(componentIndex + 1, path, end + 1, magicExpressionMatches))
+        return true;
+    }
+    *componentMatches = glob::Capture{std::min(pos, path.size()), 0};
+    return matchComponents(componentIndex + 1, path, pos, magicExpressionMatches);
+  }
+
+  if (pos > path.size())
+    return false;
+  const size_t end = componentEnd(path, pos);
+  const std::wstring_view name = path.substr(pos, end - pos);
+  if (!component.magic)
+  {
+    if (name != component.text)
+      return false;
+  }
+  else
+  {
+    if (!component.matcher.match(name, componentMatches))
+      return false;
+    for (size_t i = 0; i < component.matcher.num_wildcards(); ++i)
+      componentMatches[i].offset += pos;
+  }
+  return matchComponents(componentIndex + 1, path, end + 1, magicExpressionMatches);
+}
+
+std::optional<std::wstring>
+CompiledPattern::substitute(const std::vector<std::wstring>& magicExpressionMatches) const
+{
+  if (magicExpressionMatches.size() != numMagicExpressions_)
+    return std::nullopt;
+
+  const std::vector<std::wstring_view> values(magicExpressionMatches.begin(),
+                                              magicExpressionMatches.end());
+  const std::vector<glob::Pattern::Component>& components = globPattern_.components();
+  std::wstring path;
+  bool first = true;
+  for (size_t i = 0; i < components.size(); ++i)
+  {
+    const glob::Pattern::Component& component = components[i];
+    const std::wstring_view* componentValues = values.data() + firstMagicExpressions_[i];
+    // A `**` matching zero directories contributes no component.
+    if (component.recursive && componentValues->empty())
+      continue;
+
+    if (!first)
+      path += static_cast<wchar_t>(fs::path::preferred_separator);
+    first = false;
+
+    if (!component.magic)
+      path += component.text;
+    else if (component.recursive)
+      path += *componentValues;
+    else
+      component.matcher.substitute(componentValues, path);
+  }
+  path = fs::path(path).lexically_normal().wstring();
+
+  std::vector<glob::Capture> captures;
+  if (!match(path, captures))
+    return std::nullopt;
+  for (size_t i = 0; i < captures.size(); ++i)
+    if (path.compare(captures[i].offset, captures[i].length, magicExpressionMatches[i]) != 0)
+      return std::nullopt;
+  return path;
+}
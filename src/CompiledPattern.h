@@ -0,0 +1,64 @@
+// This file is part of Caméléon.
+//
+// Copyright (C) 2024 Wojciech Śmigaj
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <glob/glob.h>
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class QString;
+
+/// A wildcard pattern parsed once and then used to count its magic expressions, to glob the
+/// filesystem and to extract the magic expression matches from each globbed path.
+class CompiledPattern
+{
+public:
+  explicit CompiledPattern(const QString& pattern);
+
+  const glob::Pattern& globPattern() const { return globPattern_; }
+
+  size_t numMagicExpressions() const { return numMagicExpressions_; }
+
+  /// Matches `path` against the pattern. If it matches, returns true and stores the position
+  /// of the text matched by each magic expression in `magicExpressionMatches`, which is resized
+  /// to numMagicExpressions().
+  ///
+  /// A `**` component matches zero or more complete path components. Each `*` and `**` matches
+  /// as much text as it can, earlier wildcards taking precedence over later ones.
+  bool match(std::wstring_view path, std::vector<glob::Capture>& magicExpressionMatches) const;
+
+  /// Returns the path obtained by replacing each magic expression with the corresponding element
+  /// of `magicExpressionMatches`, normalised like the paths found by globbing. Returns nothing if
+  /// matching that path against the pattern would yield different magic expression matches.
+  std::optional<std::wstring>
+  substitute(const std::vector<std::wstring>& magicExpressionMatches) const;
+
+private:
+  bool matchComponents(size_t componentIndex, std::wstring_view path, size_t pos,
+                       glob::Capture* magicExpressionMatches) const;
+
+  glob::Pattern globPattern_;
+  size_t numMagicExpressions_ = 0;
+  /// Index of the first magic expression of each component.
+  std::vector<size_t> firstMagicExpressions_;
+  /// Number of components other than `**` following each component.
+  std::vector<size_t> numFixedComponentsAfter_;
+};
@@ -0,0 +1,222 @@
+// This file is part of Caméléon.
+//
+// Copyright (C) 2024 Wojciech Śmigaj
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "DirectoryListingCache.h"
+
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QSettings>
+#include <QStandardPaths>
+
+#include <algorithm>
+
+namespace
+{
+const quint32 FILE_MAGIC = 0x434d4c43; // "CMLC"
+const quint32 FILE_VERSION = 1;
+
+const size_t DEFAULT_MAX_NUM_ENTRIES = 2000000;
+// Once the cap is exceeded, listings are evicted until the cache holds at most this fraction of
+// the maximum number of entries, so that the (sorting) eviction runs only once in a while.
+const double EVICTION_TARGET = 0.9;
+
+QByteArray toBytes(const fs::path::string_type& string)
+{
+  return QByteArray(reinterpret_cast<const char*>(string.data()),
+                    static_cast<qsizetype>(string.size() * sizeof(fs::path::value_type)));
+}
+
+fs::path::string_type fromBytes(const QByteArray& bytes)
+{
+  return fs::path::string_type(reinterpret_cast<const fs::path::value_type*>(bytes.constData()),
+                               bytes.size() / sizeof(fs::path::value_type));
+}
+} // namespace
+
+DirectoryListingCache::DirectoryListingCache(QString path, size_t maxNumEntries)
+  : path_(std::move(path)), maxNumEntries_(maxNumEntries)
+{
+}
+
+DirectoryListingCache& DirectoryListingCache::instance()
+{
+  static DirectoryListingCache cache(
+    QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/directory-listings.bin",
+    QSettings()
+      .value("maxDirectoryListingCacheEntries", qulonglong(DEFAULT_MAX_NUM_ENTRIES))
+      .toULongLong());
+  return cache;
+}
+
+std::shared_ptr<const std::vector<glob::CachedEntry>>
+DirectoryListingCache::find(const fs::path& directory, const glob::DirectoryStamp& stamp)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  loadIfNeeded();
+  auto it = listings_.find(directory.native());
+  if (it == listings_.end() || it->second.stamp != stamp)
+    return nullptr;
+  it->second.lastUse = ++useCounter_;
+  return it->second.entries;
+}
+
+void DirectoryListingCache::store(const fs::path& directory, const glob::DirectoryStamp& stamp,
+                                  std::vector<glob::CachedEntry> entries)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  loadIfNeeded();
+  Listing& listing = listings_[directory.native()];
+  if (listing.entries)
+    numEntries_ -= listing.entries->size();
+  numEntries_ += entries.size();
+  listing.stamp = stamp;
+  listing.entries = std::make_shared<const std::vector<glob::CachedEntry>>(std::move(entries));
+  listing.lastUse = ++useCounter_;
+  ++generation_;
+  if (numEntries_ > maxNumEntries_)
+    evictLeastRecentlyUsed();
+}
+
+void DirectoryListingCache::save()
+{
+  std::lock_guard<std::mutex> fileLock(fileMutex_);
+  std::vector<std::pair<fs::path::string_type, Listing>> snapshot;
+  uint64_t generation;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (generation_ == savedGeneration_)
+      return;
+    generation = generation_;
+    snapshot.assign(listings_.begin(), listings_.end());
+  }
+
+  QDir().mkpath(QFileInfo(path_).absolutePath());
+  QSaveFile file(path_);
+  if (!file.open(QIODevice::WriteOnly))
+    return;
+  QDataStream stream(&file);
+  stream.setVersion(QDataStream::Qt_6_0);
+  stream << FILE_MAGIC << FILE_VERSION << quint64(snapshot.size());
+  for (const auto& [directory, listing] : snapshot)
+  {
+    stream << toBytes(directory) << quint64(listing.stamp.device) << quint64(listing.stamp.inode)
+           << qint64(listing.stamp.modification_time) << qint64(listing.stamp.change_time)
+           << quint64(listing.lastUse) << quint64(listing.entries->size());
+    for (const glob::CachedEntry& entry : *listing.entries)
+      stream << toBytes(entry.name) << qint8(entry.type);
+  }
+  if (stream.status() == QDataStream::Ok && file.commit())
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    savedGeneration_ = std::max(savedGeneration_, generation);
+  }
+}
+
+void DirectoryListingCache::clear()
+{
+  std::lock_guard<std::mutex> fileLock(fileMutex_);
+  std::lock_guard<std::mutex> lock(mutex_);
+  listings_.clear();
+  numEntries_ = 0;
+  loaded_ = true;
+  savedGeneration_ = generation_;
+  QFile::remove(path_);
+}
+
+size_t DirectoryListingCache::numListings() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return listings_.size();
+}
+
+void DirectoryListingCache::loadIfNeeded()
+{
+  if (loaded_)
+    return;
+  loaded_ = true;
+
+  QFile file(path_);
+  if (!file.open(QIODevice::ReadOnly))
+    return;
+  QDataStream stream(&file);
+  stream.setVersion(QDataStream::Qt_6_0);
+  quint32 magic = 0, version = 0;
+  quint64 numListings = 0;
+  stream >> magic >> version >> numListings;
+  if (magic != FILE_MAGIC || version != FILE_VERSION)
+    return;
+
+  for (quint64 i = 0; i < numListings && stream.status() == QDataStream::Ok; ++i)
+  {
+    QByteArray directory;
+    quint64 device = 0, inode = 0, lastUse = 0, numEntries = 0;
+    qint64 modificationTime = 0, changeTime = 0;
+    stream >> directory >> device >> inode >> modificationTime >> changeTime >> lastUse >>
+      numEntries;
+
+    std::vector<glob::CachedEntry> entries;
+    for (quint64 j = 0; j < numEntries && stream.status() == QDataStream::Ok; ++j)
+    {
+      QByteArray name;
+      qint8 type = 0;
+      stream >> name >> type;
+      entries.push_back({fromBytes(name), static_cast<fs::file_type>(type)});
+    }
+
+    Listing& listing = listings_[fromBytes(directory)];
+    listing.stamp = glob::DirectoryStamp{device, inode, modificationTime, changeTime};
+    listing.lastUse = lastUse;
+    numEntries_ += entries.size();
+    listing.entries = std::make_shared<const std::vector<glob::CachedEntry>>(std::move(entries));
+    useCounter_ = std::max(useCounter_, uint64_t(lastUse));
+  }
+
+  if (stream.status() != QDataStream::Ok)
+  {
+    // The file is damaged; start afresh.
+    listings_.clear();
+    numEntries_ = 0;
+    useCounter_ = 0;
+  }
+  else if (numEntries_ > maxNumEntries_)
+  {
+    // The cap may have been lowered since the file was written.
+    evictLeastRecentlyUsed();
+  }
+}
+
+void DirectoryListingCache::evictLeastRecentlyUsed()
+{
+  const size_t targetNumEntries = static_cast<size_t>(maxNumEntries_ * EVICTION_TARGET);
+  std::vector<std::pair<uint64_t, fs::path::string_type>> byLastUse;
+  byLastUse.reserve(listings_.size());
+  for (const auto& [directory, listing] : listings_)
+    byLastUse.emplace_back(listing.lastUse, directory);
+  std::sort(byLastUse.begin(), byLastUse.end());
+
+  for (const auto& [lastUse, directory] : byLastUse)
+  {
+    if (numEntries_ <= targetNumEntries)
+      break;
+    auto it = listings_.find(directory);
+    numEntries_ -= it->second.entries->size();
+    listings_.erase(it);
+  }
+}
@@ -0,0 +1,91 @@
+// This file is part of Caméléon.
+//
+// Copyright (C) 2024 Wojciech Śmigaj
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <glob/listing_cache.h>
+
+#include <QString>
+
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+
+/// Directory listings kept between sessions in a file, so that reopening or refreshing an album
+/// reads again only the directories changed since they were last listed.
+///
+/// The listings are loaded from the file on first use and written back by `save()`. Once they
+/// hold more than a given number of entries, the least recently used listings are dropped as
+/// new ones are stored.
+class DirectoryListingCache : public glob::ListingCache
+{
+public:
+  /// \param path path of the file holding the listings
+  /// \param maxNumEntries maximum total number of entries of the listings saved to the file
+  DirectoryListingCache(QString path, size_t maxNumEntries);
+
+  /// Returns the cache shared by all albums, stored in the user's cache directory. Pattern
+  /// matching uses it unless the "useDirectoryListingCache" setting is false; the
+  /// "maxDirectoryListingCacheEntries" setting caps its size.
+  static DirectoryListingCache& instance();
+
+  std::shared_ptr<const std::vector<glob::CachedEntry>>
+  find(const fs::path& directory, const glob::DirectoryStamp& stamp) override;
+
+  void store(const fs::path& directory, const glob::DirectoryStamp& stamp,
+             std::vector<glob::CachedEntry> entries) override;
+
+  /// Writes the listings to the file if any has been stored since they were last saved. Failing
+  /// to write it is not an error: the listings will just be read again next time.
+  ///
+  /// The file is written from a snapshot of the listings, so globbing may look up and store
+  /// listings on other threads meanwhile.
+  void save();
+
+  /// Removes all listings, from memory and from the file.
+  void clear();
+
+  /// Returns the number of listings currently held.
+  size_t numListings() const;
+
+private:
+  struct Listing
+  {
+    glob::DirectoryStamp stamp;
+    std::shared_ptr<const std::vector<glob::CachedEntry>> entries;
+    /// Value of useCounter_ when the listing was last found or stored.
+    uint64_t lastUse = 0;
+  };
+
+  void loadIfNeeded();
+  void evictLeastRecentlyUsed();
+
+  QString path_;
+  size_t maxNumEntries_;
+
+  /// Held while the file is written or removed.
+  std::mutex fileMutex_;
+  mutable std::mutex mutex_;
+  bool loaded_ = false;
+  /// Incremented whenever the listings change, so that `save()` can tell whether they changed
+  /// while it was writing its snapshot.
+  uint64_t generation_ = 0;
+  uint64_t savedGeneration_ = 0;
+  uint64_t useCounter_ = 0;
+  size_t numEntries_ = 0;
+  std::unordered_map<fs::path::string_type, Listing> listings_;
+};
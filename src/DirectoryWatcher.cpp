@@ -0,0 +1,135 @@
+// This file is part of Caméléon.
+//
+// Copyright (C) 2024 Wojciech Śmigaj
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "DirectoryWatcher.h"
+
+#include <QFile>
+
+#include <algorithm>
+#include <iterator>
+
+namespace
+{
+size_t depth(const fs::path& path)
+{
+  return std::distance(path.begin(), path.end());
+}
+} // namespace
+
+DirectoryWatcher::DirectoryWatcher(size_t maxNumDirectories, int notificationDelay,
+                                   QObject* parent)
+  : QObject(parent), maxNumDirectories_(maxNumDirectories)
+{
+  timer_.setSingleShot(true);
+  timer_.setInterval(notificationDelay);
+  connect(&timer_, &QTimer::timeout, this, &DirectoryWatcher::directoriesChanged);
+  connect(&watcher_, &QFileSystemWatcher::directoryChanged, this,
+          &DirectoryWatcher::onDirectoryChanged);
+}
+
+size_t DirectoryWatcher::defaultMaxNumDirectories()
+{
+  size_t maxNumDirectories = 65536;
+#ifdef Q_OS_LINUX
+  // Leave room for the watches of other applications.
+  QFile file("/proc/sys/fs/inotify/max_user_watches");
+  if (file.open(QIODevice::ReadOnly))
+  {
+    bool ok = false;
+    const qulonglong maxUserWatches = file.readAll().trimmed().toULongLong(&ok);
+    if (ok)
+      maxNumDirectories = std::max<size_t>(maxUserWatches / 2, 1);
+  }
+#endif
+  return maxNumDirectories;
+}
+
+size_t DirectoryWatcher::setDirectories(const std::vector<fs::path>& directories)
+{
+  // The deepest directories come first, so that they are the ones kept if there are too many
+  // for this watcher or for the operating system.
+  std::vector<fs::path> selectedDirectories = directories;
+  std::stable_sort(selectedDirectories.begin(), selectedDirectories.end(),
+                   [](const fs::path& a, const fs::path& b) { return depth(a) > depth(b); });
+  if (selectedDirectories.size() > maxNumDirectories_)
+    selectedDirectories.resize(maxNumDirectories_);
+
+  QSet<QString> newDirectories;
+  newDirectories.reserve(selectedDirectories.size());
+  for (const fs::path& directory : selectedDirectories)
+    newDirectories.insert(QString::fromStdWString(directory.wstring()));
+
+  const QStringList oldDirectories = watcher_.directories();
+  QStringList directoriesToRemove;
+  for (const QString& directory : oldDirectories)
+  {
+    if (!newDirectories.remove(directory))
+      directoriesToRemove.push_back(directory);
+  }
+  if (!directoriesToRemove.empty())
+    watcher_.removePaths(directoriesToRemove);
+
+  // What is left in `newDirectories` is not watched yet.
+  QStringList directoriesToAdd;
+  for (const fs::path& directory : selectedDirectories)
+  {
+    const QString path = QString::fromStdWString(directory.wstring());
+    if (newDirectories.contains(path))
+      directoriesToAdd.push_back(path);
+  }
+  size_t numUnwatchedDirectories = directories.size() - selectedDirectories.size();
+  if (!directoriesToAdd.empty())
+    numUnwatchedDirectories += watcher_.addPaths(directoriesToAdd).size();
+  return numUnwatchedDirectories;
+}
+
+void DirectoryWatcher::clear()
+{
+  timer_.stop();
+  changedDirectories_.clear();
+  const QStringList directories = watcher_.directories();
+  if (!directories.empty())
+    watcher_.removePaths(directories);
+}
+
+size_t DirectoryWatcher::numDirectories() const
+{
+  return watcher_.directories().size();
+}
+
+std::vector<fs::path> DirectoryWatcher::takeChangedDirectories()
+{
+  std::vector<fs::path> directories;
+  directories.reserve(changedDirectories_.size());
+  for (const QString& directory : changedDirectories_)
+    directories.push_back(directory.toStdWString());
+  changedDirectories_.clear();
+  std::sort(directories.begin(), directories.end());
+  return directories;
+}
+
+void DirectoryWatcher::postponeNotification()
+{
+  timer_.start();
+}
+
+void DirectoryWatcher::onDirectoryChanged(const QString& directory)
+{
+  changedDirectories_.insert(directory);
+  if (!timer_.isActive())
+    timer_.start();
+}
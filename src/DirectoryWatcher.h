@@ -0,0 +1,81 @@
+// This file is part of Caméléon.
+//
+// Copyright (C) 2024 Wojciech Śmigaj
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "ghc/fs_std_fwd.hpp"
+
+#include <QFileSystemWatcher>
+#include <QObject>
+#include <QSet>
+#include <QTimer>
+
+#include <vector>
+
+/// Watches a set of directories for entries being created, deleted or renamed, and reports such
+/// changes with the `directoriesChanged()` signal. The directories that have changed are
+/// collected until they are taken with `takeChangedDirectories()`.
+///
+/// Changes are reported at most once per notification delay: the signal is emitted that long
+/// after the first change, however many follow it in the meantime, so that a burst of writes
+/// causes a single update.
+class DirectoryWatcher : public QObject
+{
+  Q_OBJECT
+
+public:
+  /// \param maxNumDirectories maximum number of directories watched at once; each takes up an
+  ///   operating system resource (an inotify watch on Linux) of which there are only so many
+  /// \param notificationDelay delay in milliseconds between the first change and the signal
+  DirectoryWatcher(size_t maxNumDirectories, int notificationDelay, QObject* parent = nullptr);
+
+  /// Returns the number of directories that can be watched at once without exhausting the
+  /// operating system's resources: half the per-user inotify watch limit on Linux.
+  static size_t defaultMaxNumDirectories();
+
+  /// Watches `directories` instead of the directories watched so far. Only the directories not
+  /// watched yet are added, and only those no longer needed are removed. If there are too many,
+  /// the ones furthest from the root of the filesystem are preferred, since new files usually
+  /// land in the leaves of a directory tree.
+  ///
+  /// \returns The number of directories that could not be watched.
+  size_t setDirectories(const std::vector<fs::path>& directories);
+
+  /// Stops watching all directories and discards any pending notification and changes.
+  void clear();
+
+  size_t numDirectories() const;
+
+  /// Returns the directories that have changed since the last call, sorted, and forgets them.
+  std::vector<fs::path> takeChangedDirectories();
+
+  /// Emits `directoriesChanged()` again after the notification delay. Used when a change cannot
+  /// be handled right away.
+  void postponeNotification();
+
+signals:
+  void directoriesChanged();
+
+private slots:
+  void onDirectoryChanged(const QString& directory);
+
+private:
+  size_t maxNumDirectories_;
+  QFileSystemWatcher watcher_;
+  QTimer timer_;
+  QSet<QString> changedDirectories_;
+};
@@ -16,14 +16,23 @@
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "Document.h"
+#include "CompiledPattern.h"
 #include "Constants.h"
 #include "ContainerUtils.h"
 #include "PatternMatching.h"
+#include "RunInBackground.h"
 #include "RuntimeError.h"
 
+#include <QtConcurrent>
+
+#include <exception>
+#include <map>
+#include <mutex>
+
 namespace
 {
 const char* DEFAULT_CAPTION_TEMPLATE = "%p";
+const char* INSTANCE_KEY_SEPARATOR = "...";
 
 QString join(const std::vector<QString>& strings, const QString& sep = QString())
 {
@@ -52,15 +61,221 @@ QJsonArray stringVectorToJsonStringArray(const std::vector<QString>& stringVecto
   std::copy(stringVector.begin(), stringVector.end(), std::back_inserter(jsonArray));
   return jsonArray;
 }
+
+QString patternMatchingStrategyToString(PatternMatchingStrategy strategy)
+{
+  switch (strategy)
+  {
+  case PatternMatchingStrategy::Probe:
+    return "probe";
+  case PatternMatchingStrategy::ProbeWithFallback:
+    return "probeWithFallback";
+  default:
+    return "glob";
+  }
+}
+
+PatternMatchingStrategy patternMatchingStrategyFromString(const QString& string)
+{
+  if (string == "probe")
+    return PatternMatchingStrategy::Probe;
+  else if (string == "probeWithFallback")
+    return PatternMatchingStrategy::ProbeWithFallback;
+  else
+    return PatternMatchingStrategy::Glob;
+}
+
+void checkInstanceIndices(const BookmarkSet& instanceIndices, size_t numInstances)
+{
+  const std::optional<size_t> lastIndex = instanceIndices.last();
+  if (lastIndex && *lastIndex >= numInstances)
+    throw RuntimeError("Invalid page index");
+}
+
+// Looks up the instance whose key, as returned by `Document::instanceKey()`, is `instanceKey` by
+// splitting the key into magic expression matches. Returns false if the key cannot be split
+// unambiguously because the matches may contain dots; otherwise sets `instanceIndex` to the
+// index of the instance, if there is one.
+bool findInstanceWithSplitKey(const InstanceTable& instances, const QString& instanceKey,
+                              std::optional<size_t>& instanceIndex)
+{
+  instanceIndex.reset();
+  const QStringList matches = instanceKey.split(INSTANCE_KEY_SEPARATOR);
+  const qsizetype numMagicExpressions = instances.numMagicExpressions();
+  // Splitting finds at least as many separators as there are between the matches, so a key
+  // with fewer parts belongs to no instance.
+  if (matches.size() < numMagicExpressions)
+    return true;
+  if (matches.size() > numMagicExpressions ||
+      instanceKey.contains(QString(INSTANCE_KEY_SEPARATOR) + "."))
+    return false;
+  instanceIndex = instances.find(std::vector<QString>(matches.begin(), matches.end()));
+  return true;
+}
+
+// Returns the results of matching `patterns` from which `instances` were found. The file matching
+// each pattern without magic expressions is shared by all instances, so it is only recovered if
+// there is at least one instance.
+std::vector<std::shared_ptr<PatternMatchingResult>>
+patternMatchingResultsOfInstances(const InstanceTable& instances,
+                                  const std::vector<QString>& patterns)
+{
+  std::vector<std::shared_ptr<PatternMatchingResult>> results;
+  for (size_t patternIndex = 0; patternIndex < patterns.size(); ++patternIndex)
+  {
+    auto result = std::make_shared<PatternMatchingResult>();
+    result->numMagicExpressions = CompiledPattern(patterns[patternIndex]).numMagicExpressions();
+    for (size_t i = 0; i < instances.size(); ++i)
+    {
+      const QString path = instances.path(i, patternIndex);
+      if (path.isEmpty())
+        continue;
+      std::vector<std::wstring> magicExpressionMatches;
+      if (result->numMagicExpressions > 0)
+        for (const QString& match : instances.magicExpressionMatches(i))
+          magicExpressionMatches.push_back(match.toStdWString());
+      result->patternMatches.push_back(
+        PatternMatch{path.toStdWString(), std::move(magicExpressionMatches)});
+      if (result->numMagicExpressions == 0)
+        break;
+    }
+    results.push_back(std::move(result));
+  }
+  return results;
+}
+
+// Changes turning the instances found before some directories changed into those found now.
+struct InstanceChanges
+{
+  /// Indices of the instances to erase, in increasing order.
+  std::vector<size_t> erasedIndices;
+  std::vector<Instance> newInstances;
+};
+
+// Returns the changes to make to `instances` given `results`, the current matches of the
+// patterns in the directories `changedDirectories` (sorted, in the form returned by
+// `normalizedDirectory()`). The files of `instances` lying in these directories are replaced by
+// the files found there now; instances left with no files are erased.
+InstanceChanges instanceChanges(const InstanceTable& instances,
+                                const std::vector<fs::path>& changedDirectories,
+                                const std::vector<std::shared_ptr<PatternMatchingResult>>& results)
+{
+  // The instances that may have changed, by key, with their indices (if they exist already).
+  std::map<std::vector<QString>, std::pair<std::optional<size_t>, Instance>> affectedInstances;
+  const size_t numPatterns = results.size();
+  // An empty table may not even have columns.
+  for (size_t patternIndex = 0; !instances.empty() && patternIndex < numPatterns; ++patternIndex)
+  {
+    const std::vector<QString>& directories = instances.directories(patternIndex);
+    for (size_t directoryIndex = 0; directoryIndex < directories.size(); ++directoryIndex)
+    {
+      if (directories[directoryIndex].isEmpty() ||
+          !std::binary_search(
+            changedDirectories.begin(), changedDirectories.end(),
+            normalizedDirectory(fs::path(directories[directoryIndex].toStdWString()))))
+        continue;
+      for (size_t index : instances.instancesInDirectory(patternIndex, directoryIndex))
+      {
+        auto [it, inserted] =
+          affectedInstances.try_emplace(instances.magicExpressionMatches(index));
+        if (inserted)
+          it->second = {index, instances[index]};
+        it->second.second.paths[patternIndex].clear();
+      }
+    }
+  }
+
+  for (size_t patternIndex = 0; patternIndex < numPatterns; ++patternIndex)
+  {
+    for (const PatternMatch& match : results[patternIndex]->patternMatches)
+    {
+      std::vector<QString> key;
+      for (const std::wstring& magicExpressionMatch : match.magicExpressionMatches)
+        key.push_back(QString::fromStdWString(magicExpressionMatch));
+      auto [it, inserted] = affectedInstances.try_emplace(key);
+      if (inserted)
+      {
+        if (std::optional<size_t> index = instances.find(key))
+          it->second = {index, instances[*index]};
+        else
+          it->second.second = Instance{std::vector<QString>(numPatterns), std::move(key)};
+      }
+      it->second.second.paths[patternIndex] = QString::fromStdWString(match.path.wstring());
+    }
+  }
+
+  InstanceChanges changes;
+  for (auto& [key, affectedInstance] : affectedInstances)
+  {
+    auto& [index, instance] = affectedInstance;
+    const bool hasFiles = std::any_of(instance.paths.begin(), instance.paths.end(),
+                                      [](const QString& path) { return !path.isEmpty(); });
+    if (index)
+    {
+      bool unchanged = hasFiles;
+      for (size_t patternIndex = 0; unchanged && patternIndex < numPatterns; ++patternIndex)
+        unchanged = instances.path(*index, patternIndex) == instance.paths[patternIndex];
+      if (unchanged)
+        continue;
+      changes.erasedIndices.push_back(*index);
+    }
+    if (hasFiles)
+      changes.newInstances.push_back(std::move(instance));
+  }
+  std::sort(changes.erasedIndices.begin(), changes.erasedIndices.end());
+  return changes;
+}
 } // namespace
 
+/// State shared by the document and the worker thread discovering its instances.
+struct Document::InstanceDiscovery
+{
+  PatternMatchingProgress progress;
+
+  std::mutex mutex;
+  /// Instances whose files have all been found, not yet added to the document. Guarded by
+  /// `mutex`.
+  std::vector<Instance> newInstances;
+
+  /// Set by the worker thread once matching is complete.
+  InstanceTable instances;
+  std::exception_ptr exception;
+
+  QFuture<void> future;
+};
+
+/// Changes to the instances found by searching again the directories that have changed, computed
+/// on a worker thread while the document's instances, patterns and searched directories stay as
+/// they are: the functions changing them discard the update first.
+struct Document::InstanceUpdate
+{
+  PatternMatchingProgress progress;
+
+  /// Set once the changes have been computed.
+  InstanceChanges changes;
+  std::vector<fs::path> searchedDirectories;
+  std::vector<std::optional<glob::DirectoryStamp>> searchedDirectoryStamps;
+  std::exception_ptr exception;
+
+  QFutureWatcher<void> watcher;
+};
+
 Document::Document()
 {
 }
 
-Document::~Document() = default;
+Document::~Document()
+{
+  if (instanceDiscovery_)
+  {
+    instanceDiscovery_->progress.cancellationRequested = true;
+    instanceDiscovery_->future.waitForFinished();
+  }
+  stopInstanceUpdate();
+}
 
-Document::Document(const QString& path, const std::function<void()>& onFilesystemTraversalProgress)
+Document::Document(const QString& path, PatternMatchingProgress* progress,
+                   bool deferPatternMatching)
   : path_(QDir::toNativeSeparators(path))
 {
   QFile file(path);
@@ -77,7 +292,7 @@ Document::Document(const QString& path, const std::function<void()>& onFilesyste
   {
     throw RuntimeError("Could not parse file " + path + ": " + error.errorString() + ".");
   }
-  initialiseFromJson(jsonDoc.object(), onFilesystemTraversalProgress);
+  initialiseFromJson(jsonDoc.object(), progress, deferPatternMatching);
   modified_ = false;
 }
 
@@ -91,30 +306,48 @@ void Document::setLayout(const Layout& layout)
   }
 }
 
-void Document::setPatterns(std::vector<QString> patterns,
-                           const std::function<void()>& onFilesystemTraversalProgress)
+void Document::setPatterns(std::vector<QString> patterns, PatternMatchingProgress* progress)
 {
   if (patterns != patterns_)
   {
     checkAllPatternsContainSameNumberOfMagicExpressionsOrNone(patterns);
-    std::vector<std::shared_ptr<PatternMatchingResult>> patternMatchingResults;
-    if (patternMatchingResults_.size() == patterns_.size())
-    {
-      patternMatchingResults = matchPatternsReusingPreviousResults(
-        patterns, patterns_, patternMatchingResults_, onFilesystemTraversalProgress);
-    }
-    else
-    {
-      patternMatchingResults = matchPatterns(patterns, onFilesystemTraversalProgress);
-    }
+    stopInstanceDiscovery();
+    stopInstanceUpdate();
+    InstanceTable newInstances;
+    // The worker only reads the document; it is updated below, on the calling thread.
+    runInBackground(
+      [&]
+      {
+        std::vector<std::shared_ptr<PatternMatchingResult>> patternMatchingResults;
+        if (patternMatchingStrategy_ != PatternMatchingStrategy::Glob)
+        {
+          // Probing relies on the driver pattern being matched together with the others.
+          patternMatchingResults =
+            matchPatterns(patterns, patternMatchingStrategy_, traversalLimits_, progress);
+        }
+        else if (instancesComplete_ && !instances_.empty())
+        {
+          // The results of the patterns kept are recovered from the instances rather than stored
+          // alongside them, which would take up several times as much memory.
+          patternMatchingResults = matchPatternsReusingPreviousResults(
+            patterns, patterns_, patternMatchingResultsOfInstances(instances_, patterns_),
+            traversalLimits_, progress);
+        }
+        else
+        {
+          patternMatchingResults =
+            matchPatterns(patterns, PatternMatchingStrategy::Glob, traversalLimits_, progress);
+        }
+        newInstances = InstanceTable(findInstances(patternMatchingResults));
+      });
 
-    const std::set<std::vector<QString>> oldBookmarkKeys = bookmarkKeys();
-    std::vector<Instance> newInstances = findInstances(patternMatchingResults);
-    std::set<size_t> newBookmarks = findInstanceIndices(newInstances, oldBookmarkKeys);
+    BookmarkSet newBookmarks = remapBookmarks(newInstances);
 
     instances_ = std::move(newInstances);
     bookmarks_ = std::move(newBookmarks);
-    patternMatchingResults_ = std::move(patternMatchingResults);
+    pendingBookmarkKeys_.clear();
+    instancesComplete_ = true;
+    clearSearchedDirectories();
     patterns_ = std::move(patterns);
     captionTemplates_.resize(patterns_.size(), DEFAULT_CAPTION_TEMPLATE);
     modified_ = true;
@@ -139,15 +372,14 @@ std::vector<QString> Document::captions(size_t instanceIndex) const
 {
   if (instanceIndex >= instances_.size())
     throw RuntimeError("Invalid page index");
-  const Instance& instance = instances_[instanceIndex];
-
   std::vector<QString> result = captionTemplates_;
   for (size_t i = 0; i < captionTemplates_.size(); ++i)
   {
-    if (instance.paths[i].isEmpty())
+    const QString path = instances_.path(instanceIndex, i);
+    if (path.isEmpty())
       result[i] = QString();
     else
-      result[i].replace(DEFAULT_CAPTION_TEMPLATE, instance.paths[i]);
+      result[i].replace(DEFAULT_CAPTION_TEMPLATE, path);
   }
   return result;
 }
@@ -162,20 +394,71 @@ void Document::setUseRelativePaths(bool useRelativePaths)
   }
 }
 
+void Document::setPatternMatchingStrategy(PatternMatchingStrategy strategy)
+{
+  if (strategy != patternMatchingStrategy_)
+  {
+    // Any instance update in progress is discarded first, so that none ends under the new strategy.
+    clearSearchedDirectories();
+    patternMatchingStrategy_ = strategy;
+    // Probing may have missed files that globbing would find.
+    instancesComplete_ = false;
+    modified_ = true;
+    modificationStatusChanged();
+  }
+}
+
+void Document::setTraversalLimits(TraversalLimits limits)
+{
+  if (limits != traversalLimits_)
+  {
+    // The worker of an instance update in progress reads the limits, so it is discarded first.
+    clearSearchedDirectories();
+    traversalLimits_ = std::move(limits);
+    // Instances found with the old limits cannot be reused.
+    instancesComplete_ = false;
+    modified_ = true;
+    modificationStatusChanged();
+  }
+}
+
 std::set<std::vector<QString>> Document::bookmarkKeys() const
 {
-  std::set<std::vector<QString>> keys;
+  std::set<std::vector<QString>> keys = pendingBookmarkKeys_;
   std::transform(bookmarks_.begin(), bookmarks_.end(), std::inserter(keys, keys.end()),
-                 [this](size_t index) { return instances_[index].magicExpressionMatches; });
+                 [this](size_t index) { return instances_.magicExpressionMatches(index); });
   return keys;
 }
 
+void Document::setBookmarkKeys(const std::set<std::vector<QString>>& keys)
+{
+  bookmarks_ = findInstanceIndices(instances_, keys);
+  pendingBookmarkKeys_ = keys;
+  for (size_t index : bookmarks_)
+    pendingBookmarkKeys_.erase(instances_.magicExpressionMatches(index));
+}
+
+BookmarkSet Document::remapBookmarks(const InstanceTable& newInstances) const
+{
+  BookmarkSet newBookmarks;
+  for (size_t index : bookmarks_)
+  {
+    const std::vector<QString> key = instances_.magicExpressionMatches(index);
+    if (std::optional<size_t> newIndex = newInstances.find(key))
+      newBookmarks.insert(*newIndex);
+  }
+  for (const std::vector<QString>& key : pendingBookmarkKeys_)
+    if (std::optional<size_t> newIndex = newInstances.find(key))
+      newBookmarks.insert(*newIndex);
+  return newBookmarks;
+}
+
 void Document::addBookmark(size_t instanceIndex)
 {
   if (instanceIndex >= instances_.size())
     throw RuntimeError("Invalid page index");
 
-  if (contains(bookmarks_, instanceIndex))
+  if (bookmarks_.contains(instanceIndex))
     return; // Bookmark already exists
 
   bookmarks_.insert(instanceIndex);
@@ -188,11 +471,10 @@ void Document::removeBookmark(size_t instanceIndex)
   if (instanceIndex >= instances_.size())
     throw RuntimeError("Invalid page index");
 
-  auto it = bookmarks_.find(instanceIndex);
-  if (it == bookmarks_.end())
+  if (!bookmarks_.contains(instanceIndex))
     return; // Bookmark does not exist.
 
-  bookmarks_.erase(it);
+  bookmarks_.erase(instanceIndex);
   modified_ = true;
   modificationStatusChanged();
 }
@@ -202,11 +484,7 @@ void Document::toggleBookmark(size_t instanceIndex)
   if (instanceIndex >= instances_.size())
     throw RuntimeError("Invalid page index");
 
-  auto it = bookmarks_.find(instanceIndex);
-  if (it != bookmarks_.end())
-    bookmarks_.erase(it);
-  else
-    bookmarks_.insert(instanceIndex);
+  bookmarks_.toggle(instanceIndex);
 
   modified_ = true;
   modificationStatusChanged();
@@ -214,36 +492,459 @@ void Document::toggleBookmark(size_t instanceIndex)
 
 void Document::removeAllBookmarks()
 {
-  if (bookmarks_.empty())
+  if (bookmarks_.empty() && pendingBookmarkKeys_.empty())
     return;
 
   bookmarks_.clear();
+  pendingBookmarkKeys_.clear();
+  modified_ = true;
+  modificationStatusChanged();
+}
+
+size_t Document::addBookmarks(const BookmarkSet& instanceIndices)
+{
+  checkInstanceIndices(instanceIndices, instances_.size());
+
+  const size_t previousNumBookmarks = bookmarks_.size();
+  bookmarks_.insert(instanceIndices);
+  const size_t numAddedBookmarks = bookmarks_.size() - previousNumBookmarks;
+  if (numAddedBookmarks > 0)
+  {
+    modified_ = true;
+    modificationStatusChanged();
+  }
+  return numAddedBookmarks;
+}
+
+size_t Document::removeBookmarks(const BookmarkSet& instanceIndices)
+{
+  checkInstanceIndices(instanceIndices, instances_.size());
+
+  const size_t previousNumBookmarks = bookmarks_.size();
+  bookmarks_.erase(instanceIndices);
+  const size_t numRemovedBookmarks = previousNumBookmarks - bookmarks_.size();
+  if (numRemovedBookmarks > 0)
+  {
+    modified_ = true;
+    modificationStatusChanged();
+  }
+  return numRemovedBookmarks;
+}
+
+void Document::setBookmarks(BookmarkSet instanceIndices)
+{
+  checkInstanceIndices(instanceIndices, instances_.size());
+
+  if (instanceIndices == bookmarks_ && pendingBookmarkKeys_.empty())
+    return;
+
+  bookmarks_ = std::move(instanceIndices);
+  pendingBookmarkKeys_.clear();
   modified_ = true;
   modificationStatusChanged();
 }
 
+BookmarkSet Document::importBookmarks(QTextStream& stream)
+{
+  BookmarkSet newBookmarks;
+  // Keys that cannot be split unambiguously are looked up among the keys of all instances,
+  // joined once for the whole import when the first such key is read.
+  std::optional<QHash<QString, size_t>> instanceIndicesByKey;
+  QString key;
+  while (stream.readLineInto(&key))
+  {
+    std::optional<size_t> instanceIndex;
+    if (!findInstanceWithSplitKey(instances_, key, instanceIndex))
+    {
+      if (!instanceIndicesByKey)
+      {
+        instanceIndicesByKey.emplace();
+        instanceIndicesByKey->reserve(instances_.size());
+        for (size_t i = 0; i < instances_.size(); ++i)
+          instanceIndicesByKey->insert(instanceKey(i), i);
+      }
+      if (auto it = instanceIndicesByKey->constFind(key); it != instanceIndicesByKey->constEnd())
+        instanceIndex = *it;
+    }
+    if (instanceIndex)
+      newBookmarks.insert(*instanceIndex);
+  }
+  newBookmarks.erase(bookmarks_);
+  addBookmarks(newBookmarks);
+  return newBookmarks;
+}
+
+void Document::exportBookmarks(QTextStream& stream) const
+{
+  for (size_t instanceIndex : bookmarks_)
+    stream << instanceKey(instanceIndex) << "\n";
+}
+
 QString Document::instanceKey(size_t instanceIndex) const
 {
   if (instanceIndex >= instances_.size())
     throw RuntimeError("Invalid page index");
-  const Instance& instance = instances_[instanceIndex];
-  return join(instance.magicExpressionMatches, "...");
+  return join(instances_.magicExpressionMatches(instanceIndex), INSTANCE_KEY_SEPARATOR);
+}
+
+std::optional<size_t> Document::findInstanceWithKey(const QString& instanceKey) const
+{
+  std::optional<size_t> instanceIndex;
+  if (findInstanceWithSplitKey(instances_, instanceKey, instanceIndex))
+    return instanceIndex;
+
+  // Some magic expression matches contain dots, so the key may be split in more than one way.
+  for (size_t i = 0; i < instances_.size(); ++i)
+    if (this->instanceKey(i) == instanceKey)
+      return i;
+  return std::nullopt;
+}
+
+std::function<InstanceKeyIndex()> Document::instanceKeyIndexBuilder() const
+{
+  return [distinctMatches = instances_.distinctMagicExpressionMatches(),
+          matchIndices = instances_.magicExpressionMatchIndices(),
+          numInstances = instances_.size(),
+          numMagicExpressions = instances_.numMagicExpressions()]
+  {
+    return InstanceKeyIndex(distinctMatches, matchIndices, numInstances, numMagicExpressions,
+                            INSTANCE_KEY_SEPARATOR);
+  };
 }
 
-void Document::regenerateInstances(const std::function<void()>& onFilesystemTraversalProgress)
+bool Document::regenerateInstances(PatternMatchingProgress* progress)
 {
   // This check may not be strictly necessary but better safe than sorry.
   checkAllPatternsContainSameNumberOfMagicExpressionsOrNone(patterns_);
-  std::vector<std::shared_ptr<PatternMatchingResult>> patternMatchingResults =
-    matchPatterns(patterns_, onFilesystemTraversalProgress);
+  stopInstanceDiscovery();
+  stopInstanceUpdate();
+  if (canUpdateInstancesIncrementally())
+  {
+    InstanceUpdate update;
+    bool anyDirectoryChanged = false;
+    runInBackground(
+      [&]
+      {
+        const std::vector<fs::path> changed =
+          changedDirectories(searchedDirectories_, searchedDirectoryStamps_);
+        if (changed.empty())
+          return;
+        anyDirectoryChanged = true;
+        findInstanceChanges(changed, progress, update);
+      });
+    if (!anyDirectoryChanged)
+      return false;
+    return applyInstanceUpdate(update, nullptr, nullptr);
+  }
+
+  InstanceTable newInstances;
+  std::vector<fs::path> searchedDirectories;
+  std::vector<std::optional<glob::DirectoryStamp>> searchedDirectoryStamps;
+  bool instancesChanged = false;
+  runInBackground(
+    [&]
+    {
+      newInstances = InstanceTable(
+        findInstances(matchPatterns(patterns_, patternMatchingStrategy_, traversalLimits_,
+                                    progress, &searchedDirectories, &searchedDirectoryStamps)));
+      instancesChanged = newInstances != instances_;
+    });
+
+  searchedDirectories_ = std::move(searchedDirectories);
+  searchedDirectoryStamps_ = std::move(searchedDirectoryStamps);
+  instancesComplete_ = true;
+  if (!instancesChanged)
+    return false;
 
-  const std::set<std::vector<QString>> oldBookmarkKeys = bookmarkKeys();
-  std::vector<Instance> newInstances = findInstances(patternMatchingResults);
-  std::set<size_t> newBookmarks = findInstanceIndices(newInstances, oldBookmarkKeys);
+  BookmarkSet newBookmarks = remapBookmarks(newInstances);
 
   instances_ = std::move(newInstances);
   bookmarks_ = std::move(newBookmarks);
-  patternMatchingResults_ = std::move(patternMatchingResults);
+  pendingBookmarkKeys_.clear();
+  return true;
+}
+
+bool Document::canUpdateInstancesIncrementally() const
+{
+  // Probing finds files outside the searched directories, and the file matching a pattern
+  // without magic expressions is shared by all instances rather than kept with its directory.
+  return instancesComplete_ && patternMatchingStrategy_ == PatternMatchingStrategy::Glob &&
+         !searchedDirectories_.empty() &&
+         std::all_of(patterns_.begin(), patterns_.end(), [](const QString& pattern)
+                     { return CompiledPattern(pattern).numMagicExpressions() > 0; });
+}
+
+void Document::startInstanceUpdate(std::vector<fs::path> changedDirectories)
+{
+  Q_ASSERT(canUpdateInstancesIncrementally());
+  stopInstanceDiscovery();
+  stopInstanceUpdate();
+
+  for (fs::path& directory : changedDirectories)
+    directory = normalizedDirectory(directory);
+  std::sort(changedDirectories.begin(), changedDirectories.end());
+  changedDirectories.erase(std::unique(changedDirectories.begin(), changedDirectories.end()),
+                           changedDirectories.end());
+
+  instanceUpdate_ = std::make_unique<InstanceUpdate>();
+  connect(&instanceUpdate_->watcher, &QFutureWatcher<void>::finished, this,
+          &Document::instanceUpdateFinished);
+  instanceUpdate_->watcher.setFuture(QtConcurrent::run(
+    [this, update = instanceUpdate_.get(), changedDirectories = std::move(changedDirectories)]
+    {
+      try
+      {
+        findInstanceChanges(changedDirectories, &update->progress, *update);
+      }
+      catch (...)
+      {
+        update->exception = std::current_exception();
+      }
+    }));
+}
+
+bool Document::finishInstanceUpdate(std::vector<size_t>* erasedIndices,
+                                    std::vector<size_t>* insertedIndices)
+{
+  if (!instanceUpdate_)
+    return false;
+
+  instanceUpdate_->watcher.waitForFinished();
+  const std::unique_ptr<InstanceUpdate> update = std::move(instanceUpdate_);
+  if (update->exception)
+    std::rethrow_exception(update->exception);
+  return applyInstanceUpdate(*update, erasedIndices, insertedIndices);
+}
+
+void Document::stopInstanceUpdate()
+{
+  if (!instanceUpdate_)
+    return;
+
+  instanceUpdate_->progress.cancellationRequested = true;
+  instanceUpdate_->watcher.waitForFinished();
+  instanceUpdate_.reset();
+}
+
+void Document::findInstanceChanges(const std::vector<fs::path>& changedDirectories,
+                                   PatternMatchingProgress* progress,
+                                   InstanceUpdate& update) const
+{
+  std::vector<fs::path> newSearchedDirectories;
+  std::vector<std::optional<glob::DirectoryStamp>> newSearchedDirectoryStamps;
+  const std::vector<std::shared_ptr<PatternMatchingResult>> results =
+    matchPatternsInChangedDirectories(patterns_, traversalLimits_, searchedDirectories_,
+                                      changedDirectories, progress, &newSearchedDirectories,
+                                      &newSearchedDirectoryStamps);
+  update.changes = instanceChanges(instances_, changedDirectories, results);
+
+  // The directories that have not changed keep their stamps; the others are replaced by those
+  // searched now. Both lists are sorted.
+  size_t newIndex = 0;
+  const auto appendNewSearchedDirectory = [&]
+  {
+    update.searchedDirectories.push_back(std::move(newSearchedDirectories[newIndex]));
+    update.searchedDirectoryStamps.push_back(newSearchedDirectoryStamps[newIndex]);
+    ++newIndex;
+  };
+  for (size_t oldIndex = 0; oldIndex < searchedDirectories_.size(); ++oldIndex)
+  {
+    const fs::path& directory = searchedDirectories_[oldIndex];
+    while (newIndex < newSearchedDirectories.size() &&
+           newSearchedDirectories[newIndex] < directory)
+      appendNewSearchedDirectory();
+    if (newIndex < newSearchedDirectories.size() && newSearchedDirectories[newIndex] == directory)
+      continue;
+    if (!std::binary_search(changedDirectories.begin(), changedDirectories.end(), directory))
+    {
+      update.searchedDirectories.push_back(directory);
+      update.searchedDirectoryStamps.push_back(searchedDirectoryStamps_[oldIndex]);
+    }
+  }
+  while (newIndex < newSearchedDirectories.size())
+    appendNewSearchedDirectory();
+}
+
+bool Document::applyInstanceUpdate(InstanceUpdate& update, std::vector<size_t>* erasedIndices,
+                                   std::vector<size_t>* insertedIndices)
+{
+  searchedDirectories_ = std::move(update.searchedDirectories);
+  searchedDirectoryStamps_ = std::move(update.searchedDirectoryStamps);
+  InstanceChanges& changes = update.changes;
+  if (changes.erasedIndices.empty() && changes.newInstances.empty())
+    return false;
+
+  eraseInstances(changes.erasedIndices);
+  std::vector<size_t> indices = insertInstances(std::move(changes.newInstances));
+  // The instances are complete, so the keys of bookmarked instances erased for good match none
+  // of them.
+  pendingBookmarkKeys_.clear();
+  if (erasedIndices)
+    *erasedIndices = std::move(changes.erasedIndices);
+  if (insertedIndices)
+    *insertedIndices = std::move(indices);
+  return true;
+}
+
+void Document::clearSearchedDirectories()
+{
+  // An update in progress would restore them.
+  stopInstanceUpdate();
+  searchedDirectories_.clear();
+  searchedDirectoryStamps_.clear();
+}
+
+void Document::startInstanceDiscovery()
+{
+  checkAllPatternsContainSameNumberOfMagicExpressionsOrNone(patterns_);
+  stopInstanceDiscovery();
+
+  std::vector<size_t> numMagicExpressionsPerPattern;
+  for (const QString& pattern : patterns_)
+    numMagicExpressionsPerPattern.push_back(CompiledPattern(pattern).numMagicExpressions());
+
+  instanceDiscovery_ = std::make_unique<InstanceDiscovery>();
+  instancesComplete_ = false;
+  clearSearchedDirectories();
+  // The worker gets copies of everything it needs from the document, which may change meanwhile.
+  instanceDiscovery_->future = QtConcurrent::run(
+    [discovery = instanceDiscovery_.get(), patterns = patterns_,
+     strategy = patternMatchingStrategy_, limits = traversalLimits_,
+     numMagicExpressionsPerPattern = std::move(numMagicExpressionsPerPattern)]
+    {
+      try
+      {
+        IncrementalInstanceFinder finder(numMagicExpressionsPerPattern);
+        discovery->progress.onPatternMatchFound =
+          [discovery, &finder](size_t patternIndex, const PatternMatch& match)
+        {
+          if (std::optional<Instance> instance = finder.addPatternMatch(patternIndex, match))
+          {
+            std::lock_guard<std::mutex> lock(discovery->mutex);
+            discovery->newInstances.push_back(std::move(*instance));
+          }
+        };
+        discovery->instances = InstanceTable(
+          findInstances(matchPatterns(patterns, strategy, limits, &discovery->progress)));
+      }
+      catch (...)
+      {
+        discovery->exception = std::current_exception();
+      }
+    });
+}
+
+bool Document::addDiscoveredInstances(std::vector<size_t>* insertedIndices)
+{
+  if (!instanceDiscovery_)
+    return true;
+
+  // Instances found after this check will be added next time.
+  const bool finished = instanceDiscovery_->future.isFinished();
+  std::vector<Instance> newInstances;
+  {
+    std::lock_guard<std::mutex> lock(instanceDiscovery_->mutex);
+    newInstances.swap(instanceDiscovery_->newInstances);
+  }
+
+  if (!finished || instanceDiscovery_->exception)
+  {
+    std::vector<size_t> indices = insertInstances(std::move(newInstances));
+    if (insertedIndices)
+      *insertedIndices = std::move(indices);
+    if (!finished)
+      return false;
+
+    const std::exception_ptr exception = instanceDiscovery_->exception;
+    instanceDiscovery_.reset();
+    std::rethrow_exception(exception);
+  }
+
+  BookmarkSet newBookmarks = remapBookmarks(instanceDiscovery_->instances);
+  instances_ = std::move(instanceDiscovery_->instances);
+  bookmarks_ = std::move(newBookmarks);
+  instancesComplete_ = true;
+  instanceDiscovery_.reset();
+  // The instances are now complete, so the remaining keys match none of them.
+  pendingBookmarkKeys_.clear();
+  return true;
+}
+
+const PatternMatchingProgress* Document::instanceDiscoveryProgress() const
+{
+  return instanceDiscovery_ ? &instanceDiscovery_->progress : nullptr;
+}
+
+void Document::stopInstanceDiscovery()
+{
+  if (!instanceDiscovery_)
+    return;
+
+  instanceDiscovery_->progress.cancellationRequested = true;
+  instanceDiscovery_->future.waitForFinished();
+
+  insertInstances(std::move(instanceDiscovery_->newInstances));
+  instanceDiscovery_.reset();
+}
+
+void Document::eraseInstances(const std::vector<size_t>& indices)
+{
+  if (indices.empty())
+    return;
+
+  // Instances may be erased only to be inserted again with other files, so the keys of the
+  // bookmarked ones are kept to bookmark them again.
+  BookmarkSet newBookmarks;
+  size_t numPrecedingErasedInstances = 0;
+  for (size_t index : bookmarks_)
+  {
+    while (numPrecedingErasedInstances < indices.size() &&
+           indices[numPrecedingErasedInstances] < index)
+      ++numPrecedingErasedInstances;
+    if (numPrecedingErasedInstances < indices.size() &&
+        indices[numPrecedingErasedInstances] == index)
+      pendingBookmarkKeys_.insert(instances_.magicExpressionMatches(index));
+    else
+      newBookmarks.insert(index - numPrecedingErasedInstances);
+  }
+
+  instances_.erase(indices);
+  bookmarks_ = std::move(newBookmarks);
+}
+
+std::vector<size_t> Document::insertInstances(std::vector<Instance> newInstances)
+{
+  std::vector<size_t> indices = instances_.insert(std::move(newInstances));
+  if (indices.empty())
+    return indices;
+
+  // The instance inserted with index indices[j] was placed before the old instances with indices
+  // indices[j] - j and above.
+  BookmarkSet newBookmarks;
+  size_t numPrecedingNewInstances = 0;
+  for (size_t index : bookmarks_)
+  {
+    while (numPrecedingNewInstances < indices.size() &&
+           indices[numPrecedingNewInstances] - numPrecedingNewInstances <= index)
+      ++numPrecedingNewInstances;
+    newBookmarks.insert(index + numPrecedingNewInstances);
+  }
+
+  if (!pendingBookmarkKeys_.empty())
+  {
+    for (size_t index : indices)
+    {
+      auto it = pendingBookmarkKeys_.find(instances_.magicExpressionMatches(index));
+      if (it != pendingBookmarkKeys_.end())
+      {
+        newBookmarks.insert(index);
+        pendingBookmarkKeys_.erase(it);
+      }
+    }
+  }
+
+  bookmarks_ = std::move(newBookmarks);
+  return indices;
 }
 
 QJsonObject Document::toJson(const QString& path) const
@@ -263,12 +964,20 @@ QJsonObject Document::toJson(const QString& path) const
   json["patterns"] = stringVectorToJsonStringArray(patterns);
   json["captionTemplates"] = stringVectorToJsonStringArray(captionTemplates_);
   json["useRelativePaths"] = useRelativePaths_;
+  json["patternMatchingStrategy"] = patternMatchingStrategyToString(patternMatchingStrategy_);
+  json["excludePatterns"] = stringVectorToJsonStringArray(traversalLimits_.excludePatterns);
+  if (traversalLimits_.maxRecursiveWildcardDepth)
+    json["maxRecursiveWildcardDepth"] = *traversalLimits_.maxRecursiveWildcardDepth;
 
   {
-    QJsonArray jsonBookmarks;
+    std::vector<std::vector<QString>> keys;
     for (size_t i : bookmarks_)
+      keys.push_back(instances_.magicExpressionMatches(i));
+    keys.insert(keys.end(), pendingBookmarkKeys_.begin(), pendingBookmarkKeys_.end());
+
+    QJsonArray jsonBookmarks;
+    for (std::vector<QString> key : keys)
     {
-      std::vector<QString> key = instances_[i].magicExpressionMatches;
       // Use the '/' separator for portability across OSs.
       std::transform(key.begin(), key.end(), key.begin(), QDir::fromNativeSeparators);
       jsonBookmarks.push_back(stringVectorToJsonStringArray(key));
@@ -279,13 +988,28 @@ QJsonObject Document::toJson(const QString& path) const
   return json;
 }
 
-void Document::initialiseFromJson(const QJsonObject& json,
-                                  const std::function<void()>& onFilesystemTraversalProgress)
+void Document::initialiseFromJson(const QJsonObject& json, PatternMatchingProgress* progress,
+                                  bool deferPatternMatching)
 {
   if (json.contains("useRelativePaths"))
   {
     setUseRelativePaths(json["useRelativePaths"].toBool());
   }
+  if (json.contains("patternMatchingStrategy"))
+  {
+    setPatternMatchingStrategy(
+      patternMatchingStrategyFromString(json["patternMatchingStrategy"].toString()));
+  }
+  {
+    TraversalLimits limits;
+    QJsonArray jsonExcludePatterns = json["excludePatterns"].toArray();
+    std::transform(jsonExcludePatterns.begin(), jsonExcludePatterns.end(),
+                   std::back_inserter(limits.excludePatterns),
+                   [](const QJsonValue& jsonPattern) { return jsonPattern.toString(); });
+    if (json.contains("maxRecursiveWildcardDepth"))
+      limits.maxRecursiveWildcardDepth = std::max(json["maxRecursiveWildcardDepth"].toInt(), 0);
+    setTraversalLimits(std::move(limits));
+  }
   {
     QJsonArray jsonPatterns = json["patterns"].toArray();
     std::vector<QString> patterns;
@@ -295,7 +1019,16 @@ void Document::initialiseFromJson(const QJsonObject& json,
       patterns.resize(MAX_NUM_PATTERNS);
     if (useRelativePaths_)
       patterns = absolutePatterns(patterns, path_);
-    setPatterns(std::move(patterns), onFilesystemTraversalProgress);
+    if (deferPatternMatching)
+    {
+      checkAllPatternsContainSameNumberOfMagicExpressionsOrNone(patterns);
+      patterns_ = std::move(patterns);
+      captionTemplates_.resize(patterns_.size(), DEFAULT_CAPTION_TEMPLATE);
+    }
+    else
+    {
+      setPatterns(std::move(patterns), progress);
+    }
   }
   {
     QJsonObject jsonLayout = json["layout"].toObject();
@@ -332,7 +1065,11 @@ void Document::initialiseFromJson(const QJsonObject& json,
         std::transform(key.begin(), key.end(), key.begin(), QDir::toNativeSeparators);
         return key;
       });
-    bookmarks_ = findInstanceIndices(instances_, bookmarkKeys);
+    setBookmarkKeys(bookmarkKeys);
+    // Bookmarks of instances that no longer exist are dropped, unless the instances are yet to be
+    // discovered.
+    if (!deferPatternMatching)
+      pendingBookmarkKeys_.clear();
   }
 }
 
@@ -386,24 +1123,18 @@ void Document::save(const QString& path)
 
 std::optional<int> findInstance(const Document& doc, const std::vector<QString>& key)
 {
-  auto matchingInstanceIt = std::find_if(doc.instances().begin(), doc.instances().end(),
-                                         [&key](const Instance& instance)
-                                         { return instance.magicExpressionMatches == key; });
-
-  if (matchingInstanceIt == doc.instances().end())
-    return std::nullopt;
-  else
-    return matchingInstanceIt - doc.instances().begin();
+  if (std::optional<size_t> index = doc.instances().find(key))
+    return static_cast<int>(*index);
+  return std::nullopt;
 }
 
-std::set<size_t> findInstanceIndices(const std::vector<Instance>& instances,
-                                     const std::set<std::vector<QString>>& keys)
+BookmarkSet findInstanceIndices(const InstanceTable& instances,
+                                const std::set<std::vector<QString>>& keys)
 {
-  std::set<size_t> result;
-  if (!keys.empty())
-    for (size_t i = 0; i < instances.size(); ++i)
-      if (contains(keys, instances[i].magicExpressionMatches))
-        result.insert(i);
+  BookmarkSet result;
+  for (const std::vector<QString>& key : keys)
+    if (std::optional<size_t> index = instances.find(key))
+      result.insert(*index);
   return result;
 }
 
@@ -17,24 +17,32 @@
 
 #pragma once
 
-#include "Instance.h"
+#include "BookmarkSet.h"
+#include "InstanceKeyIndex.h"
+#include "InstanceTable.h"
 #include "Layout.h"
+#include "PatternMatching.h"
 
 #include <QString>
 
+class QTextStream;
+
+#include <functional>
+#include <optional>
 #include <set>
 #include <vector>
 
-class PatternMatchingResult;
-
 class Document : public QObject
 {
   Q_OBJECT
 
 public:
   Document();
-  explicit Document(
-    const QString& path, const std::function<void()>& onFilesystemTraversalProgress = []() {});
+  /// Matching the patterns runs on a worker thread; see `setPatterns()`. If
+  /// `deferPatternMatching` is true, the patterns are not matched and the document has no
+  /// instances until `startInstanceDiscovery()` is called.
+  explicit Document(const QString& path, PatternMatchingProgress* progress = nullptr,
+                    bool deferPatternMatching = false);
   Document(const Document&) = delete;
   Document(Document&&) = delete;
   Document& operator=(const Document&) = delete;
@@ -47,40 +55,181 @@ public:
   void setLayout(const Layout& layout);
 
   const std::vector<QString>& patterns() const { return patterns_; }
-  void setPatterns(
-    std::vector<QString> patterns,
-    const std::function<void()>& onFilesystemTraversalProgress = []() {});
+  /// Matches the patterns on a worker thread, processing events on the calling thread in the
+  /// meantime, and updates the document once matching is complete. If `progress` is not null,
+  /// it is updated while matching runs, and matching can be cancelled through it.
+  void setPatterns(std::vector<QString> patterns, PatternMatchingProgress* progress = nullptr);
 
   const std::vector<QString>& captionTemplates() const { return captionTemplates_; }
   void setCaptionTemplates(std::vector<QString> captionTemplates);
 
   std::vector<QString> captions(size_t instanceIndex) const;
 
-  const std::set<size_t>& bookmarks() const { return bookmarks_; }
+  const BookmarkSet& bookmarks() const { return bookmarks_; }
+  /// Also includes the keys of the bookmarked instances not discovered yet.
   std::set<std::vector<QString>> bookmarkKeys() const;
   void addBookmark(size_t instanceIndex);
   void removeBookmark(size_t instanceIndex);
   void toggleBookmark(size_t instanceIndex);
   void removeAllBookmarks();
 
+  /// Bookmarks all the given instances at once. Returns the number of instances that were not
+  /// bookmarked before.
+  size_t addBookmarks(const BookmarkSet& instanceIndices);
+  /// Removes the bookmarks of all the given instances at once. Returns the number of bookmarks
+  /// removed.
+  size_t removeBookmarks(const BookmarkSet& instanceIndices);
+  /// Replaces all bookmarks, including those not discovered yet, with the given instances.
+  void setBookmarks(BookmarkSet instanceIndices);
+
+  /// Reads instance keys, as returned by `instanceKey()`, one per line from `stream` and
+  /// bookmarks the instances with these keys at once. Returns the instances newly bookmarked.
+  BookmarkSet importBookmarks(QTextStream& stream);
+  /// Writes the keys of the bookmarked instances to `stream`, one per line.
+  void exportBookmarks(QTextStream& stream) const;
+
   bool useRelativePaths() const { return useRelativePaths_; }
   void setUseRelativePaths(bool useRelativePaths);
 
+  /// Takes effect the next time the patterns are matched.
+  PatternMatchingStrategy patternMatchingStrategy() const { return patternMatchingStrategy_; }
+  void setPatternMatchingStrategy(PatternMatchingStrategy strategy);
+
+  /// Takes effect the next time the patterns are matched.
+  const TraversalLimits& traversalLimits() const { return traversalLimits_; }
+  void setTraversalLimits(TraversalLimits limits);
+
   QString instanceKey(size_t instanceIndex) const;
+  /// Returns the index of the instance whose key, as returned by `instanceKey()`, is
+  /// `instanceKey`, if there is one.
+  ///
+  /// Keys whose magic expression matches may contain dots, and so cannot be split unambiguously,
+  /// are compared with the keys of all instances, which is slow for large albums.
+  std::optional<size_t> findInstanceWithKey(const QString& instanceKey) const;
+  /// Returns a function building an index of the keys of the current instances, as returned by
+  /// `instanceKey()`. The function works on copies of the data it needs, so it can be run on a
+  /// worker thread while the document changes.
+  std::function<InstanceKeyIndex()> instanceKeyIndexBuilder() const;
 
   bool modified() const { return modified_; }
 
-  void regenerateInstances(const std::function<void()>& onFilesystemTraversalProgress = []() {});
+  /// Matches the patterns again like `setPatterns()`.
+  ///
+  /// If the patterns were last matched by this function with the Glob strategy and all of them
+  /// contain magic expressions, only the directories whose stamps have changed since they were
+  /// searched, and the new directories found in them, are searched again, and the instances with
+  /// files in them are updated in place. Otherwise all the patterns are matched again, and the
+  /// instances are left untouched if none has changed.
+  ///
+  /// \returns True if the instances have changed, false otherwise.
+  bool regenerateInstances(PatternMatchingProgress* progress = nullptr);
+
+  /// Returns the directories searched for files matching the patterns the last time
+  /// `regenerateInstances()` was called, or nothing if the patterns, strategy or traversal limits
+  /// have changed since. The instances can only change through changes to these directories.
+  const std::vector<fs::path>& searchedDirectories() const { return searchedDirectories_; }
+
+  /// Returns true if the instances can be brought up to date by searching only the directories
+  /// that have changed: if they were last found by `regenerateInstances()` with the Glob strategy
+  /// and all the patterns contain magic expressions.
+  bool canUpdateInstancesIncrementally() const;
+
+  /// Starts bringing the instances up to date on a worker thread after entries have been
+  /// created, deleted or renamed in `changedDirectories`, e.g. as reported by a
+  /// `DirectoryWatcher`, and returns immediately. Only these directories and the new ones found
+  /// in them are searched. `instanceUpdateFinished()` is emitted once the changes can be applied
+  /// with `finishInstanceUpdate()`; until then the instances are left untouched, and matching
+  /// the patterns in any other way discards the update. Any update in progress is stopped first.
+  ///
+  /// May only be called if `canUpdateInstancesIncrementally()` returns true.
+  void startInstanceUpdate(std::vector<fs::path> changedDirectories);
+
+  bool isUpdatingInstances() const { return instanceUpdate_ != nullptr; }
+
+  /// Waits for the instance update in progress, if any, to finish and applies its changes: the
+  /// instances whose files have changed are erased and inserted again, keeping the bookmarks
+  /// attached to them.
+  ///
+  /// If `erasedIndices` is not null, it receives the indices the erased instances had, and if
+  /// `insertedIndices` is not null, the indices the inserted instances have got, both in
+  /// increasing order. If the update has failed, rethrows the exception.
+  ///
+  /// \returns True if the instances have changed, false otherwise.
+  bool finishInstanceUpdate(std::vector<size_t>* erasedIndices = nullptr,
+                            std::vector<size_t>* insertedIndices = nullptr);
+
+  /// Discards the instance update in progress, if any.
+  void stopInstanceUpdate();
+
+  const InstanceTable& instances() const { return instances_; }
 
-  const std::vector<Instance>& instances() const { return instances_; }
+  /// Starts matching the patterns on a worker thread and returns immediately, so that the
+  /// instances found first can be viewed while matching continues. Any instance discovery
+  /// already in progress is stopped first.
+  void startInstanceDiscovery();
+
+  /// Adds the instances whose files have all been found since the last call to `instances()`,
+  /// keeping them sorted and the bookmarks attached to the same instances. Once matching is
+  /// complete, replaces the instances with the full list, which also includes the instances
+  /// lacking some files, and returns true.
+  ///
+  /// If `insertedIndices` is not null and matching is not complete, sets it to the indices the
+  /// added instances have got, in increasing order.
+  ///
+  /// If matching has failed, keeps the instances found so far and rethrows the exception.
+  bool addDiscoveredInstances(std::vector<size_t>* insertedIndices = nullptr);
+
+  bool isDiscoveringInstances() const { return instanceDiscovery_ != nullptr; }
+
+  /// Returns the progress of the instance discovery in progress, or null if there is none.
+  const PatternMatchingProgress* instanceDiscoveryProgress() const;
+
+  /// Cancels the instance discovery in progress, if any, keeping the instances found so far.
+  /// Matching the patterns in any other way stops it too.
+  void stopInstanceDiscovery();
 
   QJsonObject toJson(const QString& path) const;
 
   void save(const QString& path);
 
 private:
-  void initialiseFromJson(
-    const QJsonObject& json, const std::function<void()>& onFilesystemTraversalProgress = []() {});
+  struct InstanceDiscovery;
+  struct InstanceUpdate;
+
+  void initialiseFromJson(const QJsonObject& json, PatternMatchingProgress* progress = nullptr,
+                          bool deferPatternMatching = false);
+
+  /// Bookmarks the instances with the given keys. The other keys are kept in
+  /// `pendingBookmarkKeys_`.
+  void setBookmarkKeys(const std::set<std::vector<QString>>& keys);
+
+  /// Searches the directories `changedDirectories` (sorted, in the form returned by
+  /// `normalizedDirectory()`) and the new ones found in them, and stores in `update` the changes
+  /// to make to the instances and the searched directories.
+  void findInstanceChanges(const std::vector<fs::path>& changedDirectories,
+                           PatternMatchingProgress* progress, InstanceUpdate& update) const;
+
+  /// Applies the changes found by `findInstanceChanges()`; see `finishInstanceUpdate()`.
+  bool applyInstanceUpdate(InstanceUpdate& update, std::vector<size_t>* erasedIndices,
+                           std::vector<size_t>* insertedIndices);
+
+  /// Forgets the searched directories, which no longer tell where the instances can change, and
+  /// discards any instance update in progress.
+  void clearSearchedDirectories();
+
+  /// Erases the instances with the given indices, in increasing order, moving the bookmarks of
+  /// the instances following them. The keys of the bookmarked instances erased are kept in
+  /// `pendingBookmarkKeys_`.
+  void eraseInstances(const std::vector<size_t>& indices);
+
+  /// Inserts `newInstances` into the (sorted) instances, moving the bookmarks of the instances
+  /// following them and bookmarking those with pending bookmark keys. Returns the indices the new
+  /// instances have got, in increasing order.
+  std::vector<size_t> insertInstances(std::vector<Instance> newInstances);
+
+  /// Returns the bookmarks of the instances of `newInstances` with the same keys as the
+  /// bookmarked instances of the document or its pending bookmark keys.
+  BookmarkSet remapBookmarks(const InstanceTable& newInstances) const;
 
   static std::vector<QString> relativePatterns(const std::vector<QString>& absolutePatterns,
                                                const QString& docPath);
@@ -89,6 +238,7 @@ private:
 
 signals:
   void modificationStatusChanged();
+  void instanceUpdateFinished();
 
 private:
   QString path_;
@@ -96,17 +246,31 @@ private:
   std::vector<QString> patterns_;
   std::vector<QString> captionTemplates_;
   bool useRelativePaths_ = false;
+  PatternMatchingStrategy patternMatchingStrategy_ = PatternMatchingStrategy::Glob;
+  TraversalLimits traversalLimits_;
 
   bool modified_ = false;
-  std::vector<std::shared_ptr<PatternMatchingResult>> patternMatchingResults_;
-  std::vector<Instance> instances_;
-  std::set<size_t> bookmarks_;
+  InstanceTable instances_;
+  /// True if `instances_` were found by matching all the patterns to completion, with the current
+  /// strategy and traversal limits. Only then can they stand for the results of matching the
+  /// patterns kept when the patterns change.
+  bool instancesComplete_ = false;
+  BookmarkSet bookmarks_;
+  /// Keys of bookmarked instances not found (yet) because the instances are still being
+  /// discovered, or discovery was stopped before they were found.
+  std::set<std::vector<QString>> pendingBookmarkKeys_;
+  std::vector<fs::path> searchedDirectories_;
+  /// Stamps of `searchedDirectories_` taken before they were searched, or nothing where they
+  /// could not be trusted.
+  std::vector<std::optional<glob::DirectoryStamp>> searchedDirectoryStamps_;
+  std::unique_ptr<InstanceDiscovery> instanceDiscovery_;
+  std::unique_ptr<InstanceUpdate> instanceUpdate_;
 };
 
 std::optional<int> findInstance(const Document& doc, const std::vector<QString>& key);
 
-std::set<size_t> findInstanceIndices(const std::vector<Instance>& instances,
-                                     const std::set<std::vector<QString>>& keys);
+BookmarkSet findInstanceIndices(const InstanceTable& instances,
+                                const std::set<std::vector<QString>>& keys);
 
 std::vector<QString> updateCaptionTemplates(const std::vector<QString>& previousCaptionTemplates,
                                             const std::vector<QString>& previousPatterns,
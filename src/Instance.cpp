@@ -19,9 +19,48 @@
 #include "PatternMatching.h"
 #include "RuntimeError.h"
 
+#include <QtConcurrent>
+
+#include <cstdint>
+#include <numeric>
+#include <unordered_map>
+
 namespace
 {
-using StringsToIndexMap = std::map<std::vector<std::wstring>, std::size_t>;
+// Minimum number of pattern matches worth giving a partition (and a thread) of its own when
+// grouping pattern matches into instances.
+constexpr std::size_t MIN_MATCHES_PER_PARTITION = 16384;
+
+// Minimum number of instances worth sorting on a thread of their own.
+constexpr std::size_t MIN_INSTANCES_PER_SORTED_CHUNK = 16384;
+
+// A match of the pattern with index `patternIndex`, with the hash of its magic expression matches.
+struct HashedPatternMatch
+{
+  std::size_t patternIndex;
+  const PatternMatch* match;
+  std::size_t hash;
+};
+
+// The collation keys of the magic expression matches of the instance with index `instanceIndex`.
+struct InstanceSortKey
+{
+  std::vector<QCollatorSortKey> collationKeys;
+  std::size_t instanceIndex;
+};
+
+struct HashedPatternMatchHash
+{
+  std::size_t operator()(const HashedPatternMatch* m) const { return m->hash; }
+};
+
+struct HashedPatternMatchEqual
+{
+  bool operator()(const HashedPatternMatch* a, const HashedPatternMatch* b) const
+  {
+    return a->match->magicExpressionMatches == b->match->magicExpressionMatches;
+  }
+};
 
 std::size_t numberOfMagicExpressions(
   const std::vector<std::shared_ptr<PatternMatchingResult>>& patternMatchingResults)
@@ -47,35 +86,78 @@ std::size_t numberOfMagicExpressions(
   return numMagicExpressions;
 }
 
-StringsToIndexMap enumerateUniqueMagicExpressionMatches(
-  const std::vector<std::shared_ptr<PatternMatchingResult>>& results)
+std::size_t hashMagicExpressionMatches(const std::vector<std::wstring>& magicExpressionMatches)
 {
-  StringsToIndexMap uniqueMagicExpressionMatchesIndex;
-  for (const std::shared_ptr<PatternMatchingResult>& result : results)
+  std::size_t hash = 0;
+  for (const std::wstring& match : magicExpressionMatches)
+    hash ^= std::hash<std::wstring>()(match) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+  return hash;
+}
+
+// Distributes the matches of the patterns containing magic expressions among `numPartitions`
+// partitions, so that all matches with the same magic expression matches land in the same
+// partition. Within each partition, matches are ordered by pattern and then as in `results`.
+std::vector<std::vector<HashedPatternMatch>>
+partitionPatternMatches(const std::vector<std::shared_ptr<PatternMatchingResult>>& results,
+                        std::size_t numPartitions)
+{
+  std::vector<std::vector<HashedPatternMatch>> partitions(numPartitions);
+  for (std::size_t iPattern = 0; iPattern < results.size(); ++iPattern)
   {
-    if (result->numMagicExpressions != 0)
+    const std::vector<PatternMatch>& patternMatches = results[iPattern]->patternMatches;
+    if (results[iPattern]->numMagicExpressions == 0 || patternMatches.empty())
+      continue;
+
+    const std::vector<std::size_t> hashes = QtConcurrent::blockingMapped(
+      patternMatches, [](const PatternMatch& match)
+      { return hashMagicExpressionMatches(match.magicExpressionMatches); });
+    for (std::size_t iMatch = 0; iMatch < patternMatches.size(); ++iMatch)
     {
-      for (const PatternMatch& patternMatch : result->patternMatches)
-      {
-        uniqueMagicExpressionMatchesIndex[patternMatch.magicExpressionMatches] = 0;
-      }
+      const std::size_t hash = hashes[iMatch];
+      // Partition by the high bits of the mixed hash, leaving the low bits, on which the hash
+      // tables of the partitions may rely, evenly distributed within each partition.
+      const std::size_t iPartition =
+        static_cast<std::size_t>((std::uint64_t(hash) * 0x9e3779b97f4a7c15ull) >> 32) %
+        numPartitions;
+      partitions[iPartition].push_back(
+        HashedPatternMatch{iPattern, &patternMatches[iMatch], hash});
     }
   }
+  return partitions;
+}
 
+// Groups the pattern matches of a partition into instances, in the order in which their magic
+// expression matches first appear. `literalPaths` holds the paths shared by all instances.
+std::vector<Instance> joinPatternMatches(const std::vector<HashedPatternMatch>& partition,
+                                         const std::vector<QString>& literalPaths)
+{
+  std::vector<Instance> instances;
+  std::unordered_map<const HashedPatternMatch*, std::size_t, HashedPatternMatchHash,
+                     HashedPatternMatchEqual>
+    instanceIndices;
+  instanceIndices.reserve(partition.size());
+  for (const HashedPatternMatch& hashedMatch : partition)
   {
-    std::size_t i = 0;
-    for (auto& [magicExpressionMatches, index] : uniqueMagicExpressionMatchesIndex)
+    const auto [it, inserted] = instanceIndices.emplace(&hashedMatch, instances.size());
+    if (inserted)
     {
-      index = i++;
+      const std::vector<std::wstring>& magicExpressionMatches =
+        hashedMatch.match->magicExpressionMatches;
+      Instance& instance = instances.emplace_back(Instance{literalPaths, {}});
+      instance.magicExpressionMatches.reserve(magicExpressionMatches.size());
+      std::transform(magicExpressionMatches.begin(), magicExpressionMatches.end(),
+                     std::back_inserter(instance.magicExpressionMatches),
+                     &QString::fromStdWString);
     }
+    instances[it->second].paths[hashedMatch.patternIndex] =
+      QString::fromStdWString(hashedMatch.match->path.wstring());
   }
-  return uniqueMagicExpressionMatchesIndex;
+  return instances;
 }
 
 std::vector<Instance>
 createInstances(std::size_t numMagicExpressions,
-                const std::vector<std::shared_ptr<PatternMatchingResult>>& results,
-                const StringsToIndexMap& uniqueMagicExpressionMatchesIndex)
+                const std::vector<std::shared_ptr<PatternMatchingResult>>& results)
 {
   std::vector<Instance> instances;
   if (numMagicExpressions == 0)
@@ -100,43 +182,84 @@ createInstances(std::size_t numMagicExpressions,
   else
   {
     const size_t numPatterns = results.size();
-    std::transform(uniqueMagicExpressionMatchesIndex.begin(),
-                   uniqueMagicExpressionMatchesIndex.end(), std::back_inserter(instances),
-                   [numPatterns](const StringsToIndexMap::value_type& matchAndIndex)
-                   {
-                     std::vector<QString> matches;
-                     std::transform(matchAndIndex.first.begin(), matchAndIndex.first.end(),
-                                    std::back_inserter(matches), &QString::fromStdWString);
-                     return Instance{std::vector<QString>(numPatterns), matches};
-                   });
+    std::vector<QString> literalPaths(numPatterns);
+    std::size_t numMatches = 0;
     for (size_t iPattern = 0; iPattern < numPatterns; ++iPattern)
     {
       const std::shared_ptr<PatternMatchingResult>& result = results[iPattern];
       if (result->numMagicExpressions == 0)
       {
         if (!result->patternMatches.empty())
-        {
-          const QString path =
+          literalPaths[iPattern] =
             QString::fromStdWString(result->patternMatches.front().path.wstring());
-          for (Instance& instance : instances)
-            instance.paths[iPattern] = path;
-        }
       }
       else
       {
-        for (const PatternMatch& patternMatch : result->patternMatches)
-        {
-          const std::size_t iInstance =
-            uniqueMagicExpressionMatchesIndex.at(patternMatch.magicExpressionMatches);
-          instances[iInstance].paths[iPattern] =
-            QString::fromStdWString(patternMatch.path.wstring());
-        }
+        numMatches += result->patternMatches.size();
       }
     }
+
+    // Hash join on the magic expression matches: matches sharing them always fall into the same
+    // partition, so the partitions can be joined independently of each other.
+    const std::size_t numPartitions =
+      std::clamp<std::size_t>(numMatches / MIN_MATCHES_PER_PARTITION, 1,
+                              std::max(QThread::idealThreadCount(), 1));
+    const std::vector<std::vector<HashedPatternMatch>> partitions =
+      partitionPatternMatches(results, numPartitions);
+    std::vector<std::vector<Instance>> partitionInstances = QtConcurrent::blockingMapped(
+      partitions, [&literalPaths](const std::vector<HashedPatternMatch>& partition)
+      { return joinPatternMatches(partition, literalPaths); });
+
+    std::size_t numInstances = 0;
+    for (const std::vector<Instance>& partitionInstance : partitionInstances)
+      numInstances += partitionInstance.size();
+    instances.reserve(numInstances);
+    for (std::vector<Instance>& partitionInstance : partitionInstances)
+      std::move(partitionInstance.begin(), partitionInstance.end(),
+                std::back_inserter(instances));
     sortInstances(instances);
   }
   return instances;
 }
+
+QCollator instanceCollator()
+{
+  QCollator collator;
+  collator.setCaseSensitivity(Qt::CaseInsensitive);
+  collator.setNumericMode(true);
+  return collator;
+}
+
+InstanceSortKey makeSortKey(const QCollator& collator, const std::vector<Instance>& instances,
+                            std::size_t instanceIndex)
+{
+  InstanceSortKey key{{}, instanceIndex};
+  const std::vector<QString>& magicExpressionMatches =
+    instances[instanceIndex].magicExpressionMatches;
+  key.collationKeys.reserve(magicExpressionMatches.size());
+  for (const QString& match : magicExpressionMatches)
+    key.collationKeys.push_back(collator.sortKey(match));
+  return key;
+}
+
+// Returns the ordering of sort keys of `instances` equivalent to `InstanceKeyLessThan`.
+auto sortKeyLessThan(const std::vector<Instance>& instances)
+{
+  return [&instances](const InstanceSortKey& ka, const InstanceSortKey& kb)
+  {
+    const std::vector<QCollatorSortKey>& a = ka.collationKeys;
+    const std::vector<QCollatorSortKey>& b = kb.collationKeys;
+    for (size_t i = 0, n = std::min(a.size(), b.size()); i < n; ++i)
+    {
+      if (const int comparison = a[i].compare(b[i]))
+        return comparison < 0;
+    }
+    if (a.size() != b.size())
+      return a.size() < b.size();
+    return instances[ka.instanceIndex].magicExpressionMatches <
+           instances[kb.instanceIndex].magicExpressionMatches;
+  };
+}
 } // namespace
 
 bool operator==(const Instance& a, const Instance& b)
@@ -149,31 +272,131 @@ bool operator!=(const Instance& a, const Instance& b)
   return !(a == b);
 }
 
+InstanceKeyLessThan::InstanceKeyLessThan() : collator_(instanceCollator())
+{
+}
+
+bool InstanceKeyLessThan::operator()(const std::vector<QString>& a,
+                                     const std::vector<QString>& b) const
+{
+  for (size_t i = 0, n = std::min(a.size(), b.size()); i < n; ++i)
+  {
+    if (const int comparison = collator_.compare(a[i], b[i]))
+      return comparison < 0;
+  }
+  if (a.size() != b.size())
+    return a.size() < b.size();
+  // Break ties between matches the collator considers equal, e.g. differing only in case, so
+  // that the order does not depend on that of the instances being sorted.
+  return a < b;
+}
+
 std::vector<Instance>
 findInstances(const std::vector<std::shared_ptr<PatternMatchingResult>>& patternMatchingResults)
 {
   const std::size_t numMagicExpressions = numberOfMagicExpressions(patternMatchingResults);
-
-  // Assign an index to each unique set of magic expression matches.
-  const StringsToIndexMap uniqueMagicExpressionMatchesIndex =
-    enumerateUniqueMagicExpressionMatches(patternMatchingResults);
-
-  return createInstances(numMagicExpressions, patternMatchingResults,
-                         uniqueMagicExpressionMatchesIndex);
+  return createInstances(numMagicExpressions, patternMatchingResults);
 }
 
 void sortInstances(std::vector<Instance>& instances)
 {
   const size_t numInstances = instances.size();
+  const auto lessThan = sortKeyLessThan(instances);
 
-  QCollator collator;
-  collator.setCaseSensitivity(Qt::CaseInsensitive);
-  collator.setNumericMode(true);
-  auto lessThan = [&collator](const Instance& va, const Instance& vb)
+  // Collate each magic expression match once, rather than at each comparison, and sort chunks of
+  // the instances in parallel.
+  const size_t numChunks = std::clamp<size_t>(numInstances / MIN_INSTANCES_PER_SORTED_CHUNK, 1,
+                                              std::max(QThread::idealThreadCount(), 1));
+  std::vector<size_t> chunkIndices(numChunks);
+  std::iota(chunkIndices.begin(), chunkIndices.end(), 0);
+  std::vector<std::vector<InstanceSortKey>> sortedChunks = QtConcurrent::blockingMapped(
+    chunkIndices,
+    [&](size_t chunkIndex)
+    {
+      // QCollator may not be used concurrently from several threads.
+      const QCollator collator = instanceCollator();
+      const size_t begin = chunkIndex * numInstances / numChunks;
+      const size_t end = (chunkIndex + 1) * numInstances / numChunks;
+      std::vector<InstanceSortKey> keys;
+      keys.reserve(end - begin);
+      for (size_t i = begin; i < end; ++i)
+        keys.push_back(makeSortKey(collator, instances, i));
+      std::sort(keys.begin(), keys.end(), lessThan);
+      return keys;
+    });
+
+  // Merge the sorted chunks in pairs until one is left.
+  while (sortedChunks.size() > 1)
   {
-    return std::lexicographical_compare(
-      va.magicExpressionMatches.begin(), va.magicExpressionMatches.end(),
-      vb.magicExpressionMatches.begin(), vb.magicExpressionMatches.end(), collator);
-  };
-  std::sort(instances.begin(), instances.end(), lessThan);
+    std::vector<size_t> pairIndices(sortedChunks.size() / 2);
+    std::iota(pairIndices.begin(), pairIndices.end(), 0);
+    std::vector<std::vector<InstanceSortKey>> mergedChunks = QtConcurrent::blockingMapped(
+      pairIndices,
+      [&](size_t pairIndex)
+      {
+        std::vector<InstanceSortKey>& a = sortedChunks[2 * pairIndex];
+        std::vector<InstanceSortKey>& b = sortedChunks[2 * pairIndex + 1];
+        std::vector<InstanceSortKey> merged;
+        merged.reserve(a.size() + b.size());
+        std::merge(std::make_move_iterator(a.begin()), std::make_move_iterator(a.end()),
+                   std::make_move_iterator(b.begin()), std::make_move_iterator(b.end()),
+                   std::back_inserter(merged), lessThan);
+        return merged;
+      });
+    if (sortedChunks.size() % 2 != 0)
+      mergedChunks.push_back(std::move(sortedChunks.back()));
+    sortedChunks = std::move(mergedChunks);
+  }
+
+  std::vector<Instance> sortedInstances;
+  sortedInstances.reserve(numInstances);
+  for (const InstanceSortKey& key : sortedChunks.front())
+    sortedInstances.push_back(std::move(instances[key.instanceIndex]));
+  instances = std::move(sortedInstances);
+}
+
+IncrementalInstanceFinder::IncrementalInstanceFinder(
+  std::vector<size_t> numMagicExpressionsPerPattern)
+  : numMagicExpressionsPerPattern_(std::move(numMagicExpressionsPerPattern)),
+    literalPaths_(numMagicExpressionsPerPattern_.size())
+{
+  numPatternsWithMagicExpressions_ =
+    std::count_if(numMagicExpressionsPerPattern_.begin(), numMagicExpressionsPerPattern_.end(),
+                  [](size_t numMagicExpressions) { return numMagicExpressions > 0; });
+}
+
+std::optional<Instance> IncrementalInstanceFinder::addPatternMatch(size_t patternIndex,
+                                                                   const PatternMatch& match)
+{
+  const QString path = QString::fromStdWString(match.path.wstring());
+  if (numMagicExpressionsPerPattern_[patternIndex] == 0)
+  {
+    if (literalPaths_[patternIndex].isEmpty())
+      literalPaths_[patternIndex] = path;
+    return std::nullopt;
+  }
+
+  auto it = partialInstances_.find(match.magicExpressionMatches);
+  if (it == partialInstances_.end())
+  {
+    it = partialInstances_.emplace(match.magicExpressionMatches, PartialInstance()).first;
+    it->second.paths.resize(numMagicExpressionsPerPattern_.size());
+  }
+  PartialInstance& partialInstance = it->second;
+  if (!partialInstance.paths[patternIndex].isEmpty())
+    return std::nullopt;
+  partialInstance.paths[patternIndex] = path;
+  if (++partialInstance.numPathsFound < numPatternsWithMagicExpressions_)
+    return std::nullopt;
+
+  Instance instance{std::move(partialInstance.paths), {}};
+  for (size_t i = 0; i < instance.paths.size(); ++i)
+  {
+    if (numMagicExpressionsPerPattern_[i] == 0)
+      instance.paths[i] = literalPaths_[i];
+  }
+  std::transform(match.magicExpressionMatches.begin(), match.magicExpressionMatches.end(),
+                 std::back_inserter(instance.magicExpressionMatches), &QString::fromStdWString);
+  partialInstances_.erase(it);
+  return instance;
 }
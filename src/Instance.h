@@ -17,11 +17,16 @@
 
 #pragma once
 
+#include <QCollator>
+#include <QString>
+
+#include <map>
 #include <memory>
+#include <optional>
+#include <string>
 #include <vector>
 
-class QString;
-
+struct PatternMatch;
 struct PatternMatchingResult;
 
 struct Instance
@@ -37,3 +42,46 @@ std::vector<Instance>
 findInstances(const std::vector<std::shared_ptr<PatternMatchingResult>>& patternMatchingResults);
 
 void sortInstances(std::vector<Instance>& instances);
+
+/// Orders the magic expression matches of instances as `sortInstances()` orders the instances:
+/// numbers are compared numerically and letters case-insensitively.
+///
+/// An object of this class may not be used concurrently from several threads.
+class InstanceKeyLessThan
+{
+public:
+  InstanceKeyLessThan();
+
+  bool operator()(const std::vector<QString>& a, const std::vector<QString>& b) const;
+
+private:
+  QCollator collator_;
+};
+
+/// Assembles instances from pattern matches arriving one at a time while the patterns are being
+/// matched, and reports each instance as soon as all of its files are known: when a file has been
+/// found for each pattern containing magic expressions. Instances lacking some of these files are
+/// only known once matching is complete, and are then found by `findInstances()`.
+class IncrementalInstanceFinder
+{
+public:
+  /// \param numMagicExpressionsPerPattern number of magic expressions in each pattern
+  explicit IncrementalInstanceFinder(std::vector<size_t> numMagicExpressionsPerPattern);
+
+  /// Records that `match` matches the pattern with index `patternIndex`. Returns the instance it
+  /// completes, if any.
+  std::optional<Instance> addPatternMatch(size_t patternIndex, const PatternMatch& match);
+
+private:
+  struct PartialInstance
+  {
+    std::vector<QString> paths;
+    size_t numPathsFound = 0;
+  };
+
+  std::vector<size_t> numMagicExpressionsPerPattern_;
+  size_t numPatternsWithMagicExpressions_ = 0;
+  /// Files matching the patterns without magic expressions, shared by all instances.
+  std::vector<QString> literalPaths_;
+  std::map<std::vector<std::wstring>, PartialInstance> partialInstances_;
+};
@@ -0,0 +1,418 @@
+// This file is part of Caméléon.
+//
+// Copyright (C) 2024 Wojciech Śmigaj
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "InstanceKeyIndex.h"
+
+#include <algorithm>
+#include <optional>
+
+namespace
+{
+/// Maximum number of typos (characters inserted, deleted or replaced) in a query resembling a
+/// key without being contained in it.
+const size_t MAX_TYPOS = 2;
+/// Postings at most this many times longer than a list of candidates are scanned rather than
+/// searched for each candidate.
+const size_t MAX_SCANNED_POSTINGS_PER_CANDIDATE = 8;
+
+/// Character taken to precede each key, so that the trigrams containing it identify the keys
+/// starting with one or two given characters. Keys containing it would only become candidates
+/// for more searches, as all candidates are checked.
+const char16_t KEY_START = u'\0';
+/// Character taken to precede each word other than the first in a key, twice, so that the
+/// trigrams containing it identify the keys with a word starting with a given character.
+const char16_t WORD_START = u'\1';
+
+/// Ranks of the keys containing the query; the keys merely resembling it rank below.
+enum SubstringRank
+{
+  EQUAL,
+  PREFIX,
+  WORD_PREFIX,
+  SUBSTRING,
+  NUM_SUBSTRING_RANKS
+};
+
+struct Match
+{
+  size_t rank;
+  size_t index;
+
+  bool operator<(const Match& other) const
+  {
+    return rank < other.rank || (rank == other.rank && index < other.index);
+  }
+};
+
+uint64_t trigram(char16_t a, char16_t b, char16_t c)
+{
+  return uint64_t(a) << 32 | uint64_t(b) << 16 | uint64_t(c);
+}
+
+/// Stores the distinct trigrams of `s` in `trigrams`, in increasing order. If `anchored` is
+/// true, `s` is taken to be preceded by two `KEY_START` characters and each of its words after
+/// the first by two `WORD_START` characters.
+void findTrigrams(QStringView s, bool anchored, std::vector<uint64_t>& trigrams)
+{
+  trigrams.clear();
+  if (anchored && s.size() >= 1)
+    trigrams.push_back(trigram(KEY_START, KEY_START, s[0].unicode()));
+  if (anchored && s.size() >= 2)
+    trigrams.push_back(trigram(KEY_START, s[0].unicode(), s[1].unicode()));
+  if (anchored)
+    for (qsizetype i = 1; i < s.size(); ++i)
+      if (!s[i - 1].isLetterOrNumber())
+        trigrams.push_back(trigram(WORD_START, WORD_START, s[i].unicode()));
+  for (qsizetype i = 0; i + 2 < s.size(); ++i)
+    trigrams.push_back(trigram(s[i].unicode(), s[i + 1].unicode(), s[i + 2].unicode()));
+  std::sort(trigrams.begin(), trigrams.end());
+  trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+}
+
+/// Returns the rank of `key` if it contains `query`.
+std::optional<SubstringRank> substringRank(QStringView key, QStringView query)
+{
+  if (key.startsWith(query))
+    return key.size() == query.size() ? EQUAL : PREFIX;
+
+  std::optional<SubstringRank> rank;
+  for (qsizetype position = key.indexOf(query, 1); position >= 0;
+       position = key.indexOf(query, position + 1))
+  {
+    if (!key[position - 1].isLetterOrNumber())
+      return WORD_PREFIX;
+    rank = SUBSTRING;
+  }
+  return rank;
+}
+
+/// Indices of the instances whose keys contain a trigram, in increasing order.
+using Postings = std::pair<const uint32_t*, const uint32_t*>;
+
+/// Advances `it` to the first element of the sorted range [`it`, `end`) not less than `value`
+/// and returns true if it is equal to `value`. Takes time logarithmic in the distance travelled,
+/// so that a short sorted list can be looked up in a long one quickly.
+bool seek(const uint32_t*& it, const uint32_t* end, uint32_t value)
+{
+  if (it != end && *it < value)
+  {
+    // Gallop until an element not less than `value` is passed, then search the last step.
+    const uint32_t* low = it;
+    ptrdiff_t step = 1;
+    while (step < end - low && low[step] < value)
+    {
+      low += step;
+      step *= 2;
+    }
+    it = std::lower_bound(low + 1, step < end - low ? low + step + 1 : end, value);
+  }
+  return it != end && *it == value;
+}
+
+/// Calls `visit` with each index present in all of `postings`, in increasing order, until it
+/// returns false.
+template <typename Visit>
+void intersect(std::vector<Postings> postings, Visit visit)
+{
+  // Look up the indices of the shortest postings in the others.
+  std::sort(postings.begin(), postings.end(), [](const Postings& a, const Postings& b)
+            { return a.second - a.first < b.second - b.first; });
+  std::vector<const uint32_t*> cursors;
+  for (const Postings& p : postings)
+    cursors.push_back(p.first);
+  for (const uint32_t* it = postings[0].first; it != postings[0].second; ++it)
+  {
+    bool inAllPostings = true;
+    for (size_t t = 1; t < postings.size() && inAllPostings; ++t)
+      inAllPostings = seek(cursors[t], postings[t].second, *it);
+    if (inAllPostings && !visit(*it))
+      return;
+  }
+}
+} // namespace
+
+InstanceKeyIndex::InstanceKeyIndex(const std::vector<QString>& distinctMatches,
+                                   const std::vector<uint32_t>& matchIndices,
+                                   size_t numInstances, size_t numMagicExpressions,
+                                   const QString& separator)
+{
+  // Each distinct match is case-folded only once, however many keys contain it.
+  std::vector<QString> foldedMatches;
+  foldedMatches.reserve(distinctMatches.size());
+  for (const QString& match : distinctMatches)
+    foldedMatches.push_back(match.toCaseFolded());
+  const QString foldedSeparator = separator.toCaseFolded();
+
+  for (const QString& s : foldedMatches)
+    for (QChar c : s)
+      if (!c.isLetterOrNumber())
+        wordSeparators_.push_back(c.unicode());
+  if (numMagicExpressions > 1)
+    for (QChar c : foldedSeparator)
+      if (!c.isLetterOrNumber())
+        wordSeparators_.push_back(c.unicode());
+  std::sort(wordSeparators_.begin(), wordSeparators_.end());
+  wordSeparators_.erase(std::unique(wordSeparators_.begin(), wordSeparators_.end()),
+                        wordSeparators_.end());
+
+  keyOffsets_.reserve(numInstances + 1);
+  for (size_t i = 0; i < numInstances; ++i)
+  {
+    for (size_t j = 0; j < numMagicExpressions; ++j)
+    {
+      if (j > 0)
+        keys_ += foldedSeparator;
+      keys_ += foldedMatches[matchIndices[i * numMagicExpressions + j]];
+    }
+    keyOffsets_.push_back(keys_.size());
+  }
+
+  // Count the keys containing each trigram first, so that the postings of all trigrams can be
+  // stored in a single vector.
+  std::vector<uint64_t> trigrams;
+  std::vector<uint32_t> numPostings;
+  for (size_t i = 0; i < numInstances; ++i)
+  {
+    findTrigrams(key(i), true /*anchored*/, trigrams);
+    for (uint64_t trigram : trigrams)
+    {
+      const auto [it, inserted] = trigramIndices_.emplace(trigram, uint32_t(numPostings.size()));
+      if (inserted)
+        numPostings.push_back(0);
+      ++numPostings[it->second];
+    }
+  }
+
+  postingOffsets_.reserve(numPostings.size() + 1);
+  for (uint32_t n : numPostings)
+    postingOffsets_.push_back(postingOffsets_.back() + n);
+  postings_.resize(postingOffsets_.back());
+
+  std::vector<uint32_t> nextPostings(postingOffsets_.begin(), postingOffsets_.end() - 1);
+  for (size_t i = 0; i < numInstances; ++i)
+  {
+    findTrigrams(key(i), true /*anchored*/, trigrams);
+    for (uint64_t trigram : trigrams)
+      postings_[nextPostings[trigramIndices_.at(trigram)]++] = uint32_t(i);
+  }
+}
+
+std::vector<size_t> InstanceKeyIndex::search(const QString& query, size_t maxResults) const
+{
+  const QString foldedQuery = query.toCaseFolded();
+  if (foldedQuery.isEmpty() || maxResults == 0)
+    return {};
+
+  const char16_t first = foldedQuery[0].unicode();
+  const char16_t second = foldedQuery.size() >= 2 ? foldedQuery[1].unicode() : u'\0';
+
+  // Keys containing the query contain all its trigrams, so if one of them is missing, no key
+  // contains the query.
+  std::vector<uint64_t> queryTrigrams;
+  findTrigrams(foldedQuery, false /*anchored*/, queryTrigrams);
+  std::vector<Postings> queryPostings;
+  for (uint64_t trigram : queryTrigrams)
+  {
+    const Postings p = postings(trigram);
+    if (p.first != p.second)
+      queryPostings.push_back(p);
+  }
+  const bool allTrigramsFound = queryPostings.size() == queryTrigrams.size();
+  std::sort(queryPostings.begin(), queryPostings.end(), [](const Postings& a, const Postings& b)
+            { return a.second - a.first < b.second - b.first; });
+
+  // Keys are looked for from the best ranks to the worst, each time in the order of the
+  // instances, so that each search can stop as soon as it has found enough of them.
+  std::vector<Match> matches;
+
+  // Keys starting with the query also contain its first one or two characters preceded by
+  // KEY_START.
+  if (allTrigramsFound)
+  {
+    std::vector<Postings> candidates = queryPostings;
+    candidates.push_back(postings(foldedQuery.size() == 1 ? trigram(KEY_START, KEY_START, first)
+                                                          : trigram(KEY_START, first, second)));
+    bool equalKeyFound = false;
+    intersect(candidates,
+              [&](uint32_t index)
+              {
+                // Once enough keys are found, only the key equal to the query could still rank
+                // higher.
+                if (matches.size() >= maxResults)
+                {
+                  if (equalKeyFound)
+                    return false;
+                  if (keyOffsets_[index + 1] - keyOffsets_[index] != uint32_t(foldedQuery.size()))
+                    return true;
+                }
+                const QStringView key = this->key(index);
+                if (key.startsWith(foldedQuery))
+                {
+                  equalKeyFound = equalKeyFound || key.size() == foldedQuery.size();
+                  matches.push_back({key.size() == foldedQuery.size() ? EQUAL : PREFIX, index});
+                }
+                return true;
+              });
+  }
+
+  // Keys containing the query at the start of another word also contain its first character
+  // preceded by WORD_START, and one of the word separators followed by its first two characters.
+  if (allTrigramsFound && matches.size() < maxResults)
+  {
+    const size_t numNeeded = maxResults - matches.size();
+    std::vector<uint32_t> wordPrefixMatches;
+    const auto addIfWordPrefix = [&](const std::vector<Postings>& candidates)
+    {
+      size_t numFound = 0;
+      intersect(candidates,
+                [&](uint32_t index)
+                {
+                  if (substringRank(key(index), foldedQuery) == WORD_PREFIX)
+                  {
+                    wordPrefixMatches.push_back(index);
+                    ++numFound;
+                  }
+                  return numFound < numNeeded;
+                });
+    };
+    if (foldedQuery.size() == 1)
+    {
+      addIfWordPrefix({postings(trigram(WORD_START, WORD_START, first))});
+    }
+    else
+    {
+      // The keys found from each separator are in order, but those found from different
+      // separators need merging.
+      for (char16_t separator : wordSeparators_)
+      {
+        std::vector<Postings> candidates = queryPostings;
+        candidates.push_back(postings(trigram(separator, first, second)));
+        addIfWordPrefix(candidates);
+      }
+    }
+    std::sort(wordPrefixMatches.begin(), wordPrefixMatches.end());
+    wordPrefixMatches.erase(std::unique(wordPrefixMatches.begin(), wordPrefixMatches.end()),
+                            wordPrefixMatches.end());
+    wordPrefixMatches.resize(std::min(wordPrefixMatches.size(), numNeeded));
+    for (uint32_t index : wordPrefixMatches)
+      matches.push_back({WORD_PREFIX, index});
+  }
+
+  // Queries too short to have trigrams are not looked for inside words.
+  if (allTrigramsFound && !queryTrigrams.empty() && matches.size() < maxResults)
+  {
+    const size_t numNeeded = maxResults - matches.size();
+    size_t numFound = 0;
+    intersect(queryPostings,
+              [&](uint32_t index)
+              {
+                // The trigrams of the key may not appear in the same order as in the query.
+                if (substringRank(key(index), foldedQuery) == SUBSTRING)
+                {
+                  matches.push_back({SUBSTRING, index});
+                  ++numFound;
+                }
+                return numFound < numNeeded;
+              });
+  }
+
+  std::sort(matches.begin(), matches.end());
+  matches.resize(std::min(matches.size(), maxResults));
+
+  // Trigrams found in most keys hardly tell them apart, so they are left out, which also saves
+  // looking up their long postings. Each typo changes up to three of the others.
+  const size_t numCommonTrigrams = std::count_if(
+    queryPostings.begin(), queryPostings.end(),
+    [this](const Postings& p) { return size_t(p.second - p.first) > size() / 2; });
+  const size_t numTrigrams = queryTrigrams.size() - numCommonTrigrams;
+  const size_t numFoundTrigrams = queryPostings.size() - numCommonTrigrams;
+  const size_t minSharedTrigrams =
+    std::max((numTrigrams + 1) / 2, numTrigrams > 3 * MAX_TYPOS ? numTrigrams - 3 * MAX_TYPOS : 0);
+  // If there are fewer matches than needed, the searches above found all keys containing the
+  // query.
+  if (matches.size() < maxResults && minSharedTrigrams > 0 && numFoundTrigrams >= minSharedTrigrams)
+  {
+    // A key sharing `minSharedTrigrams` trigrams with the query must contain one of the
+    // trigrams with the shortest postings, so the other postings need only be looked up.
+    const size_t numCandidatePostings = numFoundTrigrams - minSharedTrigrams + 1;
+    std::vector<uint16_t> numSharedTrigrams(size(), 0);
+    std::vector<uint32_t> candidates;
+    for (size_t t = 0; t < numCandidatePostings; ++t)
+      for (const uint32_t* it = queryPostings[t].first; it != queryPostings[t].second; ++it)
+        if (numSharedTrigrams[*it]++ == 0)
+          candidates.push_back(*it);
+    bool candidatesAreSorted = false;
+    for (size_t t = numCandidatePostings; t < numFoundTrigrams; ++t)
+    {
+      const Postings& p = queryPostings[t];
+      if (size_t(p.second - p.first) <= MAX_SCANNED_POSTINGS_PER_CANDIDATE * candidates.size())
+      {
+        for (const uint32_t* it = p.first; it != p.second; ++it)
+          if (numSharedTrigrams[*it] > 0)
+            ++numSharedTrigrams[*it];
+      }
+      else
+      {
+        if (!candidatesAreSorted)
+        {
+          std::sort(candidates.begin(), candidates.end());
+          candidatesAreSorted = true;
+        }
+        const uint32_t* it = p.first;
+        for (uint32_t candidate : candidates)
+          if (seek(it, p.second, candidate))
+            ++numSharedTrigrams[candidate];
+      }
+    }
+
+    std::vector<size_t> substringMatches;
+    for (const Match& match : matches)
+      substringMatches.push_back(match.index);
+    std::sort(substringMatches.begin(), substringMatches.end());
+
+    std::vector<Match> fuzzyMatches;
+    for (uint32_t candidate : candidates)
+      if (numSharedTrigrams[candidate] >= minSharedTrigrams &&
+          !std::binary_search(substringMatches.begin(), substringMatches.end(), candidate))
+        fuzzyMatches.push_back(
+          {NUM_SUBSTRING_RANKS + numTrigrams - numSharedTrigrams[candidate], candidate});
+    const size_t numFuzzyMatches = std::min(fuzzyMatches.size(), maxResults - matches.size());
+    std::partial_sort(fuzzyMatches.begin(), fuzzyMatches.begin() + numFuzzyMatches,
+                      fuzzyMatches.end());
+    matches.insert(matches.end(), fuzzyMatches.begin(), fuzzyMatches.begin() + numFuzzyMatches);
+  }
+
+  std::vector<size_t> result;
+  result.reserve(matches.size());
+  for (const Match& match : matches)
+    result.push_back(match.index);
+  return result;
+}
+
+QStringView InstanceKeyIndex::key(size_t index) const
+{
+  return QStringView(keys_).mid(keyOffsets_[index], keyOffsets_[index + 1] - keyOffsets_[index]);
+}
+
+Postings InstanceKeyIndex::postings(uint64_t trigram) const
+{
+  const auto it = trigramIndices_.find(trigram);
+  if (it == trigramIndices_.end())
+    return {nullptr, nullptr};
+  return {postings_.data() + postingOffsets_[it->second],
+          postings_.data() + postingOffsets_[it->second + 1]};
+}
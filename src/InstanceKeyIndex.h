@@ -0,0 +1,88 @@
+// This file is part of Caméléon.
+//
+// Copyright (C) 2024 Wojciech Śmigaj
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <QString>
+#include <QStringView>
+
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/// An index of the keys of the instances of an album, finding the instances whose keys contain
+/// a string, or resemble it, without visiting all the keys.
+///
+/// Each key is broken into trigrams (sequences of three consecutive characters), and for each
+/// trigram the index stores the instances whose keys contain it. Only the instances whose keys
+/// contain all trigrams of a string can contain the string itself, and only those whose keys
+/// share many of its trigrams resemble it. Searches ignore case.
+///
+/// The index does not refer to the instances, so it can be built on a worker thread.
+class InstanceKeyIndex
+{
+public:
+  InstanceKeyIndex() = default;
+
+  /// Indexes the keys of `numInstances` instances, made of the magic expression matches with
+  /// indices `matchIndices[i * numMagicExpressions]`, ..., `matchIndices[(i + 1) *
+  /// numMagicExpressions - 1]` in `distinctMatches` joined with `separator`.
+  InstanceKeyIndex(const std::vector<QString>& distinctMatches,
+                   const std::vector<uint32_t>& matchIndices, size_t numInstances,
+                   size_t numMagicExpressions, const QString& separator);
+
+  size_t size() const { return keyOffsets_.size() - 1; }
+
+  /// Returns the indices of up to `maxResults` instances whose keys best match `query`, best
+  /// first.
+  ///
+  /// Keys containing `query` come first: the key equal to it, then keys starting with it, then
+  /// keys containing it at the start of another word, then the others. If there are fewer than
+  /// `maxResults` of them, they are followed by keys sharing most trigrams of `query`, as if it
+  /// contained a couple of typos, the more of them the better; trigrams found in more than half
+  /// of the keys are not taken into account. Keys matching equally well are
+  /// returned in the order of the instances.
+  ///
+  /// Queries shorter than a trigram are only looked for at the start of keys and words. Words
+  /// are separated by characters other than letters and digits.
+  std::vector<size_t> search(const QString& query, size_t maxResults) const;
+
+private:
+  /// Returns the case-folded key of the instance with index `index`.
+  QStringView key(size_t index) const;
+
+  /// Returns the range of `postings_` holding the indices of the instances whose keys contain
+  /// `trigram`.
+  std::pair<const uint32_t*, const uint32_t*> postings(uint64_t trigram) const;
+
+  /// Case-folded keys of all instances, one after another.
+  QString keys_;
+  /// For each instance, the offset of its key in `keys_`, followed by the length of `keys_`.
+  std::vector<uint32_t> keyOffsets_{0};
+  /// Characters other than letters and digits found in the keys, after which words start.
+  std::vector<char16_t> wordSeparators_;
+  /// Maps each trigram found in the keys, including those made of their first one or two
+  /// characters preceded by a character standing for the start of the key, to its index.
+  std::unordered_map<uint64_t, uint32_t> trigramIndices_;
+  /// For each trigram, the offset of its postings in `postings_`, followed by the length of
+  /// `postings_`.
+  std::vector<uint32_t> postingOffsets_{0};
+  /// Indices of the instances whose keys contain each trigram, in increasing order, one trigram
+  /// after another.
+  std::vector<uint32_t> postings_;
+};
@@ -0,0 +1,98 @@
+// This file is part of Caméléon.
+//
+// Copyright (C) 2024 Wojciech Śmigaj
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "InstanceListModel.h"
+#include "Document.h"
+
+#include <QBrush>
+
+void InstanceListModel::setDocument(const Document* doc)
+{
+  beginResetModel();
+  doc_ = doc;
+  numRows_ = doc_ ? static_cast<int>(doc_->instances().size()) : 0;
+  endResetModel();
+}
+
+void InstanceListModel::instancesInserted(const std::vector<size_t>& indices)
+{
+  // Report each run of consecutive indices as one insertion. Views see the rows inserted so far
+  // and none of the following ones, so the runs must be reported in increasing order.
+  for (size_t begin = 0; begin < indices.size();)
+  {
+    size_t end = begin + 1;
+    while (end < indices.size() && indices[end] == indices[end - 1] + 1)
+      ++end;
+    beginInsertRows(QModelIndex(), static_cast<int>(indices[begin]),
+                    static_cast<int>(indices[end - 1]));
+    numRows_ += static_cast<int>(end - begin);
+    endInsertRows();
+    begin = end;
+  }
+}
+
+void InstanceListModel::instancesErased(const std::vector<size_t>& indices)
+{
+  // Report each run of consecutive indices as one removal, starting from the last run so that
+  // the indices of the others stay valid.
+  for (size_t end = indices.size(); end > 0;)
+  {
+    size_t begin = end - 1;
+    while (begin > 0 && indices[begin - 1] + 1 == indices[begin])
+      --begin;
+    beginRemoveRows(QModelIndex(), static_cast<int>(indices[begin]),
+                    static_cast<int>(indices[end - 1]));
+    numRows_ -= static_cast<int>(end - begin);
+    endRemoveRows();
+    end = begin;
+  }
+}
+
+void InstanceListModel::bookmarksChanged()
+{
+  // Views repaint only the rows they show, so notifying them of a change to all rows is cheap.
+  const int numRows = rowCount();
+  if (numRows > 0)
+    emit dataChanged(index(0), index(numRows - 1), {Qt::ForegroundRole});
+}
+
+int InstanceListModel::rowCount(const QModelIndex& parent) const
+{
+  if (parent.isValid())
+    return 0;
+  return numRows_;
+}
+
+QVariant InstanceListModel::data(const QModelIndex& index, int role) const
+{
+  if (!index.isValid() || index.row() >= rowCount())
+    return QVariant();
+
+  const size_t instance = index.row();
+  switch (role)
+  {
+  case Qt::DisplayRole:
+  case Qt::EditRole:
+    return doc_->instanceKey(instance);
+  case Qt::ForegroundRole:
+    if (doc_->bookmarks().contains(instance))
+      return QBrush(BOOKMARK_COLOUR);
+    return QVariant();
+  default:
+    return QVariant();
+  }
+}
@@ -0,0 +1,65 @@
+// This file is part of Caméléon.
+//
+// Copyright (C) 2024 Wojciech Śmigaj
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <QAbstractListModel>
+
+#include <vector>
+
+class Document;
+
+/// A list model with one row per instance of a document, showing the instance key and
+/// highlighting bookmarked instances.
+///
+/// The rows are not stored: their data are computed on request from the document, so views
+/// showing only some rows (such as the popup list of a combo box with uniform item sizes) never
+/// touch the others. Resetting the model after the instances change therefore takes constant
+/// time, however many instances there are.
+class InstanceListModel : public QAbstractListModel
+{
+  Q_OBJECT
+
+public:
+  using QAbstractListModel::QAbstractListModel;
+
+  /// Makes the model show the instances of `doc`, which may be null. Must be called again
+  /// whenever the instances of the document change, and before the document is destroyed.
+  void setDocument(const Document* doc);
+
+  /// May be called instead of `setDocument()` after instances have been inserted into the
+  /// document, with their (increasing) indices, so that views keep their state.
+  void instancesInserted(const std::vector<size_t>& indices);
+
+  /// May be called instead of `setDocument()` after instances have been erased from the
+  /// document, with the (increasing) indices they had, before any call to `instancesInserted()`
+  /// for instances inserted afterwards.
+  void instancesErased(const std::vector<size_t>& indices);
+
+  /// Must be called after the bookmarks of the document change.
+  void bookmarksChanged();
+
+  int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+  QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+
+private:
+  static const auto BOOKMARK_COLOUR = Qt::blue;
+
+  const Document* doc_ = nullptr;
+  /// Number of instances of the document the views have been told about.
+  int numRows_ = 0;
+};
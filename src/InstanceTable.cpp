@@ -0,0 +1,338 @@
+// This file is part of Caméléon.
+//
+// Copyright (C) 2024 Wojciech Śmigaj
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "InstanceTable.h"
+#include "RuntimeError.h"
+
+#include <algorithm>
+
+namespace
+{
+uint32_t internString(const QString& s, std::vector<QString>& values,
+                      QHash<QString, uint32_t>& indices)
+{
+  auto it = indices.constFind(s);
+  if (it != indices.constEnd())
+    return *it;
+  if (values.size() >= UINT32_MAX)
+    throw RuntimeError("Too many distinct strings to store.");
+  const uint32_t index = values.size();
+  values.push_back(s);
+  indices.insert(s, index);
+  return index;
+}
+
+uint32_t checkedOffset(qsizetype offset)
+{
+  if (offset >= qsizetype(UINT32_MAX))
+    throw RuntimeError("The paths of the album's pages are too long to store.");
+  return offset;
+}
+} // namespace
+
+InstanceTable::InstanceTable(const std::vector<Instance>& instances)
+{
+  for (const Instance& instance : instances)
+    push_back(instance);
+}
+
+Instance InstanceTable::operator[](size_t index) const
+{
+  Instance instance;
+  instance.paths.reserve(pathColumns_.size());
+  for (size_t i = 0; i < pathColumns_.size(); ++i)
+    instance.paths.push_back(path(index, i));
+  instance.magicExpressionMatches = magicExpressionMatches(index);
+  return instance;
+}
+
+QString InstanceTable::path(size_t index, size_t patternIndex) const
+{
+  const PathColumn& column = pathColumns_[patternIndex];
+  const uint32_t record = rows_[index];
+  const uint32_t directoryIndex = column.recordDirectories[record];
+  if (directoryIndex == NO_FILE)
+    return QString();
+
+  const uint32_t begin = column.fileNameOffsets[record];
+  const uint32_t end = column.fileNameOffsets[record + 1];
+  QString result = column.directories[directoryIndex];
+  result.append(QStringView(column.fileNames).mid(begin, end - begin));
+  return result;
+}
+
+std::vector<QString> InstanceTable::magicExpressionMatches(size_t index) const
+{
+  std::vector<QString> result;
+  result.reserve(numMagicExpressions_);
+  const uint32_t* begin = recordMagicExpressionMatches(rows_[index]);
+  for (const uint32_t* it = begin; it != begin + numMagicExpressions_; ++it)
+    result.push_back(magicExpressionMatchValues_[*it]);
+  return result;
+}
+
+std::vector<uint32_t> InstanceTable::magicExpressionMatchIndices() const
+{
+  std::vector<uint32_t> result;
+  result.reserve(rows_.size() * numMagicExpressions_);
+  for (uint32_t record : rows_)
+  {
+    const uint32_t* begin = recordMagicExpressionMatches(record);
+    result.insert(result.end(), begin, begin + numMagicExpressions_);
+  }
+  return result;
+}
+
+std::vector<size_t> InstanceTable::instancesInDirectory(size_t patternIndex,
+                                                       size_t directoryIndex) const
+{
+  std::vector<size_t> result;
+  for (uint32_t record : pathColumns_[patternIndex].directoryRecords[directoryIndex])
+    if (recordRows_[record] != NO_ROW)
+      result.push_back(recordRows_[record]);
+  std::sort(result.begin(), result.end());
+  return result;
+}
+
+std::optional<size_t>
+InstanceTable::find(const std::vector<QString>& magicExpressionMatches) const
+{
+  if (rows_.empty() || magicExpressionMatches.size() != numMagicExpressions_)
+    return std::nullopt;
+
+  std::vector<uint32_t> matchIndices;
+  matchIndices.reserve(numMagicExpressions_);
+  for (const QString& match : magicExpressionMatches)
+  {
+    auto it = magicExpressionMatchIndices_.constFind(match);
+    if (it == magicExpressionMatchIndices_.constEnd())
+      return std::nullopt;
+    matchIndices.push_back(*it);
+  }
+
+  const auto [begin, end] = records_.equal_range(hashMagicExpressionMatches(matchIndices.data()));
+  for (auto it = begin; it != end; ++it)
+  {
+    if (std::equal(matchIndices.begin(), matchIndices.end(),
+                   recordMagicExpressionMatches(it->second)))
+      return recordRows_[it->second];
+  }
+  return std::nullopt;
+}
+
+void InstanceTable::push_back(const Instance& instance)
+{
+  const uint32_t record = appendRecord(instance);
+  rows_.push_back(record);
+  recordRows_[record] = static_cast<uint32_t>(rows_.size() - 1);
+}
+
+uint32_t InstanceTable::appendRecord(const Instance& instance)
+{
+  if (recordRows_.empty())
+  {
+    pathColumns_.resize(instance.paths.size());
+    numMagicExpressions_ = instance.magicExpressionMatches.size();
+  }
+  if (recordRows_.size() >= UINT32_MAX - 1)
+    throw RuntimeError("Too many pages to store.");
+  Q_ASSERT(instance.paths.size() == pathColumns_.size());
+  Q_ASSERT(instance.magicExpressionMatches.size() == numMagicExpressions_);
+
+  const uint32_t record = static_cast<uint32_t>(recordRows_.size());
+  for (size_t i = 0; i < pathColumns_.size(); ++i)
+  {
+    PathColumn& column = pathColumns_[i];
+    const QString& path = instance.paths[i];
+    if (path.isEmpty())
+    {
+      column.recordDirectories.push_back(NO_FILE);
+    }
+    else
+    {
+      // Paths use the native separator, which may be either of these on Windows.
+      const qsizetype fileNameStart = std::max(path.lastIndexOf('/'), path.lastIndexOf('\\')) + 1;
+      const uint32_t directoryIndex =
+        internString(path.left(fileNameStart), column.directories, column.directoryIndices);
+      column.recordDirectories.push_back(directoryIndex);
+      column.directoryRecords.resize(column.directories.size());
+      column.directoryRecords[directoryIndex].push_back(record);
+      column.fileNames.append(QStringView(path).mid(fileNameStart));
+    }
+    column.fileNameOffsets.push_back(checkedOffset(column.fileNames.size()));
+  }
+
+  for (const QString& match : instance.magicExpressionMatches)
+    recordMagicExpressionMatches_.push_back(
+      internString(match, magicExpressionMatchValues_, magicExpressionMatchIndices_));
+  records_.emplace(hashMagicExpressionMatches(recordMagicExpressionMatches(record)), record);
+  recordRows_.push_back(NO_ROW);
+  return record;
+}
+
+std::vector<size_t> InstanceTable::insert(std::vector<Instance> newInstances)
+{
+  if (newInstances.empty())
+    return {};
+  sortInstances(newInstances);
+
+  // Find the index of the first old instance following each new instance, searching only
+  // after the one found for the previous new instance since both lists are sorted.
+  const InstanceKeyLessThan lessThan;
+  const size_t numOldInstances = rows_.size();
+  std::vector<size_t> indices;
+  indices.reserve(newInstances.size());
+  size_t first = 0;
+  for (const Instance& instance : newInstances)
+  {
+    size_t last = numOldInstances;
+    while (first < last)
+    {
+      const size_t middle = first + (last - first) / 2;
+      if (lessThan(instance.magicExpressionMatches, magicExpressionMatches(middle)))
+        last = middle;
+      else
+        first = middle + 1;
+    }
+    indices.push_back(first);
+  }
+
+  std::vector<uint32_t> newRecords;
+  newRecords.reserve(newInstances.size());
+  for (const Instance& instance : newInstances)
+    newRecords.push_back(appendRecord(instance));
+
+  // Merge the new records into the rows from the back, so that each old row moves only once.
+  rows_.resize(numOldInstances + newInstances.size());
+  size_t oldIndex = numOldInstances;
+  size_t index = rows_.size();
+  for (size_t i = newInstances.size(); i-- > 0;)
+  {
+    while (oldIndex > indices[i])
+      rows_[--index] = rows_[--oldIndex];
+    rows_[--index] = newRecords[i];
+  }
+
+  // Turn the insertion points into the indices of the new instances.
+  for (size_t i = 0; i < indices.size(); ++i)
+    indices[i] += i;
+  updateRecordRows(indices.front());
+  return indices;
+}
+
+void InstanceTable::erase(const std::vector<size_t>& indices)
+{
+  if (indices.empty())
+    return;
+
+  for (size_t index : indices)
+  {
+    const uint32_t record = rows_[index];
+    const auto [begin, end] =
+      records_.equal_range(hashMagicExpressionMatches(recordMagicExpressionMatches(record)));
+    for (auto it = begin; it != end; ++it)
+    {
+      if (it->second == record)
+      {
+        records_.erase(it);
+        break;
+      }
+    }
+    recordRows_[record] = NO_ROW;
+    rows_[index] = NO_ROW;
+  }
+  rows_.erase(std::remove(rows_.begin() + indices.front(), rows_.end(), NO_ROW), rows_.end());
+  numErasedRecords_ += indices.size();
+
+  if (numErasedRecords_ > rows_.size())
+  {
+    // Most records are garbage; copy the remaining instances into fresh records.
+    InstanceTable compacted;
+    for (size_t i = 0; i < rows_.size(); ++i)
+      compacted.push_back((*this)[i]);
+    *this = std::move(compacted);
+    return;
+  }
+  updateRecordRows(indices.front());
+}
+
+void InstanceTable::updateRecordRows(size_t first)
+{
+  for (size_t i = first; i < rows_.size(); ++i)
+    recordRows_[rows_[i]] = static_cast<uint32_t>(i);
+}
+
+size_t InstanceTable::hashMagicExpressionMatches(const uint32_t* begin) const
+{
+  size_t hash = 0;
+  for (const uint32_t* it = begin; it != begin + numMagicExpressions_; ++it)
+    hash ^= std::hash<uint32_t>()(*it) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+  return hash;
+}
+
+bool operator==(const InstanceTable& a, const InstanceTable& b)
+{
+  if (a.size() != b.size())
+    return false;
+  if (a.empty())
+    return true;
+  if (a.pathColumns_.size() != b.pathColumns_.size() ||
+      a.numMagicExpressions_ != b.numMagicExpressions_)
+    return false;
+
+  // Compare the stored strings in place rather than assembling the instances.
+  for (size_t i = 0; i < a.size(); ++i)
+  {
+    const uint32_t recordA = a.rows_[i];
+    const uint32_t recordB = b.rows_[i];
+    const uint32_t* matchesA = a.recordMagicExpressionMatches(recordA);
+    const uint32_t* matchesB = b.recordMagicExpressionMatches(recordB);
+    for (size_t k = 0; k < a.numMagicExpressions_; ++k)
+      if (a.magicExpressionMatchValues_[matchesA[k]] != b.magicExpressionMatchValues_[matchesB[k]])
+        return false;
+
+    for (size_t p = 0; p < a.pathColumns_.size(); ++p)
+    {
+      const InstanceTable::PathColumn& columnA = a.pathColumns_[p];
+      const InstanceTable::PathColumn& columnB = b.pathColumns_[p];
+      const uint32_t directoryA = columnA.recordDirectories[recordA];
+      const uint32_t directoryB = columnB.recordDirectories[recordB];
+      if ((directoryA == InstanceTable::NO_FILE) != (directoryB == InstanceTable::NO_FILE))
+        return false;
+      if (directoryA == InstanceTable::NO_FILE)
+        continue;
+      if (columnA.directories[directoryA] != columnB.directories[directoryB])
+        return false;
+      const QStringView fileNameA =
+        QStringView(columnA.fileNames)
+          .mid(columnA.fileNameOffsets[recordA],
+               columnA.fileNameOffsets[recordA + 1] - columnA.fileNameOffsets[recordA]);
+      const QStringView fileNameB =
+        QStringView(columnB.fileNames)
+          .mid(columnB.fileNameOffsets[recordB],
+               columnB.fileNameOffsets[recordB + 1] - columnB.fileNameOffsets[recordB]);
+      if (fileNameA != fileNameB)
+        return false;
+    }
+  }
+  return true;
+}
+
+bool operator!=(const InstanceTable& a, const InstanceTable& b)
+{
+  return !(a == b);
+}
@@ -0,0 +1,163 @@
+// This file is part of Caméléon.
+//
+// Copyright (C) 2024 Wojciech Śmigaj
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include "Instance.h"
+
+#include <QHash>
+#include <QString>
+
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+/// The instances of an album, stored pattern by pattern so as to take up little memory even
+/// when there are millions of them.
+///
+/// Each path is split into its directory, stored once per pattern however many files it
+/// contains, and its file name, stored together with the file names of the other instances in a
+/// single string. Each distinct magic expression match is likewise stored once. Instances are
+/// assembled when accessed, so code visiting many of them should use `path()` and
+/// `magicExpressionMatches()` rather than `operator[]`. Instances can also be looked up by their
+/// magic expression matches through a hash index kept up to date with the table.
+///
+/// The data of each instance (its record) stay where they were appended; the order of the
+/// instances is a separate list of record indices. Inserting or erasing a few instances thus
+/// only shifts integers, and the records of erased instances are reclaimed once they outnumber
+/// the others.
+class InstanceTable
+{
+public:
+  InstanceTable() = default;
+  explicit InstanceTable(const std::vector<Instance>& instances);
+
+  size_t size() const { return rows_.size(); }
+  bool empty() const { return rows_.empty(); }
+
+  /// Returns the instance with index `index`.
+  Instance operator[](size_t index) const;
+
+  /// Returns the path of the file of the instance with index `index` matching the pattern with
+  /// index `patternIndex`, or an empty string if there is none.
+  QString path(size_t index, size_t patternIndex) const;
+
+  /// Returns the magic expression matches of the instance with index `index`.
+  std::vector<QString> magicExpressionMatches(size_t index) const;
+
+  /// Returns the number of magic expression matches of each instance.
+  size_t numMagicExpressions() const { return numMagicExpressions_; }
+
+  /// Returns the distinct magic expression matches of the instances.
+  const std::vector<QString>& distinctMagicExpressionMatches() const
+  {
+    return magicExpressionMatchValues_;
+  }
+
+  /// Returns the indices in `distinctMagicExpressionMatches()` of the magic expression matches of
+  /// all instances, `numMagicExpressions()` per instance.
+  std::vector<uint32_t> magicExpressionMatchIndices() const;
+
+  /// Returns the directories of the files matching the pattern with index `patternIndex`, each
+  /// ending with a separator. Directories no longer holding any of these files may be included.
+  const std::vector<QString>& directories(size_t patternIndex) const
+  {
+    return pathColumns_[patternIndex].directories;
+  }
+
+  /// Returns the indices, in increasing order, of the instances whose file matching the pattern
+  /// with index `patternIndex` lies in the directory with index `directoryIndex` in
+  /// `directories(patternIndex)`.
+  std::vector<size_t> instancesInDirectory(size_t patternIndex, size_t directoryIndex) const;
+
+  /// Returns the index of the instance with the given magic expression matches, if there is one.
+  std::optional<size_t> find(const std::vector<QString>& magicExpressionMatches) const;
+
+  /// Appends `instance`, which must have as many paths and magic expression matches as the
+  /// instances already stored.
+  void push_back(const Instance& instance);
+
+  /// Inserts `newInstances` into the table, whose instances must be sorted like
+  /// `sortInstances()` sorts them, keeping it sorted, and returns the indices they get, in
+  /// increasing order.
+  ///
+  /// Each new instance is located by a binary search, but the indices of all instances following
+  /// the first new one are updated, so this is meant for batches that are small compared to the
+  /// table or, failing that, infrequent.
+  std::vector<size_t> insert(std::vector<Instance> newInstances);
+
+  /// Erases the instances with the given indices, which must be in increasing order.
+  void erase(const std::vector<size_t>& indices);
+
+  friend bool operator==(const InstanceTable& a, const InstanceTable& b);
+
+private:
+  /// Index of the directory of a missing file.
+  static constexpr uint32_t NO_FILE = UINT32_MAX;
+  /// Index of the instance of an erased record.
+  static constexpr uint32_t NO_ROW = UINT32_MAX;
+
+  struct PathColumn
+  {
+    /// Distinct directories of the files, each ending with a separator (or empty).
+    std::vector<QString> directories;
+    QHash<QString, uint32_t> directoryIndices;
+    /// For each record, the index of the directory of its file or NO_FILE.
+    std::vector<uint32_t> recordDirectories;
+    /// For each directory, the records of the files it contains, including erased ones.
+    std::vector<std::vector<uint32_t>> directoryRecords;
+    /// File names of all records, one after another.
+    QString fileNames;
+    /// For each record, the offset of its file name in `fileNames`, followed by the length of
+    /// `fileNames`.
+    std::vector<uint32_t> fileNameOffsets{0};
+  };
+
+  /// Stores the data of `instance` in a new record and returns its index.
+  uint32_t appendRecord(const Instance& instance);
+
+  /// Returns the indices of the magic expression matches of the record with index `record`.
+  const uint32_t* recordMagicExpressionMatches(uint32_t record) const
+  {
+    return recordMagicExpressionMatches_.data() + size_t(record) * numMagicExpressions_;
+  }
+
+  /// Returns the hash of the magic expression match indices of a record, starting at `begin`.
+  size_t hashMagicExpressionMatches(const uint32_t* begin) const;
+
+  /// Updates `recordRows_` for the instances with indices `first` and above.
+  void updateRecordRows(size_t first);
+
+  size_t numMagicExpressions_ = 0;
+  std::vector<PathColumn> pathColumns_;
+  /// Distinct magic expression matches.
+  std::vector<QString> magicExpressionMatchValues_;
+  QHash<QString, uint32_t> magicExpressionMatchIndices_;
+  /// For each record, the indices of its magic expression matches in
+  /// `magicExpressionMatchValues_`.
+  std::vector<uint32_t> recordMagicExpressionMatches_;
+  /// For each instance, the index of its record.
+  std::vector<uint32_t> rows_;
+  /// For each record, the index of its instance, or NO_ROW if the instance has been erased.
+  std::vector<uint32_t> recordRows_;
+  size_t numErasedRecords_ = 0;
+  /// Maps the hashes of the magic expression matches of the instances to their records.
+  std::unordered_multimap<size_t, uint32_t> records_;
+};
+
+bool operator!=(const InstanceTable& a, const InstanceTable& b);
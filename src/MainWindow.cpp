@@ -19,7 +19,11 @@
 #include "CancellationException.h"
 #include "Constants.h"
 #include "ContainerUtils.h"
+#include "DirectoryListingCache.h"
+#include "DirectoryWatcher.h"
 #include "Document.h"
+#include "InstanceKeyIndex.h"
+#include "InstanceListModel.h"
 #include "MainWindow.h"
 #include "PatternMatching.h"
 #include "PatternMatchingProgressDialog.h"
@@ -30,6 +34,7 @@
 
 #include <Qt>
 #include <QCheckBox>
+#include <QtConcurrent>
 
 namespace
 {
@@ -85,18 +90,67 @@ MainWindow::MainWindow(QWidget* parent, bool dontUseNativeDialogs,
   populateLayoutSubmenu();
   initialiseRecentDocumentsSubmenu();
 
+  instanceListModel_ = new InstanceListModel(this);
   instanceComboBox_ = new QComboBox(this);
+  instanceComboBox_->setObjectName("instanceComboBox");
   instanceComboBox_->setToolTip("Page Title");
+  // Items are created on demand by the model. Avoid size calculations that would visit them all.
+  instanceComboBox_->setSizeAdjustPolicy(QComboBox::AdjustToMinimumContentsLengthWithIcon);
+  if (QListView* view = qobject_cast<QListView*>(instanceComboBox_->view()))
+    view->setUniformItemSizes(true);
+  instanceComboBox_->setModel(instanceListModel_);
   instanceComboBox_->setSizePolicy(QSizePolicy(QSizePolicy::Expanding, QSizePolicy::Fixed));
   ui_->mainToolBar->addSeparator();
   ui_->mainToolBar->addWidget(instanceComboBox_);
   instanceComboBox_->installEventFilter(this);
 
+  instanceSearchBox_ = new QLineEdit(this);
+  instanceSearchBox_->setObjectName("instanceSearchBox");
+  instanceSearchBox_->setToolTip("Find Page");
+  instanceSearchBox_->setPlaceholderText("Find Page");
+  instanceSearchBox_->setClearButtonEnabled(true);
+  instanceSearchBox_->setEnabled(false);
+  ui_->actionFindPage->setEnabled(false);
+  ui_->mainToolBar->addWidget(instanceSearchBox_);
+  instanceSearchResults_ = new QStringListModel(this);
+  instanceSearchCompleter_ = new QCompleter(instanceSearchResults_, this);
+  // The results are filtered and ranked by the index already.
+  instanceSearchCompleter_->setCompletionMode(QCompleter::UnfilteredPopupCompletion);
+  instanceSearchCompleter_->setWidget(instanceSearchBox_);
+
   connect(instanceComboBox_, &QComboBox::currentIndexChanged, this,
           &MainWindow::onInstanceComboBox);
+  connect(instanceSearchBox_, &QLineEdit::textEdited, this,
+          &MainWindow::onInstanceSearchBoxTextEdited);
+  connect(instanceSearchBox_, &QLineEdit::returnPressed, this,
+          &MainWindow::onInstanceSearchBoxReturnPressed);
+  connect(instanceSearchCompleter_, qOverload<const QString&>(&QCompleter::activated), this,
+          &MainWindow::onInstanceSearchResultActivated);
   connect(ui_->mainView, &MainView::mouseMovedOverImage, this, &MainWindow::onMouseMovedOverImage);
   connect(ui_->mainView, &MainView::mouseLeftImage, this, &MainWindow::onMouseLeftImage);
 
+  directoryWatcher_ =
+    new DirectoryWatcher(QSettings()
+                           .value("maxWatchedDirectories",
+                                  qulonglong(DirectoryWatcher::defaultMaxNumDirectories()))
+                           .toULongLong(),
+                         WATCH_NOTIFICATION_DELAY_MS, this);
+  connect(directoryWatcher_, &DirectoryWatcher::directoriesChanged, this,
+          &MainWindow::onWatchedDirectoriesChanged);
+
+  instanceDiscoveryTimer_ = new QTimer(this);
+  instanceDiscoveryTimer_->setInterval(INSTANCE_DISCOVERY_UPDATE_INTERVAL_MS);
+  connect(instanceDiscoveryTimer_, &QTimer::timeout, this,
+          &MainWindow::onInstanceDiscoveryTimeout);
+
+  // The directory listings read while matching patterns are saved in the background every now
+  // and then, and when the window is destroyed, rather than after every match.
+  listingCacheSaveWatcher_ = new QFutureWatcher<void>(this);
+  listingCacheSaveTimer_ = new QTimer(this);
+  listingCacheSaveTimer_->setInterval(LISTING_CACHE_SAVE_INTERVAL_MS);
+  connect(listingCacheSaveTimer_, &QTimer::timeout, this, &MainWindow::onListingCacheSaveTimeout);
+  listingCacheSaveTimer_->start();
+
   QIcon::setThemeName("crystalsvg");
 
   ui_->actionNewAlbum->setIcon(QIcon::fromTheme("document-new"));
@@ -118,8 +172,17 @@ MainWindow::MainWindow(QWidget* parent, bool dontUseNativeDialogs,
   ui_->actionUnregisterFileType->setStatusTip("Remove " CAMELEON_APP_NAME
                                               "'s association with .cml files");
 #else
-  ui_->menuTools->menuAction()->setVisible(false);
+  ui_->actionRegisterFileType->setVisible(false);
+  ui_->actionUnregisterFileType->setVisible(false);
 #endif
+  ui_->actionClearDirectoryListingCache->setStatusTip(
+    "Forget the directory listings kept to speed up opening and refreshing albums");
+  ui_->actionWatchAlbum->setStatusTip(
+    "Refresh the album automatically when files are added to or removed from its directories");
+  ui_->actionOpenAlbumsProgressively->setStatusTip(
+    "Show the first pages of albums being opened while the search for matching files goes on");
+  ui_->actionOpenAlbumsProgressively->setChecked(
+    QSettings().value("openAlbumsProgressively", false).toBool());
 
   // Add a wide empty label to the status bar to force other labels to be right-aligned.
   statusBarMessageLabel_ = new QLabel(this);
@@ -152,6 +215,8 @@ MainWindow::MainWindow(QWidget* parent, bool dontUseNativeDialogs,
 
 MainWindow::~MainWindow()
 {
+  listingCacheSaveWatcher_->waitForFinished();
+  DirectoryListingCache::instance().save();
 }
 
 bool MainWindow::eventFilter(QObject* obj, QEvent* event)
@@ -253,6 +318,8 @@ void MainWindow::closeEvent(QCloseEvent* event)
 {
   if (maybeSaveDocument())
   {
+    stopWatchingAlbum();
+    instanceListModel_->setDocument(nullptr);
     doc_ = nullptr;
     event->accept();
   }
@@ -308,12 +375,10 @@ void MainWindow::on_actionNewAlbum_triggered()
   PatternMatchingProgressDialog progressDialog(this);
   progressDialog.show();
 
-  auto onFilesystemTraversalProgress = [&progressDialog]()
-  { progressDialog.incrementProgressAndCheckForCancellation(); };
-
-  if (!Try([&] { newDoc->setPatterns(dialog.values(), onFilesystemTraversalProgress); }))
+  if (!Try([&] { newDoc->setPatterns(dialog.values(), progressDialog.progress()); }))
     return;
 
+  stopWatchingAlbum();
   doc_ = std::move(newDoc);
 
   connectDocumentSignals();
@@ -344,15 +409,19 @@ void MainWindow::openDocument(const QString& path)
   QSettings settings;
   settings.setValue("lastOpenDir", QFileInfo(path).dir().path());
 
+  if (settings.value("openAlbumsProgressively", false).toBool())
+  {
+    openDocumentProgressively(path);
+    return;
+  }
+
   PatternMatchingProgressDialog progressDialog(this);
   progressDialog.show();
 
-  auto onFilesystemTraversalProgress = [&progressDialog]()
-  { progressDialog.incrementProgressAndCheckForCancellation(); };
-
-  if (!Try([&] { doc_ = std::make_unique<Document>(path, onFilesystemTraversalProgress); }))
+  if (!Try([&] { doc_ = std::make_unique<Document>(path, progressDialog.progress()); }))
     return;
 
+  stopWatchingAlbum();
   connectDocumentSignals();
   onDocumentPathChanged();
   onInstancesChanged();
@@ -360,6 +429,104 @@ void MainWindow::openDocument(const QString& path)
     goToInstance(0);
 }
 
+// Opens the album at `path` and matches its patterns in the background, showing the instances
+// found so far every INSTANCE_DISCOVERY_UPDATE_INTERVAL_MS.
+void MainWindow::openDocumentProgressively(const QString& path)
+{
+  std::unique_ptr<Document> newDoc;
+  if (!Try(
+        [&]
+        {
+          newDoc = std::make_unique<Document>(path, nullptr, true /*deferPatternMatching*/);
+          newDoc->startInstanceDiscovery();
+        }))
+    return;
+
+  stopWatchingAlbum();
+  doc_ = std::move(newDoc);
+  instance_ = 0;
+
+  connectDocumentSignals();
+  onDocumentPathChanged();
+  onInstancesChanged();
+  statusBarMessageLabel_->setText("Searching for matching files...");
+  instanceDiscoveryTimer_->start();
+}
+
+void MainWindow::onInstanceDiscoveryTimeout()
+{
+  if (!doc_ || !doc_->isDiscoveringInstances())
+  {
+    instanceDiscoveryTimer_->stop();
+    statusBarMessageLabel_->clear();
+    return;
+  }
+
+  const std::optional<std::vector<QString>> previousInstanceKey = currentInstanceKey();
+  const size_t previousNumInstances = doc_->instances().size();
+
+  bool finished = true;
+  std::vector<size_t> insertedIndices;
+  Try([&] { finished = doc_->addDiscoveredInstances(&insertedIndices); });
+
+  if (finished)
+  {
+    instanceDiscoveryTimer_->stop();
+    statusBarMessageLabel_->clear();
+  }
+  else
+  {
+    statusBarMessageLabel_->setText(
+      QString("Searching for matching files... Number of files visited so far: %1")
+        .arg(doc_->instanceDiscoveryProgress()->numVisitedFiles.load()));
+    if (doc_->instances().size() == previousNumInstances)
+      return;
+  }
+
+  if (!finished && previousNumInstances > 0)
+  {
+    // Only rows have been added, so tell the model which ones rather than resetting it.
+    {
+      const QSignalBlocker blocker(instanceComboBox_);
+      instanceListModel_->instancesInserted(insertedIndices);
+    }
+    instanceComboBox_->setEnabled(true);
+    updateDocumentDependentUiElements();
+  }
+  else
+  {
+    // Repopulating the combo box would otherwise switch to the first page.
+    const QSignalBlocker blocker(instanceComboBox_);
+    onInstancesChanged();
+  }
+  if (doc_->instances().empty())
+    return;
+
+  const std::optional<int> newInstance =
+    previousInstanceKey ? findInstance(*doc_, *previousInstanceKey) : std::nullopt;
+  if (newInstance)
+  {
+    // The page on display has only moved, so there is no need to reload its images.
+    instance_ = *newInstance;
+    const QSignalBlocker blocker(instanceComboBox_);
+    instanceComboBox_->setCurrentIndex(instance_);
+    updateInstanceDependentUiElements();
+  }
+  else
+  {
+    goToInstance(0);
+  }
+}
+
+void MainWindow::onListingCacheSaveTimeout()
+{
+  // A save still running from the previous timeout will have written most of the listings.
+  if (listingCacheSaveWatcher_->isRunning())
+    return;
+  listingCacheSaveWatcher_->setFuture(
+    QtConcurrent::run([] { DirectoryListingCache::instance().save(); }));
+}
+
 void MainWindow::onRecentDocumentActionTriggered()
 {
   const QAction* action = dynamic_cast<QAction*>(sender());
@@ -390,10 +557,7 @@ void MainWindow::on_actionEditAlbum_triggered()
     PatternMatchingProgressDialog progressDialog(this);
     progressDialog.show();
 
-    auto onFilesystemTraversalProgress = [&progressDialog]()
-    { progressDialog.incrementProgressAndCheckForCancellation(); };
-
-    if (!Try([&] { doc_->setPatterns(dialog.values(), onFilesystemTraversalProgress); }))
+    if (!Try([&] { doc_->setPatterns(dialog.values(), progressDialog.progress()); }))
       return;
 
     const size_t newNumPatterns = doc_->patterns().size();
@@ -409,13 +573,17 @@ void MainWindow::on_actionEditAlbum_triggered()
       previousInstanceKey ? findInstance(*doc_, *previousInstanceKey).value_or(0) : 0;
     if (!doc_->instances().empty())
       goToInstance(newInstance);
+
+    // The new patterns may search other directories.
+    if (ui_->actionWatchAlbum->isChecked())
+      refreshWatchedAlbum();
   }
 }
 
 std::optional<std::vector<QString>> MainWindow::currentInstanceKey() const
 {
   if (instance_ < doc_->instances().size())
-    return doc_->instances()[instance_].magicExpressionMatches;
+    return doc_->instances().magicExpressionMatches(instance_);
   return std::nullopt;
 }
 
@@ -426,18 +594,131 @@ void MainWindow::on_actionRefreshAlbum_triggered()
   PatternMatchingProgressDialog progressDialog(this);
   progressDialog.show();
 
-  auto onFilesystemTraversalProgress = [&progressDialog]()
-  { progressDialog.incrementProgressAndCheckForCancellation(); };
+  bool instancesChanged = false;
+  if (!Try([&] { instancesChanged = doc_->regenerateInstances(progressDialog.progress()); }))
+    return;
+
+  if (ui_->actionWatchAlbum->isChecked())
+    watchSearchedDirectories();
+  onInstancesRegenerated(instancesChanged, previousInstanceKey);
+}
 
-  if (!Try([&] { doc_->regenerateInstances(onFilesystemTraversalProgress); }))
+void MainWindow::on_actionWatchAlbum_triggered(bool checked)
+{
+  if (checked)
+    refreshWatchedAlbum();
+  else
+    stopWatchingAlbum();
+}
+
+void MainWindow::onWatchedDirectoriesChanged()
+{
+  // Wait for any dialog to close, or for the pattern matching in progress to finish.
+  if (qApp->activeModalWidget() || refreshingWatchedAlbum_ ||
+      (doc_ && doc_->isUpdatingInstances()))
+  {
+    directoryWatcher_->postponeNotification();
     return;
+  }
 
-  onInstancesChanged();
+  std::vector<fs::path> changedDirectories = directoryWatcher_->takeChangedDirectories();
+  if (!doc_ || !ui_->actionWatchAlbum->isChecked())
+    return;
 
-  const int newInstance =
-    previousInstanceKey ? findInstance(*doc_, *previousInstanceKey).value_or(0) : 0;
-  if (!doc_->instances().empty())
-    goToInstance(newInstance);
+  if (doc_->canUpdateInstancesIncrementally())
+  {
+    // Only the changed directories are searched, in the background, so the album can still be
+    // browsed meanwhile; onInstanceUpdateFinished() applies the changes.
+    doc_->startInstanceUpdate(std::move(changedDirectories));
+    return;
+  }
+  refreshWatchedAlbum();
+}
+
+void MainWindow::onInstanceUpdateFinished()
+{
+  if (!doc_ || !doc_->isUpdatingInstances())
+    return;
+
+  const std::optional<std::vector<QString>> previousInstanceKey = currentInstanceKey();
+  const size_t previousNumInstances = doc_->instances().size();
+
+  bool instancesChanged = false;
+  std::vector<size_t> erasedIndices;
+  std::vector<size_t> insertedIndices;
+  if (!Try([&]
+           { instancesChanged = doc_->finishInstanceUpdate(&erasedIndices, &insertedIndices); }))
+  {
+    stopWatchingAlbum();
+    return;
+  }
+
+  watchSearchedDirectories();
+  if (!instancesChanged || previousNumInstances == 0 || doc_->instances().empty())
+  {
+    onInstancesRegenerated(instancesChanged, previousInstanceKey);
+    return;
+  }
+
+  // Only some rows have been erased and inserted, so tell the model which ones rather than
+  // resetting it.
+  {
+    const QSignalBlocker blocker(instanceComboBox_);
+    instanceListModel_->instancesErased(erasedIndices);
+    instanceListModel_->instancesInserted(insertedIndices);
+  }
+  instanceComboBox_->setEnabled(true);
+  startIndexingInstanceKeys();
+  updateDocumentDependentUiElements();
+
+  // The files of the page on display may have been replaced, so reload its images.
+  const std::optional<int> newInstance =
+    previousInstanceKey ? findInstance(*doc_, *previousInstanceKey) : std::nullopt;
+  goToInstance(newInstance.value_or(0));
+}
+
+// Regenerates the instances and updates the set of watched directories.
+void MainWindow::refreshWatchedAlbum()
+{
+  const std::optional<std::vector<QString>> previousInstanceKey = currentInstanceKey();
+
+  bool instancesChanged = false;
+  bool success = false;
+  {
+    PatternMatchingProgressDialog progressDialog(this);
+    progressDialog.show();
+
+    refreshingWatchedAlbum_ = true;
+    success = Try([&] { instancesChanged = doc_->regenerateInstances(progressDialog.progress()); });
+    refreshingWatchedAlbum_ = false;
+  }
+  if (!success)
+  {
+    stopWatchingAlbum();
+    return;
+  }
+
+  watchSearchedDirectories();
+  onInstancesRegenerated(instancesChanged, previousInstanceKey);
+}
+
+void MainWindow::watchSearchedDirectories()
+{
+  const size_t numUnwatchedDirectories =
+    directoryWatcher_->setDirectories(doc_->searchedDirectories());
+  statusBarMessageLabel_->setText(
+    numUnwatchedDirectories == 0
+      ? QString()
+      : QString("Too many directories to watch; %1 are not watched").arg(numUnwatchedDirectories));
+}
+
+void MainWindow::stopWatchingAlbum()
+{
+  directoryWatcher_->clear();
+  if (doc_)
+    doc_->stopInstanceUpdate();
+  ui_->actionWatchAlbum->setChecked(false);
+  statusBarMessageLabel_->clear();
 }
 
 void MainWindow::on_actionUseRelativePathsInSavedAlbum_triggered(bool checked)
@@ -464,6 +745,7 @@ void MainWindow::on_actionCloseAlbum_triggered()
     return;
   }
 
+  stopWatchingAlbum();
   doc_ = nullptr;
   onDocumentPathChanged();
   onInstancesChanged();
@@ -622,6 +904,12 @@ void MainWindow::on_actionLastInstance_triggered()
   goToInstance(doc_->instances().size() - 1);
 }
 
+void MainWindow::on_actionFindPage_triggered()
+{
+  instanceSearchBox_->setFocus();
+  instanceSearchBox_->selectAll();
+}
+
 void MainWindow::on_actionBookmarkPage_triggered(bool checked)
 {
   if (!doc_ || doc_->instances().empty())
@@ -630,8 +918,6 @@ void MainWindow::on_actionBookmarkPage_triggered(bool checked)
     doc_->addBookmark(instance_);
   else
     doc_->removeBookmark(instance_);
-  const QBrush brush = checked ? QBrush(BOOKMARK_COLOUR) : QBrush();
-  instanceComboBox_->setItemData(instance_, brush, Qt::ForegroundRole);
 
   onBookmarksChanged();
 }
@@ -648,9 +934,6 @@ void MainWindow::on_actionRemoveAllBookmarks_triggered()
     return;
 
   doc_->removeAllBookmarks();
-  QBrush defaultBrush;
-  for (size_t instance = 0; instance < doc_->instances().size(); ++instance)
-    instanceComboBox_->setItemData(instance, defaultBrush, Qt::ForegroundRole);
 
   onBookmarksChanged();
 }
@@ -659,7 +942,7 @@ void MainWindow::on_actionFirstBookmark_triggered()
 {
   if (!doc_ || doc_->instances().empty() || doc_->bookmarks().empty())
     return;
-  goToInstance(*doc_->bookmarks().begin());
+  goToInstance(*doc_->bookmarks().first());
 }
 
 void MainWindow::on_actionPreviousBookmark_triggered()
@@ -667,10 +950,8 @@ void MainWindow::on_actionPreviousBookmark_triggered()
   if (!doc_ || doc_->instances().empty())
     return;
 
-  auto it = std::upper_bound(doc_->bookmarks().rbegin(), doc_->bookmarks().rend(), instance_,
-                             std::greater<size_t>());
-  if (it != doc_->bookmarks().rend())
-    goToInstance(*it);
+  if (const std::optional<size_t> bookmark = doc_->bookmarks().previous(instance_))
+    goToInstance(*bookmark);
 }
 
 void MainWindow::on_actionNextBookmark_triggered()
@@ -678,16 +959,15 @@ void MainWindow::on_actionNextBookmark_triggered()
   if (!doc_ || doc_->instances().empty())
     return;
 
-  auto it = std::upper_bound(doc_->bookmarks().begin(), doc_->bookmarks().end(), instance_);
-  if (it != doc_->bookmarks().end())
-    goToInstance(*it);
+  if (const std::optional<size_t> bookmark = doc_->bookmarks().next(instance_))
+    goToInstance(*bookmark);
 }
 
 void MainWindow::on_actionLastBookmark_triggered()
 {
   if (!doc_ || doc_->instances().empty() || doc_->bookmarks().empty())
     return;
-  goToInstance(*doc_->bookmarks().rbegin());
+  goToInstance(*doc_->bookmarks().last());
 }
 
 void MainWindow::on_actionImportBookmarks_triggered()
@@ -706,27 +986,13 @@ void MainWindow::on_actionImportBookmarks_triggered()
 
   settings.setValue("lastImportOrExportBookmarksDir", QFileInfo(fileName).dir().path());
   QFile file(fileName);
-  QString bookmarkKey;
-  std::set<QString> bookmarkKeys;
   if (file.open(QFile::ReadOnly))
   {
     QTextStream stream(&file);
-    while (stream.readLineInto(&bookmarkKey))
-      bookmarkKeys.insert(bookmarkKey);
-    size_t numImportedBookmarks = 0;
-    const QBrush bookmarkBrush = QBrush(BOOKMARK_COLOUR);
-    for (size_t i = 0; i < doc_->instances().size(); ++i)
-    {
-      if (contains(bookmarkKeys, doc_->instanceKey(i)) && !contains(doc_->bookmarks(), i))
-      {
-        doc_->addBookmark(i);
-        instanceComboBox_->setItemData(i, bookmarkBrush, Qt::ForegroundRole);
-        ++numImportedBookmarks;
-      }
-    }
-    QMessageBox::information(this, "Import Bookmarks",
-                             QString("%1 bookmarks have been imported.").arg(numImportedBookmarks),
-                             QMessageBox::Ok);
+    const BookmarkSet importedBookmarks = doc_->importBookmarks(stream);
+    QMessageBox::information(
+      this, "Import Bookmarks",
+      QString("%1 bookmarks have been imported.").arg(importedBookmarks.size()), QMessageBox::Ok);
     onBookmarksChanged();
   }
   else
@@ -755,8 +1021,7 @@ void MainWindow::on_actionExportBookmarks_triggered()
   if (file.open(QFile::WriteOnly | QFile::Truncate))
   {
     QTextStream stream(&file);
-    for (size_t i : doc_->bookmarks())
-      stream << doc_->instanceKey(i) << "\n";
+    doc_->exportBookmarks(stream);
     QMessageBox::information(
       this, "Export Bookmarks",
       QString("%1 bookmarks have been exported.").arg(doc_->bookmarks().size()), QMessageBox::Ok);
@@ -844,6 +1109,75 @@ void MainWindow::onInstanceComboBox(int currentIndex)
     goToInstance(currentIndex);
 }
 
+void MainWindow::onInstanceSearchBoxTextEdited(const QString& text)
+{
+  if (!doc_ || !instanceKeyIndex_)
+    return;
+
+  QStringList instanceKeys;
+  for (size_t instance : instanceKeyIndex_->search(text, MAX_NUM_INSTANCE_SEARCH_RESULTS))
+    instanceKeys.push_back(doc_->instanceKey(instance));
+  instanceSearchResults_->setStringList(instanceKeys);
+  if (instanceKeys.empty())
+    instanceSearchCompleter_->popup()->hide();
+  else
+    instanceSearchCompleter_->complete();
+}
+
+void MainWindow::onInstanceSearchBoxReturnPressed()
+{
+  // Go to the best match unless another one has been picked from the list.
+  const QStringList instanceKeys = instanceSearchResults_->stringList();
+  if (!instanceKeys.empty())
+    onInstanceSearchResultActivated(instanceKeys.front());
+}
+
+void MainWindow::onInstanceSearchResultActivated(const QString& instanceKey)
+{
+  if (!doc_)
+    return;
+
+  if (const std::optional<size_t> instance = doc_->findInstanceWithKey(instanceKey))
+  {
+    instanceSearchCompleter_->popup()->hide();
+    instanceSearchResults_->setStringList({});
+    instanceSearchBox_->clear();
+    goToInstance(*instance);
+  }
+}
+
+void MainWindow::startIndexingInstanceKeys()
+{
+  // An index of the previous instances, possibly still being built, is of no use any more.
+  delete instanceKeyIndexWatcher_;
+  instanceKeyIndexWatcher_ = nullptr;
+  instanceKeyIndex_ = nullptr;
+  instanceSearchResults_->setStringList({});
+  instanceSearchCompleter_->popup()->hide();
+  instanceSearchBox_->setEnabled(false);
+  ui_->actionFindPage->setEnabled(false);
+
+  // The instances of an album opened progressively are indexed once they are all found.
+  if (!doc_ || doc_->isDiscoveringInstances() || doc_->instances().empty() ||
+      doc_->instances().numMagicExpressions() == 0)
+    return;
+
+  instanceKeyIndexWatcher_ = new QFutureWatcher<std::shared_ptr<const InstanceKeyIndex>>(this);
+  connect(instanceKeyIndexWatcher_,
+          &QFutureWatcher<std::shared_ptr<const InstanceKeyIndex>>::finished, this,
+          &MainWindow::onInstanceKeysIndexed);
+  instanceKeyIndexWatcher_->setFuture(
+    QtConcurrent::run([buildIndex = doc_->instanceKeyIndexBuilder()]
+                      { return std::make_shared<const InstanceKeyIndex>(buildIndex()); }));
+}
+
+void MainWindow::onInstanceKeysIndexed()
+{
+  instanceKeyIndex_ = instanceKeyIndexWatcher_->result();
+  instanceSearchBox_->setEnabled(true);
+  ui_->actionFindPage->setEnabled(true);
+}
+
 void MainWindow::onMouseLeftImage()
 {
   statusBarPixelLabel_->setText(QString());
@@ -858,6 +1192,8 @@ void MainWindow::connectDocumentSignals()
 {
   connect(doc_.get(), &Document::modificationStatusChanged, this,
           &MainWindow::onDocumentModificationStatusChanged);
+  connect(doc_.get(), &Document::instanceUpdateFinished, this,
+          &MainWindow::onInstanceUpdateFinished);
 }
 
 void MainWindow::updateMainViewLayout()
@@ -891,22 +1227,12 @@ void MainWindow::updateLayoutSubmenu()
 
 void MainWindow::populateInstanceComboBox()
 {
-  instanceComboBox_->clear();
+  instanceListModel_->setDocument(doc_.get());
 
-  bool anyItemIsNonempty = false;
-  if (doc_ != nullptr)
-  {
-    const size_t numInstances = doc_->instances().size();
-    for (size_t instance = 0; instance < numInstances; ++instance)
-    {
-      QString item = doc_->instanceKey(instance);
-      anyItemIsNonempty = anyItemIsNonempty || !item.isEmpty();
-      const bool isBookmarked = contains(doc_->bookmarks(), instance);
-      const QBrush brush = isBookmarked ? QBrush(BOOKMARK_COLOUR) : QBrush();
-      instanceComboBox_->addItem(item);
-      instanceComboBox_->setItemData(instanceComboBox_->count() - 1, brush, Qt::ForegroundRole);
-    }
-  }
+  // Instance keys are unique, so at most one of them can be empty.
+  const size_t numInstances = doc_ ? doc_->instances().size() : 0;
+  const bool anyItemIsNonempty =
+    numInstances > 1 || (numInstances == 1 && !doc_->instanceKey(0).isEmpty());
   instanceComboBox_->setEnabled(anyItemIsNonempty);
 }
 
@@ -924,6 +1250,7 @@ void MainWindow::updateDocumentDependentActions()
   const bool hasPatterns = isOpen && !doc_->patterns().empty();
   ui_->actionEditAlbum->setEnabled(isOpen);
   ui_->actionRefreshAlbum->setEnabled(isOpen);
+  ui_->actionWatchAlbum->setEnabled(isOpen);
   ui_->actionSaveAlbum->setEnabled(isModified);
   ui_->actionSaveAlbumAs->setEnabled(isOpen);
   ui_->actionCloseAlbum->setEnabled(isOpen);
@@ -1027,12 +1354,12 @@ void MainWindow::updateBookmarkDependentActions()
   const bool hasInstances = isOpen && !doc_->instances().empty();
   const bool hasBookmarks = isOpen && !doc_->bookmarks().empty();
   ui_->actionBookmarkPage->setEnabled(hasInstances);
-  ui_->actionBookmarkPage->setChecked(isOpen && contains(doc_->bookmarks(), instance_));
+  ui_->actionBookmarkPage->setChecked(isOpen && doc_->bookmarks().contains(instance_));
   ui_->actionRemoveAllBookmarks->setEnabled(hasBookmarks);
-  ui_->actionFirstBookmark->setEnabled(hasBookmarks && instance_ != *doc_->bookmarks().begin());
-  ui_->actionPreviousBookmark->setEnabled(hasBookmarks && instance_ > *doc_->bookmarks().begin());
-  ui_->actionNextBookmark->setEnabled(hasBookmarks && instance_ < *doc_->bookmarks().rbegin());
-  ui_->actionLastBookmark->setEnabled(hasBookmarks && instance_ != *doc_->bookmarks().rbegin());
+  ui_->actionFirstBookmark->setEnabled(hasBookmarks && instance_ != *doc_->bookmarks().first());
+  ui_->actionPreviousBookmark->setEnabled(hasBookmarks && instance_ > *doc_->bookmarks().first());
+  ui_->actionNextBookmark->setEnabled(hasBookmarks && instance_ < *doc_->bookmarks().last());
+  ui_->actionLastBookmark->setEnabled(hasBookmarks && instance_ != *doc_->bookmarks().last());
   ui_->actionImportBookmarks->setEnabled(isOpen && hasInstances);
   ui_->actionExportBookmarks->setEnabled(hasBookmarks);
 }
@@ -1059,6 +1386,16 @@ void MainWindow::on_actionUnregisterFileType_triggered()
                            " has been removed.");
 }
 
+void MainWindow::on_actionClearDirectoryListingCache_triggered()
+{
+  DirectoryListingCache::instance().clear();
+}
+
+void MainWindow::on_actionOpenAlbumsProgressively_triggered(bool checked)
+{
+  QSettings().setValue("openAlbumsProgressively", checked);
+}
+
 bool MainWindow::isFileTypeRegistered()
 {
   QSettings settings(HKCU_SOFTWARE_CLASSES_KEY, QSettings::NativeFormat);
@@ -1098,14 +1435,33 @@ void MainWindow::onInstancesChanged()
   updateMainViewLayout();
   updateLayoutSubmenu();
   populateInstanceComboBox();
+  startIndexingInstanceKeys();
   updateDocumentDependentUiElements();
 
-  if (doc_ && doc_->instances().empty())
+  if (doc_ && doc_->instances().empty() && !doc_->isDiscoveringInstances())
   {
     QMessageBox::information(this, "Information", "No pattern matches found.");
   }
 }
 
+void MainWindow::onInstancesRegenerated(
+  bool instancesChanged, const std::optional<std::vector<QString>>& previousInstanceKey)
+{
+  if (!instancesChanged && !doc_->instances().empty())
+  {
+    // The files may still have been overwritten, so reload the images on display.
+    goToInstance(instance_);
+    return;
+  }
+
+  onInstancesChanged();
+
+  const int newInstance =
+    previousInstanceKey ? findInstance(*doc_, *previousInstanceKey).value_or(0) : 0;
+  if (!doc_->instances().empty())
+    goToInstance(newInstance);
+}
+
 void MainWindow::onActiveInstanceChanged()
 {
   if (doc_ && !doc_->instances().empty())
@@ -1136,6 +1492,7 @@ void MainWindow::onCaptionTemplatesChanged()
 
 void MainWindow::onBookmarksChanged()
 {
+  instanceListModel_->bookmarksChanged();
   updateBookmarkDependentActions();
 }
 
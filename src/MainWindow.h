@@ -19,7 +19,10 @@
 
 #include <QtWidgets/QMainWindow>
 
+class DirectoryWatcher;
 class Document;
+class InstanceKeyIndex;
+class InstanceListModel;
 class Layout;
 class MainView;
 
@@ -31,9 +34,15 @@ class MainWindowClass;
 class QAction;
 class QActionGroup;
 class QComboBox;
+class QCompleter;
 class QGridLayout;
 class QLabel;
+class QLineEdit;
 class QMenu;
+class QStringListModel;
+class QTimer;
+template <typename T>
+class QFutureWatcher;
 
 class MainWindow : public QMainWindow
 {
@@ -66,6 +75,7 @@ private slots:
   void on_actionOpenAlbum_triggered();
   void on_actionEditAlbum_triggered();
   void on_actionRefreshAlbum_triggered();
+  void on_actionWatchAlbum_triggered(bool checked);
   void on_actionUseRelativePathsInSavedAlbum_triggered(bool checked);
   void on_actionSaveAlbum_triggered();
   void on_actionSaveAlbumAs_triggered();
@@ -83,6 +93,7 @@ private slots:
   void on_actionPreviousInstance_triggered();
   void on_actionNextInstance_triggered();
   void on_actionLastInstance_triggered();
+  void on_actionFindPage_triggered();
 
   void on_actionBookmarkPage_triggered(bool checked);
   void on_actionRemoveAllBookmarks_triggered();
@@ -95,6 +106,8 @@ private slots:
 
   void on_actionRegisterFileType_triggered();
   void on_actionUnregisterFileType_triggered();
+  void on_actionClearDirectoryListingCache_triggered();
+  void on_actionOpenAlbumsProgressively_triggered(bool checked);
 
   void on_actionTutorial_triggered();
   void on_actionAboutCameleon_triggered();
@@ -104,6 +117,14 @@ private slots:
 
   void onDocumentModificationStatusChanged();
   void onInstanceComboBox(int currentIndex);
+  void onInstanceSearchBoxTextEdited(const QString& text);
+  void onInstanceSearchBoxReturnPressed();
+  void onInstanceSearchResultActivated(const QString& instanceKey);
+  void onInstanceKeysIndexed();
+  void onWatchedDirectoriesChanged();
+  void onInstanceUpdateFinished();
+  void onInstanceDiscoveryTimeout();
+  void onListingCacheSaveTimeout();
 
   void onMouseLeftImage();
   void onMouseMovedOverImage(QPoint pixelCoords, QColor pixelColour);
@@ -111,7 +132,12 @@ private slots:
 private:
   void connectDocumentSignals();
 
+  void openDocumentProgressively(const QString& path);
+
   void populateInstanceComboBox();
+  /// Starts indexing the keys of the instances on a worker thread, so that they can be searched
+  /// from the search box once done.
+  void startIndexingInstanceKeys();
 
   void initialiseRecentDocumentsSubmenu();
   void prependToRecentDocuments(const QString& path);
@@ -133,6 +159,12 @@ private:
   void onDocumentPathChanged();
   void onInstancesChanged();
   void onActiveInstanceChanged();
+  void onInstancesRegenerated(bool instancesChanged,
+                              const std::optional<std::vector<QString>>& previousInstanceKey);
+
+  void refreshWatchedAlbum();
+  void watchSearchedDirectories();
+  void stopWatchingAlbum();
   void onCaptionTemplatesChanged();
   void onBookmarksChanged();
 
@@ -154,12 +186,26 @@ private:
 
 private:
   static const size_t MAX_NUM_RECENT_COMPARISONS = 9;
-  static const auto BOOKMARK_COLOUR = Qt::blue;
+  /// Delay between the first change to a watched directory and the refresh of the album.
+  static const int WATCH_NOTIFICATION_DELAY_MS = 1000;
+  /// Interval between updates of the instances of an album opened progressively.
+  static const int INSTANCE_DISCOVERY_UPDATE_INTERVAL_MS = 500;
+  /// Interval between the background saves of the directory listings read since the last save.
+  static const int LISTING_CACHE_SAVE_INTERVAL_MS = 5 * 60 * 1000;
+  /// Maximum number of pages listed below the search box.
+  static const size_t MAX_NUM_INSTANCE_SEARCH_RESULTS = 20;
 
 private:
   std::unique_ptr<Ui::MainWindowClass> ui_;
   bool dontUseNativeDialogs_;
+  InstanceListModel* instanceListModel_ = nullptr;
   QComboBox* instanceComboBox_ = nullptr;
+  QLineEdit* instanceSearchBox_ = nullptr;
+  QStringListModel* instanceSearchResults_ = nullptr;
+  QCompleter* instanceSearchCompleter_ = nullptr;
+  /// Index of the keys of the instances, or null while it is being built.
+  std::shared_ptr<const InstanceKeyIndex> instanceKeyIndex_;
+  QFutureWatcher<std::shared_ptr<const InstanceKeyIndex>>* instanceKeyIndexWatcher_ = nullptr;
   QMenu* layoutMenu_ = nullptr;
   QActionGroup* layoutActionGroup_ = nullptr;
   std::map<QAction*, Layout> layoutActions_;
@@ -169,6 +215,12 @@ private:
   QLabel* statusBarInstanceLabel_ = nullptr;
   QLabel* statusBarPixelLabel_ = nullptr;
 
+  DirectoryWatcher* directoryWatcher_ = nullptr;
+  bool refreshingWatchedAlbum_ = false;
+  QTimer* instanceDiscoveryTimer_ = nullptr;
+  QTimer* listingCacheSaveTimer_ = nullptr;
+  QFutureWatcher<void>* listingCacheSaveWatcher_ = nullptr;
+
   std::unique_ptr<Document> doc_;
   int instance_ = 0;
 };
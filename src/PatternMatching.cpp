@@ -16,85 +16,474 @@
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "PatternMatching.h"
-#include "PatternUtils.h"
+#include "CancellationException.h"
+#include "CompiledPattern.h"
+#include "ContainerUtils.h"
+#include "DirectoryListingCache.h"
 #include "RuntimeError.h"
 
+#include <glob/batch_status.h>
 #include <glob/glob.h>
 
-#include <regex>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
 
-bool operator==(const PatternMatch& a, const PatternMatch& b)
+namespace
 {
-  return a.magicExpressionMatches == b.magicExpressionMatches && a.path == b.path;
+// Number of paths whose existence is checked concurrently between two rounds of progress
+// reports.
+const size_t PROBE_BATCH_SIZE = 4096;
+// Number of paths probed together while globbing. Kept small, since the files found by probing
+// are reported only once the batch is checked.
+const size_t EARLY_PROBE_BATCH_SIZE = 64;
+
+// Directories searched for matching files, collected from the threads traversing the filesystem,
+// optionally with their stamps.
+class SearchedDirectories
+{
+public:
+  explicit SearchedDirectories(bool stamped) : stamped_(stamped) {}
+
+  // Must be called before `directory` is searched, so that its stamp reflects any later change.
+  void insert(const fs::path& directory)
+  {
+    const fs::path normalisedDirectory = normalizedDirectory(directory);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!stamped_ || contains(directories_, normalisedDirectory.native()))
+      {
+        directories_.emplace(normalisedDirectory.native(), std::nullopt);
+        return;
+      }
+    }
+    std::optional<glob::DirectoryStamp> stamp =
+      glob::directory_stamps({normalisedDirectory}).front();
+    std::lock_guard<std::mutex> lock(mutex_);
+    directories_.emplace(normalisedDirectory.native(), stamp);
+  }
+
+  // Inserts a directory searched already, whose stamp is therefore not recorded.
+  void insertUnstamped(const fs::path& directory)
+  {
+    const fs::path normalisedDirectory = normalizedDirectory(directory);
+    std::lock_guard<std::mutex> lock(mutex_);
+    directories_.emplace(normalisedDirectory.native(), std::nullopt);
+  }
+
+  // Stores the sorted directories in `directories` and, if it is not null, their stamps in
+  // `stamps`.
+  void get(std::vector<fs::path>& directories,
+           std::vector<std::optional<glob::DirectoryStamp>>* stamps) const
+  {
+    std::vector<std::pair<fs::path, std::optional<glob::DirectoryStamp>>> entries;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      entries.assign(directories_.begin(), directories_.end());
+    }
+    // Paths compare component by component, so each directory is followed by those below it.
+    std::sort(entries.begin(), entries.end(),
+              [](const auto& a, const auto& b) { return a.first < b.first; });
+    directories.clear();
+    if (stamps)
+      stamps->clear();
+    for (auto& [directory, stamp] : entries)
+    {
+      directories.push_back(std::move(directory));
+      if (stamps)
+        stamps->push_back(stamp);
+    }
+  }
+
+private:
+  bool stamped_;
+  mutable std::mutex mutex_;
+  std::unordered_map<fs::path::string_type, std::optional<glob::DirectoryStamp>> directories_;
+};
+
+// Returns true if `directory` is `ancestor` or lies below it.
+bool isSameOrBelow(const fs::path& directory, const fs::path& ancestor)
+{
+  return std::mismatch(ancestor.begin(), ancestor.end(), directory.begin(), directory.end())
+           .first == ancestor.end();
 }
 
-bool operator!=(const PatternMatch& a, const PatternMatch& b)
+glob::TraversalOptions traversalOptions(const TraversalLimits& limits = {},
+                                        PatternMatchingProgress* progress = nullptr,
+                                        SearchedDirectories* searchedDirectories = nullptr)
 {
-  return !(a == b);
+  glob::TraversalOptions options;
+  // Network filesystems may respond poorly to many concurrent directory listings; the user can
+  // cap their number in the application settings.
+  options.max_concurrency = QSettings().value("maxConcurrentDirectoryReads", 0).toUInt();
+  for (const QString& excludePattern : limits.excludePatterns)
+    options.exclude.emplace_back(excludePattern.toStdWString());
+  if (limits.maxRecursiveWildcardDepth)
+    options.max_recursive_depth =
+      static_cast<unsigned>(std::max(*limits.maxRecursiveWildcardDepth, 0));
+  if (QSettings().value("useDirectoryListingCache", true).toBool())
+    options.listing_cache = &DirectoryListingCache::instance();
+  if (progress)
+  {
+    options.num_skipped_cycles = &progress->numSkippedCycles;
+    options.cancelled = &progress->cancellationRequested;
+  }
+  if (searchedDirectories)
+  {
+    options.on_directory_searched = [searchedDirectories](const fs::path& directory)
+    { searchedDirectories->insert(directory); };
+  }
+  return options;
 }
 
-bool operator==(const PatternMatchingResult& a, const PatternMatchingResult& b)
+// Returns the function the glob library calls for each file or directory it visits.
+std::function<void()> progressCallback(PatternMatchingProgress* progress)
 {
-  return a.numMagicExpressions == b.numMagicExpressions && a.patternMatches == b.patternMatches;
+  if (!progress)
+    return [] {};
+  return [progress] { progress->numVisitedFiles.fetch_add(1, std::memory_order_relaxed); };
 }
 
-bool operator!=(const PatternMatchingResult& a, const PatternMatchingResult& b)
+void checkForCancellation(const PatternMatchingProgress* progress)
 {
-  return !(a == b);
+  if (progress && progress->cancellationRequested)
+    throw CancellationException();
 }
 
-PatternMatchingResult matchPattern(const QString& pattern,
-                                   const std::function<void()>& onFilesystemTraversalProgress)
+std::vector<std::wstring>
+magicExpressionMatches(const std::wstring& path,
+                       const std::vector<glob::Capture>& magicExpressionMatchPositions)
 {
-  PatternMatchingResult result;
+  std::vector<std::wstring> matches;
+  matches.reserve(magicExpressionMatchPositions.size());
+  for (const glob::Capture& position : magicExpressionMatchPositions)
+  {
+    matches.emplace_back(path, position.offset, position.length);
+  }
+  return matches;
+}
 
-  const QString nativePattern = QDir::toNativeSeparators(pattern);
-  const std::wstring patternAsStdWString = nativePattern.toStdWString();
+// Appends to `result` the path found by globbing `pattern` described by `info`, unless it is a
+// directory. `magicExpressionMatchPositions` is a scratch buffer reused across calls.
+void addPatternMatch(const CompiledPattern& pattern, const glob::PathInfo& info,
+                     std::vector<glob::Capture>& magicExpressionMatchPositions,
+                     PatternMatchingResult& result)
+{
+  if (fs::is_directory(info.status))
+    return;
+
+  std::wstring path = info.path.wstring();
+  if (!pattern.match(path, magicExpressionMatchPositions))
+  {
+    throw RuntimeError(QString::fromStdWString(L"Internal error: the path '" + path +
+                                               L"' unexpectedly did not match the pattern."));
+  }
+  std::vector<std::wstring> matches = magicExpressionMatches(path, magicExpressionMatchPositions);
+  result.patternMatches.push_back(PatternMatch{std::move(path), std::move(matches)});
+}
 
-  const std::vector<glob::PathInfo> globResults =
-    glob::rglob(patternAsStdWString, onFilesystemTraversalProgress);
+// Returns the form of `path` in which it is looked up among the paths already found.
+fs::path::string_type normalizedPath(const fs::path& path)
+{
+  return path.lexically_normal().native();
+}
 
-  const std::wregex patternAsRegex(wildcardPatternToRegex(patternAsStdWString));
-  result.numMagicExpressions = patternAsRegex.mark_count();
-  for (const glob::PathInfo& info : globResults)
+// Globs `patterns` in one shared traversal, turning the paths found into pattern matches as
+// they arrive. `patternIndices` holds the index of each pattern passed to
+// `progress->onPatternMatchFound`.
+//
+// If `shouldSearch` is set, only the directories it accepts are searched. If
+// `onPatternMatchFound` is set, it is called with each match instead of
+// `progress->onPatternMatchFound`.
+std::vector<std::shared_ptr<PatternMatchingResult>> globPatterns(
+  const std::vector<const CompiledPattern*>& patterns, const std::vector<size_t>& patternIndices,
+  const TraversalLimits& limits, PatternMatchingProgress* progress,
+  SearchedDirectories* searchedDirectories,
+  std::function<bool(const fs::path&)> shouldSearch = nullptr,
+  const std::function<void(size_t patternIndex, const PatternMatch& match)>& onPatternMatchFound =
+    nullptr)
+{
+  std::vector<const glob::Pattern*> globPatterns;
+  std::vector<std::shared_ptr<PatternMatchingResult>> results;
+  for (const CompiledPattern* pattern : patterns)
   {
-    if (fs::is_directory(info.status))
-      continue;
+    globPatterns.push_back(&pattern->globPattern());
+    results.push_back(std::make_shared<PatternMatchingResult>());
+    results.back()->numMagicExpressions = pattern->numMagicExpressions();
+  }
 
-    const std::wstring path = info.path.wstring();
-    std::wsmatch match;
-    std::vector<std::wstring> magicExpressionMatches;
-    if (std::regex_match(path, match, patternAsRegex))
+  // Directories traversed by several patterns are listed only once.
+  glob::TraversalOptions options = traversalOptions(limits, progress, searchedDirectories);
+  options.should_search = std::move(shouldSearch);
+  std::vector<glob::Capture> magicExpressionMatchPositions;
+  glob::glob_each_streamed(
+    globPatterns,
+    [&](size_t patternIndex, glob::PathInfo&& info)
     {
-      if (match.size() != result.numMagicExpressions + 1)
+      PatternMatchingResult& result = *results[patternIndex];
+      const size_t numMatches = result.patternMatches.size();
+      addPatternMatch(*patterns[patternIndex], info, magicExpressionMatchPositions, result);
+      if (result.patternMatches.size() == numMatches)
+        return;
+      if (onPatternMatchFound)
+        onPatternMatchFound(patternIndices[patternIndex], result.patternMatches.back());
+      else if (progress && progress->onPatternMatchFound)
+        progress->onPatternMatchFound(patternIndices[patternIndex], result.patternMatches.back());
+    },
+    progressCallback(progress), options);
+  // Globbing stops early if cancelled, leaving the results incomplete.
+  checkForCancellation(progress);
+  return results;
+}
+
+// Returns the index of the pattern expected to match the fewest files, or nothing if fewer than
+// two patterns contain magic expressions.
+std::optional<size_t> findDriverPattern(const std::vector<CompiledPattern>& patterns)
+{
+  // Prefer patterns with fewer `**` and `*` wildcards and more literal text around them.
+  auto selectivity = [](const CompiledPattern& pattern)
+  {
+    int numRecursiveWildcards = 0;
+    int numAsterisks = 0;
+    size_t length = 0;
+    for (const glob::Pattern::Component& component : pattern.globPattern().components())
+    {
+      if (component.recursive)
       {
-        throw RuntimeError(QString::fromStdWString(L"Internal error: the path '" + path +
-                                                   L"' did not match all magic expressions"));
+        ++numRecursiveWildcards;
       }
-      for (std::size_t i = 1; i < match.size(); ++i)
+      else if (component.magic)
       {
-        magicExpressionMatches.push_back(match[i].str());
+        numAsterisks +=
+          static_cast<int>(std::count(component.text.begin(), component.text.end(), '*'));
+        length += component.text.size();
       }
     }
+    return std::make_tuple(-numRecursiveWildcards, -numAsterisks, length);
+  };
+
+  std::optional<size_t> driver;
+  size_t numPatternsWithMagicExpressions = 0;
+  for (size_t i = 0; i < patterns.size(); ++i)
+  {
+    if (patterns[i].numMagicExpressions() == 0)
+      continue;
+    ++numPatternsWithMagicExpressions;
+    if (!driver || selectivity(patterns[i]) > selectivity(patterns[*driver]))
+      driver = i;
+  }
+  if (numPatternsWithMagicExpressions < 2)
+    return std::nullopt;
+  return driver;
+}
+
+// Returns, for each of `paths`, true if globbing would report it as a file: if it exists and is
+// not a directory, or if it is a broken symbolic link. The paths are checked concurrently.
+std::vector<bool> areFiles(const std::vector<fs::path>& paths)
+{
+  const glob::TraversalOptions options = traversalOptions();
+  const std::vector<fs::file_status> statuses = glob::status_each(paths, true, options);
+
+  std::vector<bool> result(paths.size());
+  std::vector<size_t> missing;
+  std::vector<fs::path> missingPaths;
+  for (size_t i = 0; i < paths.size(); ++i)
+  {
+    if (fs::exists(statuses[i]))
+    {
+      result[i] = !fs::is_directory(statuses[i]);
+    }
     else
     {
-      throw RuntimeError(
-        QString::fromStdWString(L"Internal error: the path '" + path +
-                                L"' unexpectedly did not match a regular expression."));
+      missing.push_back(i);
+      missingPaths.push_back(paths[i]);
+    }
+  }
+
+  const std::vector<fs::file_status> symlinkStatuses =
+    glob::status_each(missingPaths, false, options);
+  for (size_t k = 0; k < missing.size(); ++k)
+    result[missing[k]] = fs::exists(symlinkStatuses[k]);
+  return result;
+}
+
+// Finds the files matching `pattern` by substituting the magic expression matches of each file
+// matching the driver pattern into `pattern` and checking if the resulting files exist.
+// Appends the parent directories of the probed paths to `probedDirectories`.
+PatternMatchingResult probePattern(const CompiledPattern& pattern,
+                                   const PatternMatchingResult& driverResult,
+                                   std::set<std::wstring>& probedDirectories,
+                                   PatternMatchingProgress* progress)
+{
+  PatternMatchingResult result;
+  result.numMagicExpressions = pattern.numMagicExpressions();
+
+  std::vector<PatternMatch> candidates;
+  for (const PatternMatch& driverMatch : driverResult.patternMatches)
+  {
+    if (std::optional<std::wstring> path = pattern.substitute(driverMatch.magicExpressionMatches))
+    {
+      candidates.push_back(PatternMatch{std::move(*path), driverMatch.magicExpressionMatches});
+      probedDirectories.insert(candidates.back().path.parent_path().wstring());
+    }
+  }
+
+  for (size_t batchStart = 0; batchStart < candidates.size(); batchStart += PROBE_BATCH_SIZE)
+  {
+    checkForCancellation(progress);
+    const auto batchBegin = candidates.begin() + batchStart;
+    const auto batchEnd =
+      candidates.begin() + std::min(batchStart + PROBE_BATCH_SIZE, candidates.size());
+    std::vector<fs::path> paths;
+    for (auto it = batchBegin; it != batchEnd; ++it)
+      paths.push_back(it->path);
+    const std::vector<bool> found = areFiles(paths);
+    if (progress)
+      progress->numVisitedFiles.fetch_add(found.size(), std::memory_order_relaxed);
+    for (size_t i = 0; i < found.size(); ++i)
+    {
+      if (found[i])
+        result.patternMatches.push_back(std::move(batchBegin[i]));
     }
-    result.patternMatches.push_back(PatternMatch{path, std::move(magicExpressionMatches)});
   }
 
   return result;
 }
 
+// Reports the matches found by globbing all patterns, each once, together with the files found
+// earlier by substituting the text matched by the magic expressions of each match of the driver
+// pattern into the other patterns with magic expressions, as in `probePattern()`.
+class ProbingReporter
+{
+public:
+  ProbingReporter(const std::vector<CompiledPattern>& patterns, size_t driver,
+                  PatternMatchingProgress& progress)
+    : patterns_(patterns), driver_(driver), progress_(progress), reportedPaths_(patterns.size())
+  {
+  }
+
+  void report(size_t patternIndex, const PatternMatch& match)
+  {
+    reportOnce(patternIndex, match);
+    if (patternIndex != driver_)
+      return;
+
+    for (size_t i = 0; i < patterns_.size(); ++i)
+    {
+      if (i == driver_ || patterns_[i].numMagicExpressions() == 0)
+        continue;
+      if (std::optional<std::wstring> path = patterns_[i].substitute(match.magicExpressionMatches))
+      {
+        candidates_.push_back(PatternMatch{std::move(*path), match.magicExpressionMatches});
+        candidatePatternIndices_.push_back(i);
+      }
+    }
+    if (candidates_.size() >= EARLY_PROBE_BATCH_SIZE)
+      probeCandidates();
+  }
+
+private:
+  // Checks which of the candidates not reported yet exist and reports them.
+  void probeCandidates()
+  {
+    std::vector<size_t> unreported;
+    std::vector<fs::path> paths;
+    for (size_t k = 0; k < candidates_.size(); ++k)
+    {
+      if (!contains(reportedPaths_[candidatePatternIndices_[k]],
+                    normalizedPath(candidates_[k].path)))
+      {
+        unreported.push_back(k);
+        paths.push_back(candidates_[k].path);
+      }
+    }
+    const std::vector<bool> found = areFiles(paths);
+    progress_.numVisitedFiles.fetch_add(found.size(), std::memory_order_relaxed);
+    for (size_t i = 0; i < found.size(); ++i)
+    {
+      if (found[i])
+        reportOnce(candidatePatternIndices_[unreported[i]], candidates_[unreported[i]]);
+    }
+    candidates_.clear();
+    candidatePatternIndices_.clear();
+  }
+
+  void reportOnce(size_t patternIndex, const PatternMatch& match)
+  {
+    if (reportedPaths_[patternIndex].insert(normalizedPath(match.path)).second)
+      progress_.onPatternMatchFound(patternIndex, match);
+  }
+
+  const std::vector<CompiledPattern>& patterns_;
+  size_t driver_;
+  PatternMatchingProgress& progress_;
+  // Paths reported so far for each pattern, normalized with `normalizedPath()`.
+  std::vector<std::unordered_set<fs::path::string_type>> reportedPaths_;
+  std::vector<PatternMatch> candidates_;
+  std::vector<size_t> candidatePatternIndices_;
+};
+
+} // namespace
+
+bool operator==(const PatternMatch& a, const PatternMatch& b)
+{
+  return a.magicExpressionMatches == b.magicExpressionMatches && a.path == b.path;
+}
+
+bool operator!=(const PatternMatch& a, const PatternMatch& b)
+{
+  return !(a == b);
+}
+
+bool operator==(const PatternMatchingResult& a, const PatternMatchingResult& b)
+{
+  return a.numMagicExpressions == b.numMagicExpressions && a.patternMatches == b.patternMatches;
+}
+
+bool operator!=(const PatternMatchingResult& a, const PatternMatchingResult& b)
+{
+  return !(a == b);
+}
+
+bool operator==(const TraversalLimits& a, const TraversalLimits& b)
+{
+  return a.excludePatterns == b.excludePatterns &&
+         a.maxRecursiveWildcardDepth == b.maxRecursiveWildcardDepth;
+}
+
+bool operator!=(const TraversalLimits& a, const TraversalLimits& b)
+{
+  return !(a == b);
+}
+
+PatternMatchingResult matchPattern(const QString& pattern, PatternMatchingProgress* progress)
+{
+  return matchPattern(CompiledPattern(pattern), progress);
+}
+
+PatternMatchingResult matchPattern(const CompiledPattern& pattern,
+                                   PatternMatchingProgress* progress)
+{
+  PatternMatchingResult result;
+  result.numMagicExpressions = pattern.numMagicExpressions();
+  const glob::TraversalOptions options = traversalOptions({}, progress);
+  std::vector<glob::Capture> magicExpressionMatchPositions;
+  glob::glob_streamed(
+    pattern.globPattern(), [&](glob::PathInfo&& info)
+    { addPatternMatch(pattern, info, magicExpressionMatchPositions, result); },
+    progressCallback(progress), options);
+  checkForCancellation(progress);
+  return result;
+}
+
 bool allPatternsContainSameNumberOfMagicExpressionsOrNone(const std::vector<QString>& patterns)
 {
   size_t numMagicExpressions = 0;
   for (const QString& pattern : patterns)
   {
-    const std::wregex patternAsRegex(wildcardPatternToRegex(pattern.toStdWString()));
-    const std::size_t markCount = patternAsRegex.mark_count();
+    const std::size_t markCount = CompiledPattern(pattern).numMagicExpressions();
     if (markCount > 0)
     {
       if (numMagicExpressions == 0)
@@ -118,24 +507,196 @@ void checkAllPatternsContainSameNumberOfMagicExpressionsOrNone(const std::vector
 }
 
 std::vector<std::shared_ptr<PatternMatchingResult>>
-matchPatterns(const std::vector<QString>& patterns,
-              const std::function<void()>& onFilesystemTraversalProgress)
+matchPatterns(const std::vector<QString>& patterns, PatternMatchingProgress* progress)
 {
-  std::vector<std::shared_ptr<PatternMatchingResult>> results;
-  std::transform(patterns.begin(), patterns.end(), std::back_inserter(results),
-                 [&onFilesystemTraversalProgress](const QString& pattern)
-                 {
-                   return std::make_shared<PatternMatchingResult>(
-                     matchPattern(pattern, onFilesystemTraversalProgress));
-                 });
+  return matchPatterns(patterns, PatternMatchingStrategy::Glob, TraversalLimits(), progress);
+}
+
+std::vector<std::shared_ptr<PatternMatchingResult>>
+matchPatterns(const std::vector<QString>& patterns, PatternMatchingStrategy strategy,
+              const TraversalLimits& limits, PatternMatchingProgress* progress,
+              std::vector<fs::path>* searchedDirectories,
+              std::vector<std::optional<glob::DirectoryStamp>>* searchedDirectoryStamps)
+{
+  std::optional<SearchedDirectories> searched;
+  if (searchedDirectories)
+    searched.emplace(searchedDirectoryStamps != nullptr);
+
+  const std::vector<CompiledPattern> compiledPatterns(patterns.begin(), patterns.end());
+  const std::optional<size_t> driver = strategy == PatternMatchingStrategy::Glob
+                                         ? std::nullopt
+                                         : findDriverPattern(compiledPatterns);
+  if (!driver || strategy == PatternMatchingStrategy::ProbeWithFallback)
+  {
+    // With a fallback, every pattern is globbed as without a driver, and the matches of the
+    // driver are only used to probe the other patterns for files to report before the traversal
+    // reaches them.
+    std::vector<size_t> patternIndices;
+    std::vector<const CompiledPattern*> patternsToGlob;
+    for (const CompiledPattern& compiledPattern : compiledPatterns)
+    {
+      patternIndices.push_back(patternsToGlob.size());
+      patternsToGlob.push_back(&compiledPattern);
+    }
+    std::optional<ProbingReporter> reporter;
+    std::function<void(size_t, const PatternMatch&)> onPatternMatchFound;
+    if (driver && progress && progress->onPatternMatchFound)
+    {
+      reporter.emplace(compiledPatterns, *driver, *progress);
+      onPatternMatchFound = [&reporter](size_t patternIndex, const PatternMatch& match)
+      { reporter->report(patternIndex, match); };
+    }
+    std::vector<std::shared_ptr<PatternMatchingResult>> results =
+      globPatterns(patternsToGlob, patternIndices, limits, progress,
+                   searched ? &*searched : nullptr, nullptr, onPatternMatchFound);
+    if (searchedDirectories)
+      searched->get(*searchedDirectories, searchedDirectoryStamps);
+    return results;
+  }
+
+  // Glob the driver pattern and the patterns without magic expressions, which match at most one
+  // file each.
+  std::vector<size_t> globbedPatternIndices;
+  std::vector<const CompiledPattern*> patternsToGlob;
+  for (size_t i = 0; i < compiledPatterns.size(); ++i)
+  {
+    if (i == *driver || compiledPatterns[i].numMagicExpressions() == 0)
+    {
+      globbedPatternIndices.push_back(i);
+      patternsToGlob.push_back(&compiledPatterns[i]);
+    }
+  }
+  std::vector<std::shared_ptr<PatternMatchingResult>> globResults = globPatterns(
+    patternsToGlob, globbedPatternIndices, limits, progress, searched ? &*searched : nullptr);
+
+  std::vector<std::shared_ptr<PatternMatchingResult>> results(compiledPatterns.size());
+  for (size_t i = 0; i < globbedPatternIndices.size(); ++i)
+    results[globbedPatternIndices[i]] = std::move(globResults[i]);
+
+  // Probe the others. Only the existence of the probed paths is checked: the limits apply to
+  // the driver's matches, but not to the directories and files of the other patterns named by
+  // the text matched by its magic expressions, so probing may find files that globbing would
+  // have skipped, e.g. hidden or excluded ones.
+  for (size_t i = 0; i < compiledPatterns.size(); ++i)
+  {
+    if (results[i])
+      continue;
+    std::set<std::wstring> probedDirectories;
+    results[i] = std::make_shared<PatternMatchingResult>(
+      probePattern(compiledPatterns[i], *results[*driver], probedDirectories, progress));
+    if (progress && progress->onPatternMatchFound)
+    {
+      for (const PatternMatch& patternMatch : results[i]->patternMatches)
+        progress->onPatternMatchFound(i, patternMatch);
+    }
+    if (searched)
+    {
+      for (const std::wstring& directory : probedDirectories)
+        searched->insertUnstamped(directory);
+    }
+  }
+
+  if (searchedDirectories)
+    searched->get(*searchedDirectories, searchedDirectoryStamps);
+  return results;
+}
+
+fs::path normalizedDirectory(const fs::path& directory)
+{
+  // Drop any trailing separator so that each directory has one form.
+  fs::path result = directory.lexically_normal();
+  if (!result.has_filename() && result.has_relative_path())
+    result = result.parent_path();
+  return result;
+}
+
+std::vector<fs::path>
+changedDirectories(const std::vector<fs::path>& directories,
+                   const std::vector<std::optional<glob::DirectoryStamp>>& stamps)
+{
+  const std::vector<std::optional<glob::DirectoryStamp>> currentStamps =
+    glob::directory_stamps(directories, traversalOptions());
+  std::vector<fs::path> result;
+  for (size_t i = 0; i < directories.size(); ++i)
+  {
+    if (!stamps[i] || currentStamps[i] != stamps[i])
+      result.push_back(directories[i]);
+  }
+  return result;
+}
+
+std::vector<std::shared_ptr<PatternMatchingResult>> matchPatternsInChangedDirectories(
+  const std::vector<QString>& patterns, const TraversalLimits& limits,
+  const std::vector<fs::path>& previousSearchedDirectories,
+  const std::vector<fs::path>& changedDirectories, PatternMatchingProgress* progress,
+  std::vector<fs::path>* searchedDirectories,
+  std::vector<std::optional<glob::DirectoryStamp>>* searchedDirectoryStamps)
+{
+  const auto isNewOrChanged = [&](const fs::path& directory)
+  {
+    return !std::binary_search(previousSearchedDirectories.begin(),
+                               previousSearchedDirectories.end(), directory) ||
+           std::binary_search(changedDirectories.begin(), changedDirectories.end(), directory);
+  };
+  // The directories below a directory sort right after it.
+  const auto leadsToChanged = [&](const fs::path& directory)
+  {
+    const auto it =
+      std::lower_bound(changedDirectories.begin(), changedDirectories.end(), directory);
+    return it != changedDirectories.end() && isSameOrBelow(*it, directory);
+  };
+
+  // A directory not searched before can only be reached through one that has changed, since the
+  // entries of the others are as they were.
+  const std::vector<CompiledPattern> compiledPatterns(patterns.begin(), patterns.end());
+  std::vector<size_t> patternIndices;
+  std::vector<const CompiledPattern*> patternsToGlob;
+  for (const CompiledPattern& compiledPattern : compiledPatterns)
+  {
+    patternIndices.push_back(patternsToGlob.size());
+    patternsToGlob.push_back(&compiledPattern);
+  }
+  SearchedDirectories searched(searchedDirectoryStamps != nullptr);
+  std::vector<std::shared_ptr<PatternMatchingResult>> results = globPatterns(
+    patternsToGlob, patternIndices, limits, progress, &searched,
+    [&](const fs::path& dirname)
+    {
+      const fs::path directory = normalizedDirectory(dirname);
+      return leadsToChanged(directory) || isNewOrChanged(directory);
+    });
+
+  // Drop the matches in the directories searched only on the way to the others.
+  for (const std::shared_ptr<PatternMatchingResult>& result : results)
+  {
+    std::vector<PatternMatch>& patternMatches = result->patternMatches;
+    patternMatches.erase(std::remove_if(patternMatches.begin(), patternMatches.end(),
+                                        [&](const PatternMatch& match) {
+                                          return !isNewOrChanged(
+                                            normalizedDirectory(match.path.parent_path()));
+                                        }),
+                         patternMatches.end());
+  }
+
+  if (searchedDirectories)
+    searched.get(*searchedDirectories, searchedDirectoryStamps);
   return results;
 }
 
 std::vector<std::shared_ptr<PatternMatchingResult>> matchPatternsReusingPreviousResults(
   const std::vector<QString>& patterns, const std::vector<QString>& previousPatterns,
   const std::vector<std::shared_ptr<PatternMatchingResult>>& previousResults,
-  const std::function<void()>& onFilesystemTraversalProgress)
+  const TraversalLimits& limits, PatternMatchingProgress* progress)
 {
+  std::vector<QString> newPatterns;
+  std::copy_if(patterns.begin(), patterns.end(), std::back_inserter(newPatterns),
+               [&previousPatterns](const QString& pattern)
+               {
+                 return std::find(previousPatterns.begin(), previousPatterns.end(), pattern) ==
+                        previousPatterns.end();
+               });
+  const std::vector<std::shared_ptr<PatternMatchingResult>> newResults =
+    matchPatterns(newPatterns, PatternMatchingStrategy::Glob, limits, progress);
+
   std::vector<std::shared_ptr<PatternMatchingResult>> results;
   std::transform(patterns.begin(), patterns.end(), std::back_inserter(results),
                  [&](const QString& pattern)
@@ -149,8 +710,9 @@ std::vector<std::shared_ptr<PatternMatchingResult>> matchPatternsReusingPrevious
                    }
                    else
                    {
-                     return std::make_shared<PatternMatchingResult>(
-                       matchPattern(pattern, onFilesystemTraversalProgress));
+                     return *(newResults.begin() +
+                              (std::find(newPatterns.begin(), newPatterns.end(), pattern) -
+                               newPatterns.begin()));
                    }
                  });
   return results;
@@ -18,12 +18,16 @@
 #pragma once
 
 #include "ghc/fs_std_fwd.hpp"
+#include <glob/listing_cache.h>
 
+#include <atomic>
 #include <functional>
 #include <memory>
+#include <optional>
 #include <string>
 #include <vector>
 
+class CompiledPattern;
 class QString;
 
 struct PatternMatch
@@ -44,19 +48,111 @@ struct PatternMatchingResult
 bool operator==(const PatternMatchingResult& a, const PatternMatchingResult& b);
 bool operator!=(const PatternMatchingResult& a, const PatternMatchingResult& b);
 
+/// Ways of finding the files matching the patterns of an album.
+enum class PatternMatchingStrategy
+{
+  /// Glob every pattern.
+  Glob,
+  /// Glob only the pattern expected to match the fewest files (the driver), substitute the text
+  /// matched by its magic expressions into the other patterns and check which of the resulting
+  /// paths exist. Files matching only the other patterns are not found.
+  Probe,
+  /// Glob every pattern, like Glob, but as the matches of the driver are found, probe the other
+  /// patterns with them like Probe, so that the files found this way are reported before the
+  /// traversal reaches them. The results are those of Glob.
+  ProbeWithFallback,
+};
+
+/// Album-specific limits on the directories searched for files matching the patterns.
+struct TraversalLimits
+{
+  /// Wildcard patterns matched against the names of the files and directories found by magic
+  /// expressions. Matching files are skipped and matching directories are not searched.
+  std::vector<QString> excludePatterns;
+  /// Maximum number of directories a `**` magic expression may match, or nothing if unlimited.
+  std::optional<int> maxRecursiveWildcardDepth;
+};
+
+bool operator==(const TraversalLimits& a, const TraversalLimits& b);
+bool operator!=(const TraversalLimits& a, const TraversalLimits& b);
+
+/// Progress of pattern matching running on one thread, shared with the thread reporting it to
+/// the user.
+struct PatternMatchingProgress
+{
+  /// Number of files and directories visited so far.
+  std::atomic<size_t> numVisitedFiles{0};
+  /// Number of directories skipped because they had already been entered on the way to them,
+  /// e.g. through a symbolic link to a parent directory.
+  std::atomic<size_t> numSkippedCycles{0};
+  /// Set to stop pattern matching, which then throws a CancellationException. It is checked
+  /// before each directory is listed.
+  std::atomic<bool> cancellationRequested{false};
+  /// If set, called by `matchPatterns()` on the thread matching the patterns with each match as
+  /// soon as it is found, together with the index of the pattern it matches, so that the matches
+  /// can be used before all of them are known.
+  std::function<void(size_t patternIndex, const PatternMatch& match)> onPatternMatchFound;
+};
+
 bool allPatternsContainSameNumberOfMagicExpressionsOrNone(const std::vector<QString>& patterns);
 
 void checkAllPatternsContainSameNumberOfMagicExpressionsOrNone(
   const std::vector<QString>& patterns);
 
-PatternMatchingResult matchPattern(
-  const QString& pattern, const std::function<void()>& onFilesystemTraversalProgress = []() {});
+/// If `progress` is not null, it is updated while the filesystem is traversed, and a
+/// CancellationException is thrown if cancellation is requested through it.
+PatternMatchingResult matchPattern(const QString& pattern,
+                                   PatternMatchingProgress* progress = nullptr);
+
+PatternMatchingResult matchPattern(const CompiledPattern& pattern,
+                                   PatternMatchingProgress* progress = nullptr);
+
+std::vector<std::shared_ptr<PatternMatchingResult>>
+matchPatterns(const std::vector<QString>& patterns, PatternMatchingProgress* progress = nullptr);
+
+/// If `searchedDirectories` is not null, it receives the sorted list of directories searched for
+/// files matching the patterns, in the form returned by `normalizedDirectory()`. Files matching
+/// the patterns can only appear or disappear through changes to these directories, so they are
+/// the ones to watch to keep the results up to date.
+///
+/// If `searchedDirectoryStamps` is not null too, it receives the stamp of each of these
+/// directories taken before it was searched, or nothing if it could not be trusted; see
+/// `changedDirectories()`.
+std::vector<std::shared_ptr<PatternMatchingResult>>
+matchPatterns(const std::vector<QString>& patterns, PatternMatchingStrategy strategy,
+              const TraversalLimits& limits = {}, PatternMatchingProgress* progress = nullptr,
+              std::vector<fs::path>* searchedDirectories = nullptr,
+              std::vector<std::optional<glob::DirectoryStamp>>* searchedDirectoryStamps = nullptr);
+
+/// Returns `directory` in the form in which searched directories are reported: lexically normal
+/// and without a trailing separator.
+fs::path normalizedDirectory(const fs::path& directory);
+
+/// Returns, in the same order, the directories of `directories` whose current stamp differs from
+/// the corresponding one in `stamps` (or cannot be trusted), i.e. that may have changed since the
+/// stamps were taken. The directories are stat'ed concurrently.
+std::vector<fs::path>
+changedDirectories(const std::vector<fs::path>& directories,
+                   const std::vector<std::optional<glob::DirectoryStamp>>& stamps);
 
-std::vector<std::shared_ptr<PatternMatchingResult>> matchPatterns(
-  const std::vector<QString>& patterns,
-  const std::function<void()>& onFilesystemTraversalProgress = []() {});
+/// Globs `patterns` like `matchPatterns()` with the Glob strategy, but only in the directories
+/// that may have changed since a previous match that searched `previousSearchedDirectories`:
+/// those in `changedDirectories` and those not searched by the previous match. Both lists must be
+/// sorted. Other directories are only searched if they lead to these, and the matches found in
+/// them are dropped, so the results hold just the current matches in the directories that may
+/// have changed.
+///
+/// `searchedDirectories` and `searchedDirectoryStamps` receive the directories searched and their
+/// stamps, like in `matchPatterns()`.
+std::vector<std::shared_ptr<PatternMatchingResult>> matchPatternsInChangedDirectories(
+  const std::vector<QString>& patterns, const TraversalLimits& limits,
+  const std::vector<fs::path>& previousSearchedDirectories,
+  const std::vector<fs::path>& changedDirectories, PatternMatchingProgress* progress,
+  std::vector<fs::path>* searchedDirectories,
+  std::vector<std::optional<glob::DirectoryStamp>>* searchedDirectoryStamps);
 
+/// `previousResults` must have been obtained with the same `limits`.
 std::vector<std::shared_ptr<PatternMatchingResult>> matchPatternsReusingPreviousResults(
   const std::vector<QString>& patterns, const std::vector<QString>& previousPatterns,
   const std::vector<std::shared_ptr<PatternMatchingResult>>& previousResults,
-  const std::function<void()>& onFilesystemTraversalProgress = []() {});
+  const TraversalLimits& limits = {}, PatternMatchingProgress* progress = nullptr);
@@ -16,7 +16,6 @@
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "PatternMatchingProgressDialog.h"
-#include "CancellationException.h"
 
 PatternMatchingProgressDialog::PatternMatchingProgressDialog(QWidget* parent)
   : QProgressDialog(parent), labelTextTemplate_("Number of files visited so far: %1")
@@ -26,6 +25,9 @@ PatternMatchingProgressDialog::PatternMatchingProgressDialog(QWidget* parent)
   setRange(0, 0);
   setLabelText(labelTextTemplate_.arg(0));
 
+  connect(this, &QProgressDialog::canceled, this,
+          [this] { progress_.cancellationRequested = true; });
+
   QTimer* timer = new QTimer(this);
   connect(timer, &QTimer::timeout, this, &PatternMatchingProgressDialog::onTimeout);
   timer->setInterval(1000);
@@ -40,15 +42,10 @@ QSize PatternMatchingProgressDialog::sizeHint() const
   return size;
 }
 
-void PatternMatchingProgressDialog::incrementProgressAndCheckForCancellation()
-{
-  ++numVisitedFiles_;
-  QCoreApplication::processEvents();
-  if (wasCanceled())
-    throw CancellationException();
-}
-
 void PatternMatchingProgressDialog::onTimeout()
 {
-  setLabelText(labelTextTemplate_.arg(numVisitedFiles_));
+  QString text = labelTextTemplate_.arg(progress_.numVisitedFiles.load());
+  if (const size_t numSkippedCycles = progress_.numSkippedCycles.load())
+    text += QString("\nSymbolic link cycles skipped: %1").arg(numSkippedCycles);
+  setLabelText(text);
 }
\ No newline at end of file
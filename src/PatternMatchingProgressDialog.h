@@ -17,6 +17,8 @@
 
 #pragma once
 
+#include "PatternMatching.h"
+
 #include <QProgressDialog>
 
 class PatternMatchingProgressDialog : public QProgressDialog
@@ -26,14 +28,14 @@ public:
 
   QSize sizeHint() const override;
 
-  /// Increment numVisitedFiles_, process events and throw an exception
-  /// if cancellation has been requested.
-  void incrementProgressAndCheckForCancellation();
+  /// Returns the progress of the pattern matching whose progress the dialog shows. The label is
+  /// refreshed from it every second, and pressing Cancel requests cancellation through it.
+  PatternMatchingProgress* progress() { return &progress_; }
 
 private slots:
   void onTimeout();
 
 private:
-  int numVisitedFiles_ = 0;
+  PatternMatchingProgress progress_;
   QString labelTextTemplate_;
 };
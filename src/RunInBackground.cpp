@@ -0,0 +1,55 @@
+// This file is part of Caméléon.
+//
+// Copyright (C) 2024 Wojciech Śmigaj
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "RunInBackground.h"
+
+#include <QtConcurrent>
+
+#include <exception>
+
+void runInBackground(const std::function<void()>& task)
+{
+  if (!QCoreApplication::instance())
+  {
+    task();
+    return;
+  }
+
+  // QtConcurrent transports only exceptions derived from QException.
+  std::exception_ptr exception;
+  QEventLoop loop;
+  QFutureWatcher<void> watcher;
+  QObject::connect(&watcher, &QFutureWatcher<void>::finished, &loop, &QEventLoop::quit);
+  watcher.setFuture(QtConcurrent::run(
+    [&task, &exception]
+    {
+      try
+      {
+        task();
+      }
+      catch (...)
+      {
+        exception = std::current_exception();
+      }
+    }));
+  if (!watcher.isFinished())
+    loop.exec();
+  watcher.waitForFinished();
+
+  if (exception)
+    std::rethrow_exception(exception);
+}
@@ -0,0 +1,26 @@
+// This file is part of Caméléon.
+//
+// Copyright (C) 2024 Wojciech Śmigaj
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <functional>
+
+/// Runs `task` on a worker thread and processes events on the calling thread until it finishes,
+/// so that the user interface stays responsive. Rethrows any exception thrown by `task`.
+///
+/// Without a QCoreApplication, `task` runs on the calling thread.
+void runInBackground(const std::function<void()>& task);
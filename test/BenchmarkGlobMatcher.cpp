@@ -0,0 +1,85 @@
+// This file is part of Caméléon.
+//
+// Copyright (C) 2024 Wojciech Śmigaj
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "BenchmarkGlobMatcher.h"
+
+#include <glob/fnmatch.h>
+
+#include <QTest>
+
+#include <regex>
+
+QTEST_MAIN(BenchmarkGlobMatcher)
+
+namespace
+{
+const size_t NUM_NAMES = 1000000;
+const std::wstring PATTERN = L"pred-*-[0-9][0-9].png";
+} // namespace
+
+void BenchmarkGlobMatcher::initTestCase()
+{
+  // Mimic a folder of evaluation outputs: one in four files is a prediction image.
+  const wchar_t* prefixes[] = {L"input-", L"gt-", L"pred-", L"log-"};
+  const wchar_t* extensions[] = {L".png", L".png", L".png", L".json"};
+  names_.reserve(NUM_NAMES);
+  for (size_t i = 0; i < NUM_NAMES; ++i)
+  {
+    const size_t kind = i % 4;
+    names_.push_back(prefixes[kind] + std::to_wstring(i / 4) + L"-" +
+                     std::to_wstring(10 + i % 90) + extensions[kind]);
+  }
+  numExpectedMatches_ = NUM_NAMES / 4;
+}
+
+void BenchmarkGlobMatcher::regexCompiledPerName()
+{
+  size_t numMatches = 0;
+  QBENCHMARK_ONCE
+  {
+    for (const std::wstring& name : names_)
+      if (std::regex_match(name, std::wregex(glob::translate(PATTERN), std::wregex::ECMAScript)))
+        ++numMatches;
+  }
+  QCOMPARE(numMatches, numExpectedMatches_);
+}
+
+void BenchmarkGlobMatcher::regexCompiledOnce()
+{
+  size_t numMatches = 0;
+  QBENCHMARK_ONCE
+  {
+    const std::wregex regex(glob::translate(PATTERN), std::wregex::ECMAScript);
+    for (const std::wstring& name : names_)
+      if (std::regex_match(name, regex))
+        ++numMatches;
+  }
+  QCOMPARE(numMatches, numExpectedMatches_);
+}
+
+void BenchmarkGlobMatcher::matcher()
+{
+  size_t numMatches = 0;
+  QBENCHMARK_ONCE
+  {
+    const glob::Matcher matcher(PATTERN);
+    for (const std::wstring& name : names_)
+      if (matcher.match(name))
+        ++numMatches;
+  }
+  QCOMPARE(numMatches, numExpectedMatches_);
+}
@@ -0,0 +1,89 @@
+// This file is part of Caméléon.
+//
+// Copyright (C) 2024 Wojciech Śmigaj
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "TestBookmarkSet.h"
+#include "BookmarkSet.h"
+
+#include <QTest>
+
+QTEST_MAIN(TestBookmarkSet)
+
+void TestBookmarkSet::insertEraseAndToggle()
+{
+  BookmarkSet set;
+  QVERIFY(set.empty());
+  set.insert(3);
+  set.insert(3);
+  set.insert(200);
+  QCOMPARE(set.size(), size_t(2));
+  QVERIFY(set.contains(3));
+  QVERIFY(set.contains(200));
+  QVERIFY(!set.contains(4));
+  QVERIFY(!set.contains(100000));
+
+  set.erase(3);
+  set.erase(5000);
+  QCOMPARE(set.size(), size_t(1));
+  QVERIFY(!set.contains(3));
+
+  set.toggle(200);
+  set.toggle(64);
+  QCOMPARE(set.size(), size_t(1));
+  QVERIFY(!set.contains(200));
+  QVERIFY(set.contains(64));
+
+  set.clear();
+  QVERIFY(set.empty());
+  QVERIFY(!set.contains(64));
+}
+
+void TestBookmarkSet::nextAndPrevious()
+{
+  const BookmarkSet set{0, 63, 64, 1000};
+  QCOMPARE(set.first(), std::optional<size_t>(0));
+  QCOMPARE(set.last(), std::optional<size_t>(1000));
+  QCOMPARE(set.next(0), std::optional<size_t>(63));
+  QCOMPARE(set.next(63), std::optional<size_t>(64));
+  QCOMPARE(set.next(64), std::optional<size_t>(1000));
+  QVERIFY(!set.next(1000));
+  QVERIFY(!set.next(5000));
+  QCOMPARE(set.previous(5000), std::optional<size_t>(1000));
+  QCOMPARE(set.previous(1000), std::optional<size_t>(64));
+  QCOMPARE(set.previous(64), std::optional<size_t>(63));
+  QCOMPARE(set.previous(63), std::optional<size_t>(0));
+  QVERIFY(!set.previous(0));
+
+  QVERIFY(!BookmarkSet().first());
+  QVERIFY(!BookmarkSet().last());
+}
+
+void TestBookmarkSet::iteration()
+{
+  const BookmarkSet set{130, 2, 65};
+  const std::vector<size_t> indices(set.begin(), set.end());
+  QCOMPARE(indices, (std::vector<size_t>{2, 65, 130}));
+  QVERIFY(BookmarkSet().begin() == BookmarkSet().end());
+}
+
+void TestBookmarkSet::comparison()
+{
+  BookmarkSet set{1, 500};
+  QVERIFY(set != BookmarkSet{1});
+  set.erase(500);
+  QVERIFY(set == BookmarkSet{1});
+  QVERIFY(BookmarkSet{1} == set);
+}
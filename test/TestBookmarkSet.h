@@ -1,6 +1,6 @@
 // This file is part of Caméléon.
 //
-// Copyright (C) 2023 Wojciech Śmigaj
+// Copyright (C) 2024 Wojciech Śmigaj
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -17,10 +17,14 @@
 
 #pragma once
 
-#include <string>
+#include <QObject>
 
-bool replaceFirstMatch(std::wstring& str, const std::wstring& from, const std::wstring& to);
-
-std::size_t replaceAllMatches(std::wstring& str, const std::wstring& from, const std::wstring& to);
-
-std::wstring wildcardPatternToRegex(const std::wstring& pattern);
\ No newline at end of file
+class TestBookmarkSet : public QObject
+{
+  Q_OBJECT
+private slots:
+  void insertEraseAndToggle();
+  void nextAndPrevious();
+  void iteration();
+  void comparison();
+};
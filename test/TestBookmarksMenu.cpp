@@ -24,6 +24,7 @@
 
 #include <QAction>
 #include <QAbstractButton>
+#include <QComboBox>
 #include <QFileDialog>
 #include <QMessageBox>
 #include <QTest>
@@ -234,6 +235,8 @@ void TestBookmarksMenu::bookmarkPage()
 
   QAction* nextInstanceAction = w.findChild<QAction*>("actionNextInstance");
   QVERIFY(nextInstanceAction != nullptr);
+  QComboBox* instanceComboBox = w.findChild<QComboBox*>("instanceComboBox");
+  QVERIFY(instanceComboBox != nullptr);
 
   std::shared_ptr<bool> asyncSuccess = std::make_shared<bool>(false);
 
@@ -248,14 +251,22 @@ void TestBookmarksMenu::bookmarkPage()
   openAction->trigger();
   QVERIFY(*asyncSuccess);
 
+  QCOMPARE(instanceComboBox->count(), 5);
+  QCOMPARE(instanceComboBox->itemText(1), "blue");
+  QVERIFY(!instanceComboBox->itemData(1, Qt::ForegroundRole).isValid());
+
   nextInstanceAction->trigger();
   bookmarkPageAction->trigger();
   QVERIFY(bookmarkPageAction->isChecked());
-  QVERIFY(w.document()->bookmarks() == std::set<size_t>{1});
+  QVERIFY(w.document()->bookmarks() == BookmarkSet{1});
+  QCOMPARE(instanceComboBox->itemData(1, Qt::ForegroundRole).value<QBrush>().color(),
+           QColor(Qt::blue));
+  QVERIFY(!instanceComboBox->itemData(0, Qt::ForegroundRole).isValid());
 
   bookmarkPageAction->trigger();
   QVERIFY(!bookmarkPageAction->isChecked());
   QVERIFY(w.document()->bookmarks().empty());
+  QVERIFY(!instanceComboBox->itemData(1, Qt::ForegroundRole).isValid());
 }
 
 void TestBookmarksMenu::removeAllBookmarks_cancelRemoval()
@@ -292,7 +303,7 @@ void TestBookmarksMenu::removeAllBookmarks_cancelRemoval()
   bookmarkPageAction->trigger();
   nextInstanceAction->trigger();
   bookmarkPageAction->trigger();
-  QVERIFY(w.document()->bookmarks() == std::set<size_t>({1, 2}));
+  QVERIFY(w.document()->bookmarks() == BookmarkSet({1, 2}));
 
   QTimer::singleShot(0,
                      [asyncSuccess]
@@ -304,7 +315,7 @@ void TestBookmarksMenu::removeAllBookmarks_cancelRemoval()
                        btn->click();
                      });
   removeAllBookmarksPageAction->trigger();
-  QVERIFY(w.document()->bookmarks() == std::set<size_t>({1, 2}));
+  QVERIFY(w.document()->bookmarks() == BookmarkSet({1, 2}));
 }
 
 void TestBookmarksMenu::removeAllBookmarks_okRemoval()
@@ -341,7 +352,7 @@ void TestBookmarksMenu::removeAllBookmarks_okRemoval()
   bookmarkPageAction->trigger();
   nextInstanceAction->trigger();
   bookmarkPageAction->trigger();
-  QVERIFY(w.document()->bookmarks() == std::set<size_t>({1, 2}));
+  QVERIFY(w.document()->bookmarks() == BookmarkSet({1, 2}));
 
   QTimer::singleShot(0,
                      [asyncSuccess]
@@ -400,7 +411,7 @@ void TestBookmarksMenu::exportAndImport()
   bookmarkPageAction->trigger();
   nextInstanceAction->trigger();
   bookmarkPageAction->trigger();
-  QVERIFY(w.document()->bookmarks() == std::set<size_t>({1, 2, 3}));
+  QVERIFY(w.document()->bookmarks() == BookmarkSet({1, 2, 3}));
 
   QTimer::singleShot(0,
                      [asyncSuccess, tempDir]
@@ -429,7 +440,7 @@ void TestBookmarksMenu::exportAndImport()
   bookmarkPageAction->trigger();
   previousInstanceAction->trigger();
   bookmarkPageAction->trigger();
-  QVERIFY(w.document()->bookmarks() == std::set<size_t>({1, 4}));
+  QVERIFY(w.document()->bookmarks() == BookmarkSet({1, 4}));
 
   QTimer::singleShot(0,
                      [asyncSuccess, tempDir]
@@ -451,5 +462,5 @@ void TestBookmarksMenu::exportAndImport()
                          });
                      });
   importBookmarksAction->trigger();
-  QVERIFY(w.document()->bookmarks() == std::set<size_t>({1, 2, 3, 4}));
-}
\ No newline at end of file
+  QVERIFY(w.document()->bookmarks() == BookmarkSet({1, 2, 3, 4}));
+}
@@ -0,0 +1,116 @@
+// This file is part of Caméléon.
+//
+// Copyright (C) 2024 Wojciech Śmigaj
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "TestDirectoryListingCache.h"
+#include "DirectoryListingCache.h"
+
+#include <QFile>
+#include <QTest>
+
+QTEST_MAIN(TestDirectoryListingCache)
+
+namespace
+{
+const glob::DirectoryStamp STAMP{1, 2, 3000000000, 4000000000};
+
+std::vector<glob::CachedEntry> entries(const std::vector<std::string>& names)
+{
+  std::vector<glob::CachedEntry> result;
+  for (const std::string& name : names)
+    result.push_back({fs::path(name).native(), fs::file_type::regular});
+  return result;
+}
+
+std::vector<std::string> names(const std::shared_ptr<const std::vector<glob::CachedEntry>>& entries)
+{
+  std::vector<std::string> result;
+  if (entries)
+    for (const glob::CachedEntry& entry : *entries)
+      result.push_back(fs::path(entry.name).string());
+  return result;
+}
+} // namespace
+
+void TestDirectoryListingCache::init()
+{
+  tempDir_ = std::make_unique<QTemporaryDir>();
+  QVERIFY(tempDir_->isValid());
+}
+
+QString TestDirectoryListingCache::cachePath() const
+{
+  return tempDir_->filePath("listings.bin");
+}
+
+void TestDirectoryListingCache::listingIsFoundOnlyWithSameStamp()
+{
+  DirectoryListingCache cache(cachePath(), 100);
+  QVERIFY(!cache.find("/a", STAMP));
+  cache.store("/a", STAMP, entries({"b.png", "c"}));
+  QCOMPARE(names(cache.find("/a", STAMP)), (std::vector<std::string>{"b.png", "c"}));
+
+  glob::DirectoryStamp modifiedStamp = STAMP;
+  ++modifiedStamp.modification_time;
+  QVERIFY(!cache.find("/a", modifiedStamp));
+  QVERIFY(!cache.find("/b", STAMP));
+}
+
+void TestDirectoryListingCache::listingsPersistAcrossInstances()
+{
+  {
+    DirectoryListingCache cache(cachePath(), 100);
+    cache.store("/a", STAMP, entries({"b.png", "c"}));
+    cache.store("/a/c", STAMP, entries({}));
+    cache.save();
+  }
+  DirectoryListingCache cache(cachePath(), 100);
+  QCOMPARE(names(cache.find("/a", STAMP)), (std::vector<std::string>{"b.png", "c"}));
+  QVERIFY(cache.find("/a/c", STAMP));
+  QCOMPARE(cache.numListings(), size_t(2));
+}
+
+void TestDirectoryListingCache::clearRemovesListingsAndFile()
+{
+  DirectoryListingCache cache(cachePath(), 100);
+  cache.store("/a", STAMP, entries({"b.png"}));
+  cache.save();
+  QVERIFY(QFile::exists(cachePath()));
+
+  cache.clear();
+  QCOMPARE(cache.numListings(), size_t(0));
+  QVERIFY(!QFile::exists(cachePath()));
+  QVERIFY(!DirectoryListingCache(cachePath(), 100).find("/a", STAMP));
+}
+
+void TestDirectoryListingCache::leastRecentlyUsedListingsAreEvicted()
+{
+  {
+    DirectoryListingCache cache(cachePath(), 4);
+    cache.store("/a", STAMP, entries({"1", "2"}));
+    cache.store("/b", STAMP, entries({"1", "2"}));
+    QVERIFY(cache.find("/a", STAMP));
+    // The cap is enforced as soon as it is exceeded, not just when saving.
+    cache.store("/c", STAMP, entries({"1"}));
+    QCOMPARE(cache.numListings(), size_t(2));
+    QVERIFY(!cache.find("/b", STAMP));
+    cache.save();
+  }
+  DirectoryListingCache cache(cachePath(), 4);
+  QVERIFY(cache.find("/a", STAMP));
+  QVERIFY(!cache.find("/b", STAMP));
+  QVERIFY(cache.find("/c", STAMP));
+}
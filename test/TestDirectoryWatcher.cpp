@@ -0,0 +1,101 @@
+// This file is part of Caméléon.
+//
+// Copyright (C) 2024 Wojciech Śmigaj
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "TestDirectoryWatcher.h"
+#include "DirectoryWatcher.h"
+
+#include <QSignalSpy>
+#include <QTemporaryDir>
+#include <QTest>
+
+#include <fstream>
+
+QTEST_MAIN(TestDirectoryWatcher)
+
+namespace
+{
+const int NOTIFICATION_DELAY_MS = 100;
+const int TIMEOUT_MS = 5000;
+} // namespace
+
+void TestDirectoryWatcher::changedDirectoriesAreReported()
+{
+  QTemporaryDir tempDir;
+  QVERIFY(tempDir.isValid());
+  const fs::path root = tempDir.path().toStdWString();
+  fs::create_directories(root / "a");
+  fs::create_directories(root / "b");
+
+  DirectoryWatcher watcher(16, NOTIFICATION_DELAY_MS);
+  QCOMPARE(watcher.setDirectories({root / "a", root / "b"}), size_t(0));
+  QCOMPARE(watcher.numDirectories(), size_t(2));
+  QSignalSpy spy(&watcher, &DirectoryWatcher::directoriesChanged);
+
+  // A burst of changes is reported once, together with the directories affected.
+  std::ofstream(root / "b" / "1.png");
+  std::ofstream(root / "b" / "2.png");
+  QVERIFY(spy.wait(TIMEOUT_MS));
+  QTest::qWait(2 * NOTIFICATION_DELAY_MS);
+  QCOMPARE(spy.count(), 1);
+  QCOMPARE(watcher.takeChangedDirectories(), std::vector<fs::path>{root / "b"});
+  QVERIFY(watcher.takeChangedDirectories().empty());
+
+  // Directories no longer needed are not watched any more.
+  QCOMPARE(watcher.setDirectories({root / "a"}), size_t(0));
+  QCOMPARE(watcher.numDirectories(), size_t(1));
+  fs::remove(root / "b" / "1.png");
+  fs::create_directory(root / "a" / "c");
+  QVERIFY(spy.wait(TIMEOUT_MS));
+  QCOMPARE(watcher.takeChangedDirectories(), std::vector<fs::path>{root / "a"});
+}
+
+void TestDirectoryWatcher::deepestDirectoriesArePreferred()
+{
+  QTemporaryDir tempDir;
+  QVERIFY(tempDir.isValid());
+  const fs::path root = tempDir.path().toStdWString();
+  fs::create_directories(root / "a" / "b");
+
+  DirectoryWatcher watcher(1, NOTIFICATION_DELAY_MS);
+  QCOMPARE(watcher.setDirectories({root / "a", root / "a" / "b"}), size_t(1));
+  QCOMPARE(watcher.numDirectories(), size_t(1));
+  QSignalSpy spy(&watcher, &DirectoryWatcher::directoriesChanged);
+
+  std::ofstream(root / "a" / "b" / "1.png");
+  QVERIFY(spy.wait(TIMEOUT_MS));
+  QCOMPARE(watcher.takeChangedDirectories(), std::vector<fs::path>{root / "a" / "b"});
+}
+
+void TestDirectoryWatcher::clearDiscardsChanges()
+{
+  QTemporaryDir tempDir;
+  QVERIFY(tempDir.isValid());
+  const fs::path root = tempDir.path().toStdWString();
+
+  const int notificationDelay = 10 * NOTIFICATION_DELAY_MS;
+  DirectoryWatcher watcher(16, notificationDelay);
+  QCOMPARE(watcher.setDirectories({root}), size_t(0));
+  QSignalSpy spy(&watcher, &DirectoryWatcher::directoriesChanged);
+
+  // Clear the watcher after the change has been noticed, but before it is reported.
+  std::ofstream(root / "1.png");
+  QTest::qWait(NOTIFICATION_DELAY_MS);
+  watcher.clear();
+  QCOMPARE(watcher.numDirectories(), size_t(0));
+  QVERIFY(!spy.wait(2 * notificationDelay));
+  QVERIFY(watcher.takeChangedDirectories().empty());
+}
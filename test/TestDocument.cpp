@@ -0,0 +1,244 @@
+// This file is part of Caméléon.
+//
+// Copyright (C) 2024 Wojciech Śmigaj
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "TestDocument.h"
+#include "Document.h"
+#include "RuntimeError.h"
+#include "TestDataDir.h"
+
+#include <QDir>
+#include <QFile>
+#include <QSignalSpy>
+#include <QTemporaryDir>
+#include <QTest>
+#include <QTextStream>
+
+#include <fstream>
+
+QTEST_MAIN(TestDocument)
+
+void TestDocument::bulkBookmarks()
+{
+  Document doc(TEST_DATA_DIR "/colours.cml");
+  QCOMPARE(doc.instances().size(), size_t(5));
+  QSignalSpy spy(&doc, &Document::modificationStatusChanged);
+
+  QCOMPARE(doc.addBookmarks(BookmarkSet{0, 2, 4}), size_t(3));
+  QCOMPARE(doc.addBookmarks(BookmarkSet{2, 3}), size_t(1));
+  QCOMPARE(doc.addBookmarks(BookmarkSet{2}), size_t(0));
+  QCOMPARE(doc.removeBookmarks(BookmarkSet{0, 1}), size_t(1));
+  QCOMPARE(spy.count(), 3);
+  QVERIFY(doc.bookmarks() == BookmarkSet({2, 3, 4}));
+  QVERIFY_EXCEPTION_THROWN(doc.addBookmarks(BookmarkSet{5}), RuntimeError);
+
+  QString exported;
+  {
+    QTextStream stream(&exported);
+    doc.exportBookmarks(stream);
+  }
+  QCOMPARE(exported, QString("green\nmagenta\nred\n"));
+
+  doc.setBookmarks(BookmarkSet{0});
+  QCOMPARE(spy.count(), 4);
+  QTextStream stream(&exported);
+  const BookmarkSet importedBookmarks = doc.importBookmarks(stream);
+  QVERIFY(importedBookmarks == BookmarkSet({2, 3, 4}));
+  QVERIFY(doc.bookmarks() == BookmarkSet({0, 2, 3, 4}));
+  QCOMPARE(spy.count(), 5);
+}
+
+void TestDocument::importBookmarksWithDotsInKeys()
+{
+  QTemporaryDir tempDir;
+  QVERIFY(tempDir.isValid());
+  const fs::path root = tempDir.path().toStdWString();
+  for (const char* name : {"x-1.png", "y.-2.png", "z...-3.png"})
+    std::ofstream(root / name);
+
+  Document doc;
+  doc.setPatterns({QDir::toNativeSeparators(tempDir.path() + "/*-*.png")});
+  QCOMPARE(doc.instances().size(), size_t(3));
+  QCOMPARE(doc.instanceKey(1), QString("y....2"));
+  QCOMPARE(doc.instanceKey(2), QString("z......3"));
+
+  // Blank lines, keys with too few parts and keys of no instance are ignored.
+  QString keys("y....2\n\nz......3\nx\nw...9\nx...1\n");
+  QTextStream stream(&keys);
+  const BookmarkSet importedBookmarks = doc.importBookmarks(stream);
+  QVERIFY(importedBookmarks == BookmarkSet({0, 1, 2}));
+  QVERIFY(doc.bookmarks() == BookmarkSet({0, 1, 2}));
+
+  QCOMPARE(doc.findInstanceWithKey("z......3"), std::optional<size_t>(2));
+  QCOMPARE(doc.findInstanceWithKey("x...1"), std::optional<size_t>(0));
+  QCOMPARE(doc.findInstanceWithKey("x"), std::nullopt);
+}
+
+void TestDocument::openProgressively()
+{
+  QTemporaryDir tempDir;
+  QVERIFY(tempDir.isValid());
+  const QString docPath = tempDir.filePath("colours.cml");
+  {
+    QFile file(docPath);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write(R"({
+      "bookmarks": [["green"], ["red"], ["white"]],
+      "patterns": [")" TEST_DATA_DIR R"(/*/checkerboard.png",
+                   ")" TEST_DATA_DIR R"(/*/inverted_checkerboard.png"],
+      "layout": {"columns": 2, "rows": 1},
+      "version": 1
+    })");
+  }
+
+  Document doc(docPath, nullptr, true /*deferPatternMatching*/);
+  QVERIFY(doc.instances().empty());
+  QVERIFY(!doc.isDiscoveringInstances());
+  // The bookmarks are kept until the instances they refer to are found.
+  const std::set<std::vector<QString>> expectedBookmarkKeys{{"green"}, {"red"}, {"white"}};
+  QCOMPARE(doc.bookmarkKeys(), expectedBookmarkKeys);
+
+  doc.startInstanceDiscovery();
+  QVERIFY(doc.isDiscoveringInstances());
+  QTRY_VERIFY(doc.addDiscoveredInstances());
+  QVERIFY(!doc.isDiscoveringInstances());
+
+  QCOMPARE(doc.instances().size(), size_t(5));
+  QCOMPARE(doc.instanceKey(0), QString("black"));
+  QCOMPARE(doc.instanceKey(4), QString("red"));
+  // No instance matches "white", so its bookmark is dropped once the instances are all known.
+  QCOMPARE(doc.bookmarks(), (BookmarkSet{2, 4}));
+  QCOMPARE(doc.bookmarkKeys(), (std::set<std::vector<QString>>{{"green"}, {"red"}}));
+}
+
+void TestDocument::regenerateInstancesAfterChanges()
+{
+  QTemporaryDir tempDir;
+  QVERIFY(tempDir.isValid());
+  const fs::path root = tempDir.path().toStdWString();
+  for (const char* dir : {"a", "b"})
+    fs::create_directory(root / dir);
+  for (const char* name : {"a/1.png", "b/1.png", "b/2.png"})
+    std::ofstream(root / name);
+
+  Document doc;
+  doc.setPatterns({QDir::toNativeSeparators(tempDir.path() + "/*/*.png")});
+  QCOMPARE(doc.instances().size(), size_t(3));
+  QVERIFY(!doc.regenerateInstances());
+  QVERIFY(!doc.searchedDirectories().empty());
+  doc.setBookmarks(BookmarkSet{0, 1, 2});
+
+  // Only the instances with files in the changed directories are updated.
+  fs::remove(root / "b/1.png");
+  fs::create_directory(root / "c");
+  for (const char* name : {"a/0.png", "c/1.png"})
+    std::ofstream(root / name);
+  QVERIFY(doc.regenerateInstances());
+  QCOMPARE(doc.instances().size(), size_t(4));
+  QCOMPARE(doc.instanceKey(0), QString("a...0"));
+  QCOMPARE(doc.instanceKey(1), QString("a...1"));
+  QCOMPARE(doc.instanceKey(2), QString("b...2"));
+  QCOMPARE(doc.instanceKey(3), QString("c...1"));
+  QCOMPARE(doc.instances().path(3, 0),
+           QString::fromStdWString((root / "c" / "1.png").wstring()));
+  QVERIFY(doc.bookmarks() == BookmarkSet({1, 2}));
+
+  QVERIFY(!doc.regenerateInstances());
+  QCOMPARE(doc.instances().size(), size_t(4));
+}
+
+void TestDocument::regenerateInstancesAfterPatternBaseCreation()
+{
+  QTemporaryDir tempDir;
+  QVERIFY(tempDir.isValid());
+  const fs::path root = tempDir.path().toStdWString();
+  fs::create_directories(root / "runs/a/1");
+  std::ofstream(root / "runs/a/1/pred.png");
+
+  Document doc;
+  doc.setPatterns({QDir::toNativeSeparators(tempDir.path() + "/runs/a/*/pred.png"),
+                   QDir::toNativeSeparators(tempDir.path() + "/runs/b/*/gt.png")});
+  QCOMPARE(doc.instances().size(), size_t(1));
+  QVERIFY(!doc.regenerateInstances());
+  // The base of the second pattern does not exist, so the directory where it would be created
+  // is searched in its place.
+  QVERIFY(std::binary_search(doc.searchedDirectories().begin(),
+                             doc.searchedDirectories().end(), root / "runs"));
+  QVERIFY(!std::binary_search(doc.searchedDirectories().begin(),
+                              doc.searchedDirectories().end(), root / "runs/b"));
+
+  fs::create_directories(root / "runs/b/1");
+  std::ofstream(root / "runs/b/1/gt.png");
+  QVERIFY(doc.regenerateInstances());
+  QCOMPARE(doc.instances().size(), size_t(1));
+  QCOMPARE(doc.instances().path(0, 1),
+           QString::fromStdWString((root / "runs" / "b" / "1" / "gt.png").wstring()));
+  QVERIFY(std::binary_search(doc.searchedDirectories().begin(),
+                             doc.searchedDirectories().end(), root / "runs/b"));
+}
+
+void TestDocument::updateInstancesInChangedDirectories()
+{
+  QTemporaryDir tempDir;
+  QVERIFY(tempDir.isValid());
+  const fs::path root = tempDir.path().toStdWString();
+  for (const char* dir : {"a", "b"})
+    fs::create_directory(root / dir);
+  for (const char* name : {"a/1.png", "b/1.png", "b/2.png"})
+    std::ofstream(root / name);
+
+  Document doc;
+  doc.setPatterns({QDir::toNativeSeparators(tempDir.path() + "/*/*.png")});
+  QVERIFY(!doc.canUpdateInstancesIncrementally());
+  doc.regenerateInstances();
+  QVERIFY(doc.canUpdateInstancesIncrementally());
+  doc.setBookmarks(BookmarkSet{0, 2});
+
+  // Files are added to b/ and a new directory; a/ is not searched, so its new file is missed.
+  std::ofstream(root / "a/0.png");
+  std::ofstream(root / "b/3.png");
+  fs::remove(root / "b/1.png");
+  fs::create_directory(root / "c");
+  std::ofstream(root / "c/1.png");
+  QSignalSpy spy(&doc, &Document::instanceUpdateFinished);
+  doc.startInstanceUpdate({root / "b", root, root / "b/"});
+  QVERIFY(doc.isUpdatingInstances());
+  QVERIFY(spy.wait());
+
+  std::vector<size_t> erasedIndices;
+  std::vector<size_t> insertedIndices;
+  QVERIFY(doc.finishInstanceUpdate(&erasedIndices, &insertedIndices));
+  QVERIFY(!doc.isUpdatingInstances());
+  QCOMPARE(erasedIndices, std::vector<size_t>{1});
+  QCOMPARE(insertedIndices, (std::vector<size_t>{2, 3}));
+  QCOMPARE(doc.instances().size(), size_t(4));
+  QCOMPARE(doc.instanceKey(0), QString("a...1"));
+  QCOMPARE(doc.instanceKey(1), QString("b...2"));
+  QCOMPARE(doc.instanceKey(2), QString("b...3"));
+  QCOMPARE(doc.instanceKey(3), QString("c...1"));
+  QVERIFY(doc.bookmarks() == BookmarkSet({0, 1}));
+
+  // The new directory is searched from now on.
+  QVERIFY(std::binary_search(doc.searchedDirectories().begin(),
+                             doc.searchedDirectories().end(), root / "c"));
+
+  // Changing the patterns discards an update in progress.
+  doc.startInstanceUpdate({root / "a"});
+  doc.setPatterns({QDir::toNativeSeparators(tempDir.path() + "/*/1.png")});
+  QVERIFY(!doc.isUpdatingInstances());
+  QVERIFY(!doc.canUpdateInstancesIncrementally());
+  QCOMPARE(doc.instances().size(), size_t(2));
+}
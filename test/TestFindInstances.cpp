@@ -164,6 +164,85 @@ void TestFindInstances::threePatternsEachWithTwoWildcards()
   runTest(patterns, objects, expectedInstances);
 }
 
+void TestFindInstances::incrementalInstanceFinder()
+{
+  QTemporaryDir tempDir;
+  QVERIFY(tempDir.isValid());
+  const fs::path tempDirPath = tempDir.path().toStdWString();
+  createFilesystemObjects(tempDirPath, {"p1/ab1/c1.png", "p1/ab1/c2.png", "p1/ab23/c1.png",
+                                        "p2/1ab/c1.png", "p2/1ab/c3.png", "p2/23ab/c1.png",
+                                        "p3/common.png"});
+  const std::vector<QString> patterns{tempDir.path() + "/p1/ab*/*.png",
+                                      tempDir.path() + "/p2/*ab/*.png",
+                                      tempDir.path() + "/p3/common.png"};
+
+  // Only the instances with files matching both patterns with wildcards are complete before
+  // matching ends.
+  IncrementalInstanceFinder finder({2, 2, 0});
+  std::vector<Instance> completeInstances;
+  PatternMatchingProgress progress;
+  progress.onPatternMatchFound = [&](size_t patternIndex, const PatternMatch& match)
+  {
+    if (std::optional<Instance> instance = finder.addPatternMatch(patternIndex, match))
+      completeInstances.push_back(std::move(*instance));
+  };
+  const std::vector<Instance> instances =
+    ::findInstances(matchPatterns(patterns, PatternMatchingStrategy::Glob, {}, &progress));
+  ::sortInstances(completeInstances);
+
+  QCOMPARE(instances.size(), size_t(4));
+  QCOMPARE(completeInstances.size(), size_t(2));
+  QCOMPARE(completeInstances[0], instances[0]); // 1, c1
+  QCOMPARE(completeInstances[1], instances[3]); // 23, c1
+  QVERIFY(!completeInstances[0].paths[2].isEmpty());
+}
+
+void TestFindInstances::sortInstances()
+{
+  std::vector<Instance> instances{
+    {{"1"}, {"b10", "x"}}, {{"2"}, {"a"}}, {{"3"}, {"B2", "y"}}, {{"4"}, {"A"}},
+    {{"5"}, {"b2", "x"}}};
+  ::sortInstances(instances);
+  // Numbers are compared numerically and letters case-insensitively; matches differing only in
+  // case are ordered by code points.
+  const std::vector<Instance> expectedInstances{
+    {{"4"}, {"A"}}, {{"2"}, {"a"}}, {{"5"}, {"b2", "x"}}, {{"3"}, {"B2", "y"}},
+    {{"1"}, {"b10", "x"}}};
+  QCOMPARE(instances, expectedInstances);
+}
+
+void TestFindInstances::manyPatternMatches()
+{
+  // Enough matches to be split among several partitions; half of the instances lack a file
+  // matching the second pattern, and the third pattern has no wildcards.
+  const size_t numInstances = 100000;
+  std::vector<std::shared_ptr<PatternMatchingResult>> results;
+  for (size_t iPattern = 0; iPattern < 3; ++iPattern)
+  {
+    auto result = std::make_shared<PatternMatchingResult>();
+    result->numMagicExpressions = iPattern < 2 ? 1 : 0;
+    results.push_back(result);
+  }
+  for (size_t i = numInstances; i-- > 0;)
+  {
+    const std::wstring match = std::to_wstring(i);
+    results[0]->patternMatches.push_back(PatternMatch{L"a" + match, {match}});
+    if (i % 2 == 0)
+      results[1]->patternMatches.push_back(PatternMatch{L"b" + match, {match}});
+  }
+  results[2]->patternMatches.push_back(PatternMatch{L"c", {}});
+
+  const std::vector<Instance> instances = ::findInstances(results);
+  QCOMPARE(instances.size(), numInstances);
+  for (size_t i = 0; i < numInstances; ++i)
+  {
+    const QString match = QString::number(i);
+    const Instance expectedInstance{
+      {"a" + match, i % 2 == 0 ? "b" + match : QString(), "c"}, {match}};
+    QCOMPARE(instances[i], expectedInstance);
+  }
+}
+
 void TestFindInstances::runTest(std::vector<QString> patterns, const std::vector<fs::path>& objects,
                                 std::optional<std::vector<Instance>> expectedInstances)
 {
@@ -35,6 +35,9 @@ private slots:
   void twoPatternsOneWithZeroWildcardsAnotherWithTwo();
   void twoPatternsOneWithOneWildcardAnotherWithTwo();
   void threePatternsEachWithTwoWildcards();
+  void incrementalInstanceFinder();
+  void sortInstances();
+  void manyPatternMatches();
 
 private:
   void runTest(std::vector<QString> pattern, const std::vector<fs::path>& objects,
@@ -0,0 +1,121 @@
+// This file is part of Caméléon.
+//
+// Copyright (C) 2024 Wojciech Śmigaj
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "TestGlobMatcher.h"
+
+#include <glob/fnmatch.h>
+
+#include <QString>
+#include <QTest>
+
+#include <regex>
+
+QTEST_MAIN(TestGlobMatcher)
+
+void TestGlobMatcher::match_data()
+{
+  QTest::addColumn<QString>("pattern");
+  QTest::addColumn<QString>("name");
+  QTest::addColumn<bool>("expected");
+
+  QTest::newRow("literal") << "abc.png" << "abc.png" << true;
+  QTest::newRow("literal, different name") << "abc.png" << "abd.png" << false;
+  QTest::newRow("literal, longer name") << "abc.png" << "abc.png2" << false;
+  QTest::newRow("empty pattern, empty name") << "" << "" << true;
+  QTest::newRow("empty pattern") << "" << "a" << false;
+  QTest::newRow("star, empty name") << "*" << "" << true;
+  QTest::newRow("star") << "*" << "anything" << true;
+  QTest::newRow("star suffix") << "*.png" << "pred-1.png" << true;
+  QTest::newRow("star suffix, empty run") << "*.png" << ".png" << true;
+  QTest::newRow("star suffix, mismatch") << "*.png" << "pred-1.jpg" << false;
+  QTest::newRow("star prefix") << "pred-*" << "pred-1.png" << true;
+  QTest::newRow("star in the middle") << "pred-*.png" << "pred-0042.png" << true;
+  QTest::newRow("overlapping prefix and suffix") << "ab*ba" << "aba" << false;
+  QTest::newRow("several stars") << "*-*-*.png" << "a-b-c.png" << true;
+  QTest::newRow("several stars, repeated separator") << "*-*-*.png" << "a--.png" << true;
+  QTest::newRow("several stars, too few separators") << "*-*-*.png" << "a-b.png" << false;
+  QTest::newRow("consecutive stars") << "a**b" << "axyzb" << true;
+  QTest::newRow("question mark") << "?.png" << "a.png" << true;
+  QTest::newRow("question mark, empty") << "?.png" << ".png" << false;
+  QTest::newRow("question marks") << "a??b" << "a12b" << true;
+  QTest::newRow("question marks, too short") << "a??b" << "a1b" << false;
+  QTest::newRow("class") << "[abc]x" << "bx" << true;
+  QTest::newRow("class, mismatch") << "[abc]x" << "dx" << false;
+  QTest::newRow("class range") << "img[0-9].png" << "img7.png" << true;
+  QTest::newRow("class range, mismatch") << "img[0-9].png" << "imgx.png" << false;
+  QTest::newRow("negated class") << "[!abc]x" << "dx" << true;
+  QTest::newRow("negated class, mismatch") << "[!abc]x" << "ax" << false;
+  QTest::newRow("closing bracket first") << "[]]" << "]" << true;
+  QTest::newRow("negated closing bracket first") << "[!]]" << "a" << true;
+  QTest::newRow("trailing hyphen") << "[a-]" << "-" << true;
+  QTest::newRow("reversed range") << "[z-a]" << "m" << false;
+  QTest::newRow("unterminated class") << "[ab" << "[ab" << true;
+  QTest::newRow("non-Latin-1 class") << QString("[Ā-ſ]") << QString("Ś") << true;
+  QTest::newRow("non-Latin-1 class, mismatch")
+    << QString("[Ā-ſ]") << QString("ƀ") << false;
+  QTest::newRow("star, class and question mark") << "*[0-9]?.png" << "run-17.png" << true;
+  QTest::newRow("star after segment that occurs twice") << "*ab*ab" << "xabyab" << true;
+}
+
+void TestGlobMatcher::match()
+{
+  QFETCH(QString, pattern);
+  QFETCH(QString, name);
+  QFETCH(bool, expected);
+
+  const glob::Matcher matcher(pattern.toStdWString());
+  QCOMPARE(matcher.match(name.toStdWString()), expected);
+}
+
+void TestGlobMatcher::agreesWithRegex_data()
+{
+  QTest::addColumn<QString>("pattern");
+
+  QTest::newRow("star") << "*";
+  QTest::newRow("star suffix") << "*.png";
+  QTest::newRow("several stars") << "*a*b*";
+  QTest::newRow("question marks and stars") << "?a*?b";
+  QTest::newRow("class and star") << "[a-b]*[!a]";
+  QTest::newRow("literal") << "ab.a";
+}
+
+void TestGlobMatcher::agreesWithRegex()
+{
+  QFETCH(QString, pattern);
+
+  const std::wstring patternAsStdWString = pattern.toStdWString();
+  const std::wregex regex(glob::translate(patternAsStdWString));
+  const glob::Matcher matcher(patternAsStdWString);
+
+  // Compare the two on all names of up to 5 characters drawn from a small alphabet.
+  const std::wstring alphabet = L"ab.";
+  std::vector<std::wstring> names{L""};
+  for (size_t begin = 0, length = 0; length < 5; ++length)
+  {
+    const size_t end = names.size();
+    for (size_t i = begin; i < end; ++i)
+      for (wchar_t c : alphabet)
+        names.push_back(names[i] + c);
+    begin = end;
+  }
+
+  for (const std::wstring& name : names)
+  {
+    QVERIFY2(matcher.match(name) == std::regex_match(name, regex),
+             qPrintable(QString::fromStdWString(name)));
+  }
+}
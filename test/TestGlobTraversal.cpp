@@ -0,0 +1,375 @@
+// This file is part of Caméléon.
+//
+// Copyright (C) 2024 Wojciech Śmigaj
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "TestGlobTraversal.h"
+
+#include <glob/batch_status.h>
+#include <glob/glob.h>
+#include <glob/listing_cache.h>
+
+#include <QDir>
+#include <QString>
+#include <QTest>
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+
+QTEST_MAIN(TestGlobTraversal)
+
+namespace
+{
+std::vector<std::wstring> paths(const std::vector<glob::PathInfo>& infos)
+{
+  std::vector<std::wstring> result;
+  for (const glob::PathInfo& info : infos)
+    result.push_back(info.path.wstring());
+  return result;
+}
+
+// Serves a made-up listing of one directory and stores nothing.
+class FakeListingCache : public glob::ListingCache
+{
+public:
+  FakeListingCache(fs::path directory, std::vector<glob::CachedEntry> entries)
+    : directory_(std::move(directory)),
+      entries_(std::make_shared<const std::vector<glob::CachedEntry>>(std::move(entries)))
+  {
+  }
+
+  std::shared_ptr<const std::vector<glob::CachedEntry>>
+  find(const fs::path& directory, const glob::DirectoryStamp&) override
+  {
+    return directory == directory_ ? entries_ : nullptr;
+  }
+
+  void store(const fs::path&, const glob::DirectoryStamp&, std::vector<glob::CachedEntry>) override
+  {
+  }
+
+private:
+  fs::path directory_;
+  std::shared_ptr<const std::vector<glob::CachedEntry>> entries_;
+};
+} // namespace
+
+void TestGlobTraversal::initTestCase()
+{
+  QVERIFY(tempDir_.isValid());
+  const fs::path root = tempDir_.path().toStdWString();
+  for (int i = 0; i < 5; ++i)
+    for (int j = 0; j < 5; ++j)
+    {
+      const fs::path dir = root / ("d" + std::to_string(i)) / ("e" + std::to_string(j));
+      fs::create_directories(dir / "f");
+      fs::create_directories(dir / ".hidden");
+      for (int k = 0; k < 3; ++k)
+      {
+        std::ofstream(dir / ("img" + std::to_string(k) + ".png"));
+        std::ofstream(dir / "f" / ("img" + std::to_string(k) + ".png"));
+        std::ofstream(dir / ".hidden" / ("img" + std::to_string(k) + ".png"));
+      }
+    }
+}
+
+QString TestGlobTraversal::rootDir() const
+{
+  return tempDir_.path();
+}
+
+void TestGlobTraversal::parallelTraversalMatchesSequentialTraversal_data()
+{
+  QTest::addColumn<QString>("pattern");
+
+  QTest::newRow("files") << "/**/*.png";
+  QTest::newRow("directories") << "/**/";
+  QTest::newRow("everything") << "/**";
+  QTest::newRow("two recursive wildcards") << "/d1/**/e2/**/*.png";
+}
+
+void TestGlobTraversal::parallelTraversalMatchesSequentialTraversal()
+{
+  QFETCH(QString, pattern);
+  const glob::Pattern globPattern((rootDir() + pattern).toStdWString(), true /*recursive*/);
+
+  size_t numSequentialProgressCalls = 0;
+  glob::TraversalOptions sequentialOptions;
+  sequentialOptions.max_concurrency = 1;
+  const std::vector<std::wstring> expected = paths(glob::glob(
+    globPattern, [&numSequentialProgressCalls] { ++numSequentialProgressCalls; },
+    sequentialOptions));
+  QVERIFY(!expected.empty());
+
+  size_t numParallelProgressCalls = 0;
+  glob::TraversalOptions parallelOptions;
+  parallelOptions.max_concurrency = 8;
+  const std::vector<std::wstring> actual = paths(glob::glob(
+    globPattern, [&numParallelProgressCalls] { ++numParallelProgressCalls; }, parallelOptions));
+
+  QVERIFY(actual == expected);
+  QCOMPARE(numParallelProgressCalls, numSequentialProgressCalls);
+}
+
+void TestGlobTraversal::cancellation()
+{
+  const glob::Pattern globPattern((rootDir() + "/**/*.png").toStdWString(), true /*recursive*/);
+  glob::TraversalOptions options;
+  options.max_concurrency = 8;
+
+  struct Cancelled
+  {
+  };
+  size_t numProgressCalls = 0;
+  const auto onProgress = [&numProgressCalls]
+  {
+    if (++numProgressCalls == 10)
+      throw Cancelled();
+  };
+  QVERIFY_EXCEPTION_THROWN(glob::glob(globPattern, onProgress, options), Cancelled);
+  QCOMPARE(numProgressCalls, size_t(10));
+}
+
+void TestGlobTraversal::sharedTraversalMatchesSeparateTraversals()
+{
+  const std::vector<QString> patterns{"/d*/e*/img0.png", "/d*/e*/img1.png", "/d*/e*/*.png",
+                                      "/d*/e*/f/*.png",  "/d*/e*",          "/d*/**/*.png",
+                                      "/d*/**",          "/d1/e*/*.png",    "/d*/e*/"};
+  std::vector<glob::Pattern> globPatterns;
+  for (const QString& pattern : patterns)
+    globPatterns.emplace_back((rootDir() + pattern).toStdWString(), true /*recursive*/);
+  std::vector<const glob::Pattern*> globPatternPointers;
+  for (const glob::Pattern& globPattern : globPatterns)
+    globPatternPointers.push_back(&globPattern);
+
+  const std::vector<std::vector<glob::PathInfo>> results = glob::glob_each(globPatternPointers);
+
+  QCOMPARE(results.size(), globPatterns.size());
+  for (size_t i = 0; i < globPatterns.size(); ++i)
+  {
+    QVERIFY(!results[i].empty());
+    QVERIFY(paths(results[i]) == paths(glob::glob(globPatterns[i])));
+  }
+}
+
+void TestGlobTraversal::relativePatternYieldsRelativePaths()
+{
+  const QString previousCurrentDir = QDir::currentPath();
+  QVERIFY(QDir::setCurrent(rootDir()));
+
+  const std::vector<glob::PathInfo> relativeResults =
+    glob::glob(glob::Pattern(L"./d1/**/img0.png", true /*recursive*/));
+  const std::vector<glob::PathInfo> absoluteResults =
+    glob::glob(glob::Pattern((rootDir() + "/d1/**/img0.png").toStdWString(), true /*recursive*/));
+
+  QVERIFY(QDir::setCurrent(previousCurrentDir));
+
+  QVERIFY(!relativeResults.empty());
+  QCOMPARE(relativeResults.size(), absoluteResults.size());
+  const fs::path root = rootDir().toStdWString();
+  for (size_t i = 0; i < relativeResults.size(); ++i)
+  {
+    QVERIFY(relativeResults[i].path.is_relative());
+    QVERIFY(relativeResults[i].path == absoluteResults[i].path.lexically_relative(root));
+    QVERIFY(relativeResults[i].status.type() == absoluteResults[i].status.type());
+  }
+}
+
+void TestGlobTraversal::batchedStatusMatchesStatus_data()
+{
+  QTest::addColumn<bool>("useIoUring");
+
+  QTest::newRow("io_uring") << true;
+  QTest::newRow("thread pool") << false;
+}
+
+void TestGlobTraversal::batchedStatusMatchesStatus()
+{
+  QFETCH(bool, useIoUring);
+
+  std::vector<fs::path> paths;
+  for (const auto& entry : fs::recursive_directory_iterator(rootDir().toStdWString()))
+  {
+    paths.push_back(entry.path());
+    paths.push_back(entry.path() / "missing");
+  }
+  QVERIFY(paths.size() > 100);
+
+  glob::TraversalOptions options;
+  options.use_io_uring = useIoUring;
+  const std::vector<fs::file_status> statuses = glob::status_each(paths, true, options);
+  QCOMPARE(statuses.size(), paths.size());
+  for (size_t i = 0; i < paths.size(); ++i)
+  {
+    std::error_code error;
+    const fs::file_status expected = fs::status(paths[i], error);
+    QVERIFY(statuses[i].type() == expected.type());
+    QVERIFY(statuses[i].permissions() == expected.permissions());
+  }
+}
+
+void TestGlobTraversal::streamedGlobMatchesGlob()
+{
+  const std::wstring pattern = (rootDir() + "/d*/**/*.png").toStdWString();
+  std::vector<glob::PathInfo> streamed;
+  glob::rglob(pattern,
+              [&streamed](glob::PathInfo&& info) { streamed.push_back(std::move(info)); });
+  QVERIFY(!streamed.empty());
+  QVERIFY(paths(streamed) == paths(glob::rglob(pattern)));
+
+  const std::vector<glob::Pattern> globPatterns{
+    {(rootDir() + "/d*/e*/*.png").toStdWString(), true},
+    {(rootDir() + "/d*/e*/f/*.png").toStdWString(), true},
+    {(rootDir() + "/d1/e1/img1.png").toStdWString(), true}};
+  const std::vector<const glob::Pattern*> globPatternPointers{&globPatterns[0], &globPatterns[1],
+                                                              &globPatterns[2]};
+  std::vector<std::vector<glob::PathInfo>> streamedEach(globPatterns.size());
+  glob::glob_each_streamed(globPatternPointers,
+                           [&streamedEach](size_t patternIndex, glob::PathInfo&& info)
+                           { streamedEach[patternIndex].push_back(std::move(info)); });
+  const std::vector<std::vector<glob::PathInfo>> results = glob::glob_each(globPatternPointers);
+  for (size_t i = 0; i < globPatterns.size(); ++i)
+  {
+    QVERIFY(!streamedEach[i].empty());
+    QVERIFY(paths(streamedEach[i]) == paths(results[i]));
+  }
+}
+
+void TestGlobTraversal::recursiveWildcardListsEachDirectoryOnce()
+{
+  size_t numEntries = 0;
+  for ([[maybe_unused]] const auto& entry :
+       fs::recursive_directory_iterator(rootDir().toStdWString()))
+    ++numEntries;
+
+  size_t numProgressCalls = 0;
+  const std::vector<glob::PathInfo> results =
+    glob::rglob((rootDir() + "/**/*.png").toStdWString(), [&] { ++numProgressCalls; });
+  QVERIFY(!results.empty());
+  // The file name is matched while "**" is walking the tree, rather than by listing each
+  // directory again.
+  QCOMPARE(numProgressCalls, numEntries);
+}
+
+void TestGlobTraversal::symbolicLinkCyclesAreSkipped()
+{
+  QTemporaryDir tempDir;
+  QVERIFY(tempDir.isValid());
+  const fs::path root = tempDir.path().toStdWString();
+  fs::create_directories(root / "a" / "b");
+  std::ofstream(root / "a" / "b" / "img.png");
+  // A link to a parent makes a cycle; a second link to the same directory does not.
+  fs::create_directory_symlink(root / "a", root / "a" / "b" / "up");
+  fs::create_directory_symlink(root / "a" / "b", root / "a" / "alias");
+
+  const glob::Pattern globPattern((tempDir.path() + "/a/**/*.png").toStdWString(),
+                                  true /*recursive*/);
+  for (unsigned maxConcurrency : {1u, 8u})
+  {
+    std::atomic<size_t> numSkippedCycles{0};
+    glob::TraversalOptions options;
+    options.max_concurrency = maxConcurrency;
+    options.num_skipped_cycles = &numSkippedCycles;
+    const std::vector<std::wstring> actual = paths(glob::glob(globPattern, [] {}, options));
+
+    // "a/b" is reached through "a/alias" first.
+    const std::vector<std::wstring> expected{(root / "a" / "alias" / "img.png").wstring()};
+    QVERIFY(actual == expected);
+    // "a/alias/up" leads back to "a" and "a/b" to "a/alias".
+    QCOMPARE(numSkippedCycles.load(), size_t(2));
+  }
+}
+
+void TestGlobTraversal::directoryReachedThroughTwoLinksIsListedOnce()
+{
+  QTemporaryDir tempDir;
+  QVERIFY(tempDir.isValid());
+  const fs::path root = tempDir.path().toStdWString();
+  fs::create_directories(root / "p" / "shared");
+  fs::create_directories(root / "q");
+  fs::create_directories(root / "m");
+  std::ofstream(root / "p" / "shared" / "img.png");
+  fs::create_directory_symlink(root / "p" / "shared", root / "q" / "l1");
+  fs::create_directory_symlink(root / "p" / "shared", root / "m" / "l2");
+
+  const glob::Pattern globPattern((tempDir.path() + "/**/*.png").toStdWString(),
+                                  true /*recursive*/);
+  for (unsigned maxConcurrency : {1u, 8u})
+  {
+    std::atomic<size_t> numSkippedCycles{0};
+    glob::TraversalOptions options;
+    options.max_concurrency = maxConcurrency;
+    options.num_skipped_cycles = &numSkippedCycles;
+    const std::vector<std::wstring> actual = paths(glob::glob(globPattern, [] {}, options));
+
+    // The files are reported under the lexicographically smallest path to their directory,
+    // whichever path it was listed by.
+    const std::vector<std::wstring> expected{(root / "m" / "l2" / "img.png").wstring()};
+    QVERIFY(actual == expected);
+    // Only one of the three paths to "p/shared" is listed.
+    QCOMPARE(numSkippedCycles.load(), size_t(2));
+  }
+}
+
+void TestGlobTraversal::listingCacheIsConsulted()
+{
+  const fs::path root = rootDir().toStdWString();
+  FakeListingCache cache(root / "d1" / "e1",
+                         {{fs::path("cached.png").native(), fs::file_type::regular},
+                          {fs::path("f").native(), fs::file_type::directory}});
+  glob::TraversalOptions options;
+  options.listing_cache = &cache;
+
+  const std::vector<std::wstring> actual = paths(glob::glob(
+    glob::Pattern((rootDir() + "/d1/e*/*.png").toStdWString(), false /*recursive*/), [] {},
+    options));
+
+  std::vector<std::wstring> expected{(root / "d1" / "e1" / "cached.png").wstring()};
+  for (int j : {0, 2, 3, 4})
+    for (int k = 0; k < 3; ++k)
+      expected.push_back(
+        (root / "d1" / ("e" + std::to_string(j)) / ("img" + std::to_string(k) + ".png")).wstring());
+  QVERIFY(std::is_permutation(actual.begin(), actual.end(), expected.begin(), expected.end()));
+}
+
+void TestGlobTraversal::onlyDirectoriesToSearchAreSearched()
+{
+  const fs::path root = rootDir().toStdWString();
+  const fs::path target = root / "d1" / "e2";
+  std::vector<std::wstring> expected;
+  for (int k = 0; k < 3; ++k)
+    expected.push_back((target / ("img" + std::to_string(k) + ".png")).wstring());
+
+  for (bool recursive : {false, true})
+  {
+    glob::TraversalOptions options;
+    // Search only `target` and the directories leading to it.
+    options.should_search = [&target](const fs::path& dirname)
+    {
+      fs::path directory = dirname.lexically_normal();
+      if (!directory.has_filename() && directory.has_relative_path())
+        directory = directory.parent_path();
+      return std::mismatch(directory.begin(), directory.end(), target.begin(), target.end())
+               .first == directory.end();
+    };
+    const QString pattern = rootDir() + (recursive ? "/**/*.png" : "/d*/e*/*.png");
+    const std::vector<std::wstring> actual =
+      paths(glob::glob(glob::Pattern(pattern.toStdWString(), recursive), [] {}, options));
+    QVERIFY(std::is_permutation(actual.begin(), actual.end(), expected.begin(), expected.end()));
+  }
+
+  QVERIFY(!glob::directory_stamps({root / "missing"}).front());
+}
@@ -0,0 +1,46 @@
+// This file is part of Caméléon.
+//
+// Copyright (C) 2024 Wojciech Śmigaj
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <QObject>
+#include <QTemporaryDir>
+
+class TestGlobTraversal : public QObject
+{
+  Q_OBJECT
+private slots:
+  void initTestCase();
+  void parallelTraversalMatchesSequentialTraversal_data();
+  void parallelTraversalMatchesSequentialTraversal();
+  void cancellation();
+  void sharedTraversalMatchesSeparateTraversals();
+  void relativePatternYieldsRelativePaths();
+  void batchedStatusMatchesStatus_data();
+  void batchedStatusMatchesStatus();
+  void streamedGlobMatchesGlob();
+  void recursiveWildcardListsEachDirectoryOnce();
+  void symbolicLinkCyclesAreSkipped();
+  void directoryReachedThroughTwoLinksIsListedOnce();
+  void listingCacheIsConsulted();
+  void onlyDirectoriesToSearchAreSearched();
+
+private:
+  QString rootDir() const;
+
+  QTemporaryDir tempDir_;
+};
@@ -0,0 +1,85 @@
+// This file is part of Caméléon.
+//
+// Copyright (C) 2024 Wojciech Śmigaj
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "TestInstanceKeyIndex.h"
+#include "InstanceKeyIndex.h"
+
+#include <QTest>
+
+QTEST_MAIN(TestInstanceKeyIndex)
+
+namespace
+{
+InstanceKeyIndex fruitIndex()
+{
+  const std::vector<QString> matches{"apple_pie", "Pineapple", "grape",
+                                     "apple",     "crab apple", "banana"};
+  return InstanceKeyIndex(matches, {0, 1, 2, 3, 4, 5}, matches.size(), 1, "...");
+}
+} // namespace
+
+void TestInstanceKeyIndex::ranking()
+{
+  const InstanceKeyIndex index = fruitIndex();
+  QCOMPARE(index.size(), size_t(6));
+  // Equal key, prefix match, word prefix match, substring match.
+  QCOMPARE(index.search("apple", 10), (std::vector<size_t>{3, 0, 4, 1}));
+  QCOMPARE(index.search("apple", 2), (std::vector<size_t>{3, 0}));
+  QCOMPARE(index.search("apple", 0), std::vector<size_t>{});
+  QCOMPARE(index.search("xyz", 10), std::vector<size_t>{});
+  QCOMPARE(index.search("", 10), std::vector<size_t>{});
+}
+
+void TestInstanceKeyIndex::caseInsensitivity()
+{
+  const InstanceKeyIndex index = fruitIndex();
+  QCOMPARE(index.search("APPLE", 10), (std::vector<size_t>{3, 0, 4, 1}));
+  QCOMPARE(index.search("pineAPPLE", 10), std::vector<size_t>{1});
+}
+
+void TestInstanceKeyIndex::shortQueries()
+{
+  const InstanceKeyIndex index = fruitIndex();
+  // "grape" contains "p", but not at the start of a word.
+  QCOMPARE(index.search("p", 10), (std::vector<size_t>{1, 0}));
+  QCOMPARE(index.search("pi", 10), (std::vector<size_t>{1, 0}));
+}
+
+void TestInstanceKeyIndex::typos()
+{
+  const InstanceKeyIndex index = fruitIndex();
+  QCOMPARE(index.search("bananna", 10), std::vector<size_t>{5});
+  QCOMPARE(index.search("grapr", 10), std::vector<size_t>{2});
+}
+
+void TestInstanceKeyIndex::multipleMagicExpressions()
+{
+  const std::vector<QString> matches{"red", "blue", "1", "2"};
+  // red...1, blue...1, red...2
+  const InstanceKeyIndex index(matches, {0, 2, 1, 2, 0, 3}, 3, 2, "...");
+  QCOMPARE(index.size(), size_t(3));
+  QCOMPARE(index.search("red", 10), (std::vector<size_t>{0, 2}));
+  QCOMPARE(index.search("red...2", 10), std::vector<size_t>{2});
+  QCOMPARE(index.search("1", 10), (std::vector<size_t>{0, 1}));
+}
+
+void TestInstanceKeyIndex::emptyIndex()
+{
+  const InstanceKeyIndex index;
+  QCOMPARE(index.size(), size_t(0));
+  QCOMPARE(index.search("a", 10), std::vector<size_t>{});
+}
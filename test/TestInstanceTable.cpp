@@ -0,0 +1,145 @@
+// This file is part of Caméléon.
+//
+// Copyright (C) 2024 Wojciech Śmigaj
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "TestInstanceTable.h"
+#include "InstanceTable.h"
+
+#include <QTest>
+
+QTEST_MAIN(TestInstanceTable)
+
+namespace
+{
+std::vector<Instance> tableInstances(const InstanceTable& table)
+{
+  std::vector<Instance> instances;
+  for (size_t i = 0; i < table.size(); ++i)
+    instances.push_back(table[i]);
+  return instances;
+}
+} // namespace
+
+void TestInstanceTable::instancesAreStoredExactly()
+{
+  const std::vector<Instance> instances{
+    {{"/data/run1/in.png", "/data/run1/out.png"}, {"1"}},
+    {{"/data/run2/in.png", "/data/run2/out.png"}, {"2"}},
+    {{"C:\\data\\run10\\in.png", "relative.png"}, {"10"}}};
+  const InstanceTable table(instances);
+  QCOMPARE(table.size(), size_t(3));
+  QVERIFY(!table.empty());
+  QCOMPARE(tableInstances(table), instances);
+  QCOMPARE(table.path(1, 1), "/data/run2/out.png");
+  QCOMPARE(table.magicExpressionMatches(2), std::vector<QString>{"10"});
+}
+
+void TestInstanceTable::missingFilesAreKept()
+{
+  const std::vector<Instance> instances{{{"a/x.png", ""}, {"x"}}, {{"", "b/y.png"}, {"y"}}};
+  const InstanceTable table(instances);
+  QCOMPARE(tableInstances(table), instances);
+  QVERIFY(table.path(0, 1).isEmpty());
+}
+
+void TestInstanceTable::insertKeepsOrder()
+{
+  InstanceTable table(std::vector<Instance>{{{"d/1.png"}, {"1"}}, {{"d/3.png"}, {"3"}}});
+  const std::vector<size_t> indices =
+    table.insert({{{"e/10.png"}, {"10"}}, {{"e/2.png"}, {"2"}}, {{"e/0.png"}, {"0"}}});
+  QCOMPARE(indices, (std::vector<size_t>{0, 2, 4}));
+  const std::vector<Instance> expectedInstances{{{"e/0.png"}, {"0"}},
+                                                {{"d/1.png"}, {"1"}},
+                                                {{"e/2.png"}, {"2"}},
+                                                {{"d/3.png"}, {"3"}},
+                                                {{"e/10.png"}, {"10"}}};
+  QCOMPARE(tableInstances(table), expectedInstances);
+
+  InstanceTable emptyTable;
+  emptyTable.insert({{{"f/b.png"}, {"b"}}, {{"f/a.png"}, {"a"}}});
+  QCOMPARE(emptyTable.size(), size_t(2));
+  QCOMPARE(emptyTable.path(0, 0), "f/a.png");
+}
+
+void TestInstanceTable::eraseKeepsOrder()
+{
+  InstanceTable table(std::vector<Instance>{
+    {{"d/0.png"}, {"0"}}, {{"d/1.png"}, {"1"}}, {{"d/2.png"}, {"2"}}, {{"d/3.png"}, {"3"}}});
+  table.erase({1});
+  table.insert({{{"e/1.png"}, {"1"}}});
+  table.erase({0, 3});
+  const std::vector<Instance> expectedInstances{{{"e/1.png"}, {"1"}}, {{"d/2.png"}, {"2"}}};
+  QCOMPARE(tableInstances(table), expectedInstances);
+  QCOMPARE(table.find({"1"}), std::optional<size_t>(0));
+  QCOMPARE(table.find({"2"}), std::optional<size_t>(1));
+  QVERIFY(!table.find({"0"}));
+  QVERIFY(!table.find({"3"}));
+  QVERIFY(table == InstanceTable(expectedInstances));
+
+  table.erase({0, 1});
+  QVERIFY(table.empty());
+  table.push_back({{"f/a.png", "f/b.png"}, {"a"}});
+  QCOMPARE(table.path(0, 1), "f/b.png");
+}
+
+void TestInstanceTable::comparison()
+{
+  const std::vector<Instance> instances{{{"a/1.png"}, {"1"}}, {{"a/2.png"}, {"2"}}};
+  InstanceTable built;
+  for (const Instance& instance : instances)
+    built.push_back(instance);
+  QVERIFY(built == InstanceTable(instances));
+  QVERIFY(built != InstanceTable(std::vector<Instance>{{{"a/1.png"}, {"1"}}}));
+  QVERIFY(built !=
+          InstanceTable(std::vector<Instance>{{{"a/1.png"}, {"1"}}, {{"b/2.png"}, {"2"}}}));
+}
+
+void TestInstanceTable::repeatedMagicExpressionMatchesAreStoredOnce()
+{
+  InstanceTable table(
+    std::vector<Instance>{{{"run/1.png"}, {"run", "1"}}, {{"run/2.png"}, {"run", "2"}}});
+  table.insert({{{"run/3.png"}, {"run", "3"}}});
+  QCOMPARE(table.distinctMagicExpressionMatches(), (std::vector<QString>{"run", "1", "2", "3"}));
+  QCOMPARE(table.magicExpressionMatches(2), (std::vector<QString>{"run", "3"}));
+}
+
+void TestInstanceTable::find()
+{
+  InstanceTable table(
+    std::vector<Instance>{{{"a/1x.png"}, {"1", "x"}}, {{"a/3x.png"}, {"3", "x"}}});
+  table.insert({{{"a/2y.png"}, {"2", "y"}}});
+  QCOMPARE(table.find({"1", "x"}), std::optional<size_t>(0));
+  QCOMPARE(table.find({"2", "y"}), std::optional<size_t>(1));
+  QCOMPARE(table.find({"3", "x"}), std::optional<size_t>(2));
+  QVERIFY(!table.find({"2", "x"}));
+  QVERIFY(!table.find({"4", "x"}));
+  QVERIFY(!table.find({"1"}));
+  QVERIFY(!InstanceTable().find({}));
+}
+
+void TestInstanceTable::instancesInDirectory()
+{
+  InstanceTable table(std::vector<Instance>{{{"a/1.png", "c/1.png"}, {"1"}},
+                                            {{"b/2.png", "c/2.png"}, {"2"}},
+                                            {{"a/3.png", ""}, {"3"}}});
+  table.insert({{{"a/0.png", ""}, {"0"}}});
+  table.erase({2});
+  QCOMPARE(table.directories(0), (std::vector<QString>{"a/", "b/"}));
+  QCOMPARE(table.directories(1), (std::vector<QString>{"c/"}));
+  QCOMPARE(table.instancesInDirectory(0, 0), (std::vector<size_t>{0, 1, 2}));
+  QCOMPARE(table.instancesInDirectory(0, 1), std::vector<size_t>{});
+  QCOMPARE(table.instancesInDirectory(1, 0), (std::vector<size_t>{1}));
+}
@@ -551,6 +551,12 @@ void TestMiscAlbumMenuItems::refresh()
 
   QVERIFY(w.document()->instanceKey(w.instance()) == "blue");
 
+  // Nothing has changed, so the instances should be kept as they are.
+  refreshAction->trigger();
+  QVERIFY(w.document() != nullptr);
+  QVERIFY(w.document()->instances().size() == 2);
+  QVERIFY(w.document()->instanceKey(w.instance()) == "blue");
+
   QVERIFY(tempQDir.mkdir("black"));
   QVERIFY(QFile::copy(TEST_DATA_DIR "/black/checkerboard.png",
                       tempDir->filePath("black/checkerboard.png")));
@@ -632,6 +638,129 @@ void TestMiscAlbumMenuItems::refreshAfterDeletingAllInstances()
   QVERIFY(w.instance() == 0);
 }
 
+void TestMiscAlbumMenuItems::watch()
+{
+  auto tempDir = std::make_shared<QTemporaryDir>();
+  QVERIFY(tempDir->isValid());
+  QDir tempQDir(tempDir->path());
+
+  QVERIFY(tempQDir.mkdir("blue"));
+  QVERIFY(QFile::copy(TEST_DATA_DIR "/blue/checkerboard.png",
+                      tempDir->filePath("blue/checkerboard.png")));
+  QVERIFY(QFile::copy(TEST_DATA_DIR "/blue/inverted_checkerboard.png",
+                      tempDir->filePath("blue/inverted_checkerboard.png")));
+
+  QVERIFY(tempQDir.mkdir("green"));
+  QVERIFY(QFile::copy(TEST_DATA_DIR "/green/checkerboard.png",
+                      tempDir->filePath("green/checkerboard.png")));
+  QVERIFY(QFile::copy(TEST_DATA_DIR "/green/inverted_checkerboard.png",
+                      tempDir->filePath("green/inverted_checkerboard.png")));
+
+  MainWindow w = createMainWindowForTest();
+
+  w.show();
+  QVERIFY(QTest::qWaitForWindowActive(&w));
+
+  QAction* newAction = w.findChild<QAction*>("actionNewAlbum");
+  QVERIFY(newAction != nullptr);
+  QAction* watchAction = w.findChild<QAction*>("actionWatchAlbum");
+  QVERIFY(watchAction != nullptr);
+
+  std::shared_ptr<bool> asyncSuccess = std::make_shared<bool>(false);
+  QTimer::singleShot(0,
+                     [asyncSuccess, tempDir]
+                     {
+                       QVERIFY(*asyncSuccess = waitForActiveModalWidgetOfType<AlbumEditorDialog>());
+                       AlbumEditorDialog* dlg =
+                         dynamic_cast<AlbumEditorDialog*>(qApp->activeModalWidget());
+                       dlg->setValues({tempDir->filePath("*/checkerboard.png"),
+                                       tempDir->filePath("*/inverted_checkerboard.png")});
+                       QTest::keyClick(dlg, Qt::Key_Enter);
+                     });
+  newAction->trigger();
+
+  QVERIFY(*asyncSuccess);
+  QVERIFY(w.document() != nullptr);
+  QVERIFY(w.document()->instances().size() == 2);
+
+  watchAction->trigger();
+  QVERIFY(watchAction->isChecked());
+  QVERIFY(w.document()->canUpdateInstancesIncrementally());
+  QVERIFY(w.document()->instanceKey(w.instance()) == "blue");
+
+  // New files are picked up without any user action, and the active instance is preserved.
+  QVERIFY(tempQDir.mkdir("black"));
+  QVERIFY(QFile::copy(TEST_DATA_DIR "/black/checkerboard.png",
+                      tempDir->filePath("black/checkerboard.png")));
+  QVERIFY(QFile::copy(TEST_DATA_DIR "/black/inverted_checkerboard.png",
+                      tempDir->filePath("black/inverted_checkerboard.png")));
+  QTRY_COMPARE_WITH_TIMEOUT(w.document()->instances().size(), size_t(3), 10000);
+  QVERIFY(w.document()->instanceKey(w.instance()) == "blue");
+
+  // So are deleted files.
+  QVERIFY(tempQDir.remove("green/checkerboard.png"));
+  QVERIFY(tempQDir.remove("green/inverted_checkerboard.png"));
+  QTRY_COMPARE_WITH_TIMEOUT(w.document()->instances().size(), size_t(2), 10000);
+  QVERIFY(w.document()->instanceKey(w.instance()) == "blue");
+
+  watchAction->trigger();
+  QVERIFY(!watchAction->isChecked());
+}
+
+void TestMiscAlbumMenuItems::watchUntilPatternBaseCreation()
+{
+  auto tempDir = std::make_shared<QTemporaryDir>();
+  QVERIFY(tempDir->isValid());
+  QDir tempQDir(tempDir->path());
+
+  QVERIFY(tempQDir.mkpath("runs/a/blue"));
+  QVERIFY(QFile::copy(TEST_DATA_DIR "/blue/checkerboard.png",
+                      tempDir->filePath("runs/a/blue/checkerboard.png")));
+
+  MainWindow w = createMainWindowForTest();
+
+  w.show();
+  QVERIFY(QTest::qWaitForWindowActive(&w));
+
+  QAction* newAction = w.findChild<QAction*>("actionNewAlbum");
+  QVERIFY(newAction != nullptr);
+  QAction* watchAction = w.findChild<QAction*>("actionWatchAlbum");
+  QVERIFY(watchAction != nullptr);
+
+  std::shared_ptr<bool> asyncSuccess = std::make_shared<bool>(false);
+  QTimer::singleShot(0,
+                     [asyncSuccess, tempDir]
+                     {
+                       QVERIFY(*asyncSuccess = waitForActiveModalWidgetOfType<AlbumEditorDialog>());
+                       AlbumEditorDialog* dlg =
+                         dynamic_cast<AlbumEditorDialog*>(qApp->activeModalWidget());
+                       dlg->setValues({tempDir->filePath("runs/a/*/checkerboard.png"),
+                                       tempDir->filePath("runs/b/*/inverted_checkerboard.png")});
+                       QTest::keyClick(dlg, Qt::Key_Enter);
+                     });
+  newAction->trigger();
+
+  QVERIFY(*asyncSuccess);
+  QVERIFY(w.document() != nullptr);
+  QVERIFY(w.document()->instances().size() == 1);
+  QVERIFY(w.document()->instances().path(0, 1).isEmpty());
+
+  watchAction->trigger();
+  QVERIFY(watchAction->isChecked());
+  QVERIFY(w.document()->canUpdateInstancesIncrementally());
+
+  // The base of the second pattern is created, with its files, after watching has started.
+  QVERIFY(tempQDir.mkpath("b/blue"));
+  QVERIFY(QFile::copy(TEST_DATA_DIR "/blue/inverted_checkerboard.png",
+                      tempDir->filePath("b/blue/inverted_checkerboard.png")));
+  QVERIFY(tempQDir.rename("b", "runs/b"));
+  QTRY_VERIFY_WITH_TIMEOUT(!w.document()->instances().path(0, 1).isEmpty(), 10000);
+  QVERIFY(w.document()->instances().size() == 1);
+
+  watchAction->trigger();
+  QVERIFY(!watchAction->isChecked());
+}
+
 void TestMiscAlbumMenuItems::open_close()
 {
   MainWindow w = createMainWindowForTest();
@@ -34,6 +34,8 @@ private slots:
   void editWithInconsistentNumberOfWildcardsPerPattern();
   void refresh();
   void refreshAfterDeletingAllInstances();
+  void watch();
+  void watchUntilPatternBaseCreation();
   void open_close();
   void open_modify_close_cancelSave();
   void open_modify_close_doNotSave();
@@ -25,6 +25,7 @@
 #include <QAction>
 #include <QAbstractButton>
 #include <QFileDialog>
+#include <QLineEdit>
 #include <QMessageBox>
 #include <QTest>
 #include <QTimer>
@@ -274,6 +275,53 @@ void TestNavigationMenu::navigationInAlbumWith5Pages()
   QVERIFY(lastInstanceAction->isEnabled());
 }
 
+void TestNavigationMenu::findPage()
+{
+  MainWindow w = createMainWindowForTest();
+
+  w.show();
+  QVERIFY(QTest::qWaitForWindowActive(&w));
+
+  QAction* findPageAction = w.findChild<QAction*>("actionFindPage");
+  QVERIFY(findPageAction != nullptr);
+  QLineEdit* searchBox = w.findChild<QLineEdit*>("instanceSearchBox");
+  QVERIFY(searchBox != nullptr);
+  QVERIFY(!findPageAction->isEnabled());
+  QVERIFY(!searchBox->isEnabled());
+
+  QAction* openAction = w.findChild<QAction*>("actionOpenAlbum");
+  QVERIFY(openAction != nullptr);
+
+  std::shared_ptr<bool> asyncSuccess = std::make_shared<bool>(false);
+
+  QTimer::singleShot(0,
+                     [asyncSuccess]
+                     {
+                       QVERIFY(*asyncSuccess = waitForActiveModalWidgetOfType<QFileDialog>());
+                       QFileDialog* dlg = dynamic_cast<QFileDialog*>(qApp->activeModalWidget());
+                       selectFile(dlg, TEST_DATA_DIR, "colours.cml");
+                       QTest::keyClick(dlg, Qt::Key_Enter);
+                     });
+  openAction->trigger();
+  QVERIFY(*asyncSuccess);
+  QVERIFY(w.instance() == 0);
+
+  // The page keys are indexed in the background.
+  QTRY_VERIFY(searchBox->isEnabled());
+  QVERIFY(findPageAction->isEnabled());
+
+  findPageAction->trigger();
+  QTest::keyClicks(searchBox, "gre");
+  QTest::keyClick(searchBox, Qt::Key_Return);
+  QVERIFY(w.instance() == 2);
+  QVERIFY(searchBox->text().isEmpty());
+
+  // A typo is forgiven.
+  QTest::keyClicks(searchBox, "magentq");
+  QTest::keyClick(searchBox, Qt::Key_Return);
+  QVERIFY(w.instance() == 3);
+}
+
 void TestNavigationMenu::stateAfterAlbumClosing()
 {
   MainWindow w = createMainWindowForTest();
@@ -28,5 +28,6 @@ private slots:
   void navigationInAlbumWith1Page();
   void navigationInAlbumWith2Pages();
   void navigationInAlbumWith5Pages();
+  void findPage();
   void stateAfterAlbumClosing();
 };
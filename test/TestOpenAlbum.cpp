@@ -23,9 +23,12 @@
 
 #include <QAbstractButton>
 #include <QAction>
+#include <QDir>
+#include <QFile>
 #include <QFileDialog>
 #include <QMessageBox>
 #include <QSettings>
+#include <QTemporaryDir>
 #include <QTest>
 #include <QTimer>
 
@@ -451,4 +454,75 @@ void TestOpenAlbum::open_modify_open_okOpen_doNotSave()
 
   const QByteArray firstDocCurrentContents = readFile(firstDocPath);
   QVERIFY(firstDocCurrentContents == firstDocOriginalContents);
-}
\ No newline at end of file
+}
+
+void TestOpenAlbum::openProgressively()
+{
+  // The directories are searched in the order of their names, e.g. 1000 before 2, but the
+  // instances are sorted numerically, so most of them are inserted before those already shown.
+  const int numInstances = 2000;
+  QTemporaryDir tempDir;
+  QVERIFY(tempDir.isValid());
+  for (int i = 1; i <= numInstances; ++i)
+  {
+    QVERIFY(QDir(tempDir.path()).mkdir(QString::number(i)));
+    QVERIFY(QFile::copy(TEST_DATA_DIR "/red/checkerboard.png",
+                        tempDir.filePath(QString("%1/checkerboard.png").arg(i))));
+  }
+  const QString docPath = tempDir.filePath("numbers.cml");
+  {
+    QFile file(docPath);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write(QString(R"({
+      "bookmarks": [["2"]],
+      "patterns": ["%1/*/checkerboard.png"],
+      "layout": {"columns": 1, "rows": 1},
+      "version": 1
+    })")
+                 .arg(tempDir.path())
+                 .toUtf8());
+  }
+
+  MainWindow w = createMainWindowForTest();
+
+  w.show();
+  QVERIFY(QTest::qWaitForWindowActive(&w));
+
+  QAction* lastInstanceAction = w.findChild<QAction*>("actionLastInstance");
+  QVERIFY(lastInstanceAction != nullptr);
+  QAction* bookmarkAction = w.findChild<QAction*>("actionBookmarkPage");
+  QVERIFY(bookmarkAction != nullptr);
+
+  QSettings().setValue("openAlbumsProgressively", true);
+  w.openDocument(docPath);
+  QSettings().remove("openAlbumsProgressively");
+  const Document* doc = w.document();
+  QVERIFY(doc != nullptr);
+
+  // Show the instances found so far as often as possible rather than on each timeout of the
+  // discovery timer. Once some are shown, go to the last page and bookmark it; it must stay on
+  // display and bookmarked while other instances are inserted before it.
+  QString currentKey;
+  while (doc->isDiscoveringInstances())
+  {
+    QVERIFY(QMetaObject::invokeMethod(&w, "onInstanceDiscoveryTimeout"));
+    if (doc->instances().empty())
+      continue;
+    if (currentKey.isEmpty())
+    {
+      lastInstanceAction->trigger();
+      bookmarkAction->trigger();
+      currentKey = doc->instanceKey(w.instance());
+    }
+    QCOMPARE(doc->instanceKey(w.instance()), currentKey);
+    QVERIFY(doc->bookmarks().contains(w.instance()));
+  }
+
+  QCOMPARE(doc->instances().size(), size_t(numInstances));
+  QVERIFY(!currentKey.isEmpty());
+  QCOMPARE(doc->instanceKey(w.instance()), currentKey);
+  // The bookmark saved in the album is attached to its instance once that is found.
+  const std::optional<size_t> bookmarkedInstance = doc->findInstanceWithKey("2");
+  QVERIFY(bookmarkedInstance.has_value());
+  QCOMPARE(doc->bookmarks(), (BookmarkSet{*bookmarkedInstance, size_t(w.instance())}));
+}
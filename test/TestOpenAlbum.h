@@ -32,4 +32,5 @@ private slots:
   void open_modify_open_okOpen_okSave_errorOnSave();
   void open_modify_open_okOpen_okSave();
   void open_modify_open_okOpen_doNotSave();
+  void openProgressively();
 };
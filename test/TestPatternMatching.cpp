@@ -16,14 +16,36 @@
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "TestPatternMatching.h"
+#include "CancellationException.h"
 #include "PatternMatching.h"
 
+#include <QDir>
 #include <QString>
 #include <fstream>
 #include <vector>
 
 QTEST_MAIN(TestPatternMatching)
 
+namespace
+{
+void createFiles(const fs::path& dir, const std::vector<fs::path>& files)
+{
+  for (const fs::path& file : files)
+  {
+    fs::create_directories((dir / file).parent_path());
+    std::ofstream fileStream(dir / file);
+  }
+}
+
+std::vector<PatternMatch> sortedPatternMatches(const PatternMatchingResult& result)
+{
+  std::vector<PatternMatch> matches = result.patternMatches;
+  std::sort(matches.begin(), matches.end(),
+            [](const PatternMatch& a, const PatternMatch& b) { return a.path < b.path; });
+  return matches;
+}
+} // namespace
+
 void TestPatternMatching::emptyPattern()
 {
   QString pattern = "";
@@ -74,6 +96,180 @@ void TestPatternMatching::noMatches()
   runTest(pattern, objects, expectedResult);
 }
 
+void TestPatternMatching::greedyAsterisks()
+{
+  QString pattern = "*_*.png";
+  std::vector<fs::path> objects{{"a_b_c.png", "a_b.png", "ab.png"}};
+  PatternMatchingResult expectedResult{
+    2, {{"a_b_c.png", {L"a_b", L"c"}}, {"a_b.png", {L"a", L"b"}}}};
+  runTest(pattern, objects, expectedResult);
+}
+
+void TestPatternMatching::recursiveWildcard()
+{
+  QString pattern = "a/**/*.png";
+  std::vector<fs::path> objects{{"a/c.png", "a/b/d.png", "a/b/e/f.png", "a/b/e/g.jpg", "h.png"}};
+  const std::wstring be = QDir::toNativeSeparators("b/e").toStdWString();
+  PatternMatchingResult expectedResult{
+    2, {{"a/c.png", {L"", L"c"}}, {"a/b/d.png", {L"b", L"d"}}, {"a/b/e/f.png", {be, L"f"}}}};
+  runTest(pattern, objects, expectedResult);
+}
+
+void TestPatternMatching::probing()
+{
+  QTemporaryDir tempDir;
+  QVERIFY(tempDir.isValid());
+  const fs::path tempDirPath = tempDir.path().toStdWString();
+  createFiles(tempDirPath, {"in/1.png", "in/2.png", "gt/1.png", "gt/3.png", "pred/run-1.png",
+                            "pred/run-2.png", "pred/run-3.png"});
+
+  // The last pattern has the most literal text and becomes the driver.
+  const std::vector<QString> patterns{tempDir.path() + "/in/*.png", tempDir.path() + "/gt/*.png",
+                                      tempDir.path() + "/pred/run-*.png"};
+  const std::vector<std::shared_ptr<PatternMatchingResult>> results =
+    matchPatterns(patterns, PatternMatchingStrategy::Probe);
+
+  QCOMPARE(results.size(), size_t(3));
+  QCOMPARE(sortedPatternMatches(*results[0]),
+           (std::vector<PatternMatch>{{tempDirPath / "in/1.png", {L"1"}},
+                                      {tempDirPath / "in/2.png", {L"2"}}}));
+  QCOMPARE(sortedPatternMatches(*results[1]),
+           (std::vector<PatternMatch>{{tempDirPath / "gt/1.png", {L"1"}},
+                                      {tempDirPath / "gt/3.png", {L"3"}}}));
+  QCOMPARE(results[2]->patternMatches.size(), size_t(3));
+}
+
+void TestPatternMatching::probingWithFallback()
+{
+  QTemporaryDir tempDir;
+  QVERIFY(tempDir.isValid());
+  const fs::path tempDirPath = tempDir.path().toStdWString();
+  createFiles(tempDirPath, {"a/in-1.png", "a/in-2.png", "a/gt-1.png", "a/gt-3.png",
+                            "a/pred-1.png", "b/in-4.png", "b/pred-4.png", "c/gt-7.png"});
+
+  // pred-*.png is the driver; in-2.png, gt-3.png and gt-7.png, in a directory without any
+  // driver match, are found only by globbing.
+  const std::vector<QString> patterns{tempDir.path() + "/*/in-*.png",
+                                      tempDir.path() + "/*/gt-*.png",
+                                      tempDir.path() + "/*/pred-*.png"};
+  PatternMatchingProgress progress;
+  std::vector<PatternMatchingResult> reportedMatches(patterns.size());
+  progress.onPatternMatchFound = [&](size_t patternIndex, const PatternMatch& match)
+  { reportedMatches[patternIndex].patternMatches.push_back(match); };
+  const std::vector<std::shared_ptr<PatternMatchingResult>> results =
+    matchPatterns(patterns, PatternMatchingStrategy::ProbeWithFallback, {}, &progress);
+  const std::vector<std::shared_ptr<PatternMatchingResult>> expectedResults =
+    matchPatterns(patterns, PatternMatchingStrategy::Glob);
+
+  // Each match is reported once, whether probing or globbing finds it first.
+  QCOMPARE(results.size(), expectedResults.size());
+  for (size_t i = 0; i < results.size(); ++i)
+  {
+    QCOMPARE(results[i]->numMagicExpressions, expectedResults[i]->numMagicExpressions);
+    QCOMPARE(sortedPatternMatches(*results[i]), sortedPatternMatches(*expectedResults[i]));
+    QCOMPARE(sortedPatternMatches(reportedMatches[i]), sortedPatternMatches(*expectedResults[i]));
+  }
+}
+
+void TestPatternMatching::traversalLimits()
+{
+  QTemporaryDir tempDir;
+  QVERIFY(tempDir.isValid());
+  const fs::path tempDirPath = tempDir.path().toStdWString();
+  createFiles(tempDirPath, {"a/c.png", "a/c_tmp.png", "a/b/d.png", "a/b/e/f.png",
+                            "a/checkpoints/g.png", "a/b/__pycache__/h.png"});
+
+  TraversalLimits limits;
+  limits.excludePatterns = {"checkpoints", "__pycache__", "*_tmp.png"};
+  limits.maxRecursiveWildcardDepth = 1;
+  const std::vector<std::shared_ptr<PatternMatchingResult>> results =
+    matchPatterns({tempDir.path() + "/a/**/*.png"}, PatternMatchingStrategy::Glob, limits);
+
+  QCOMPARE(results.size(), size_t(1));
+  QCOMPARE(sortedPatternMatches(*results[0]),
+           (std::vector<PatternMatch>{{tempDirPath / "a/b/d.png", {L"b", L"d"}},
+                                      {tempDirPath / "a/c.png", {L"", L"c"}}}));
+}
+
+void TestPatternMatching::progressAndCancellation()
+{
+  QTemporaryDir tempDir;
+  QVERIFY(tempDir.isValid());
+  const fs::path tempDirPath = tempDir.path().toStdWString();
+  createFiles(tempDirPath, {"a/b.png", "a/c/d.png", "a/c/e/f.png"});
+  const std::vector<QString> patterns{tempDir.path() + "/a/**/*.png"};
+
+  PatternMatchingProgress progress;
+  const std::vector<std::shared_ptr<PatternMatchingResult>> results =
+    matchPatterns(patterns, &progress);
+  QCOMPARE(results.size(), size_t(1));
+  QCOMPARE(results[0]->patternMatches.size(), size_t(3));
+  // a/b.png, a/c, a/c/d.png, a/c/e and a/c/e/f.png.
+  QCOMPARE(progress.numVisitedFiles.load(), size_t(5));
+  QCOMPARE(progress.numSkippedCycles.load(), size_t(0));
+
+  PatternMatchingProgress cancelledProgress;
+  cancelledProgress.cancellationRequested = true;
+  QVERIFY_EXCEPTION_THROWN(matchPatterns(patterns, &cancelledProgress), CancellationException);
+  QCOMPARE(cancelledProgress.numVisitedFiles.load(), size_t(0));
+}
+
+void TestPatternMatching::searchedDirectories()
+{
+  QTemporaryDir tempDir;
+  QVERIFY(tempDir.isValid());
+  const fs::path tempDirPath = tempDir.path().toStdWString();
+  createFiles(tempDirPath, {"a/b/x.png", "a/c/y.png", "a/d.png", "a/e/f/x.png", "g/z.png"});
+  fs::create_directories(tempDirPath / "a/h");
+
+  // Every subdirectory of a/ is searched for x.png, even if it does not contain it (yet).
+  std::vector<fs::path> directories;
+  matchPatterns({tempDir.path() + "/a/*/x.png", tempDir.path() + "/g/z.png"},
+                PatternMatchingStrategy::Glob, {}, nullptr, &directories);
+  QCOMPARE(directories, (std::vector<fs::path>{tempDirPath / "a", tempDirPath / "a/b",
+                                               tempDirPath / "a/c", tempDirPath / "a/e",
+                                               tempDirPath / "a/h", tempDirPath / "g"}));
+
+  matchPatterns({tempDir.path() + "/a/**/x.png"}, PatternMatchingStrategy::Glob, {}, nullptr,
+                &directories);
+  QCOMPARE(directories, (std::vector<fs::path>{tempDirPath / "a", tempDirPath / "a/b",
+                                               tempDirPath / "a/c", tempDirPath / "a/e",
+                                               tempDirPath / "a/e/f", tempDirPath / "a/h"}));
+}
+
+void TestPatternMatching::matchingInChangedDirectories()
+{
+  QTemporaryDir tempDir;
+  QVERIFY(tempDir.isValid());
+  const fs::path tempDirPath = tempDir.path().toStdWString();
+  createFiles(tempDirPath, {"a/b/1.png", "a/c/1.png"});
+
+  const std::vector<QString> patterns{tempDir.path() + "/a/*/*.png"};
+  std::vector<fs::path> previousDirectories;
+  std::vector<std::optional<glob::DirectoryStamp>> previousStamps;
+  matchPatterns(patterns, PatternMatchingStrategy::Glob, {}, nullptr, &previousDirectories,
+                &previousStamps);
+  QCOMPARE(previousStamps.size(), previousDirectories.size());
+
+  // a/ gets a new subdirectory and a/b/ a new file; a/c/ is left alone.
+  createFiles(tempDirPath, {"a/b/2.png", "a/d/1.png"});
+  const std::vector<fs::path> changed{tempDirPath / "a", tempDirPath / "a/b"};
+  std::vector<fs::path> directories;
+  std::vector<std::optional<glob::DirectoryStamp>> stamps;
+  const std::vector<std::shared_ptr<PatternMatchingResult>> results =
+    matchPatternsInChangedDirectories(patterns, {}, previousDirectories, changed, nullptr,
+                                      &directories, &stamps);
+  QCOMPARE(results.size(), size_t(1));
+  const std::vector<PatternMatch> expectedMatches{
+    {tempDirPath / "a/b/1.png", {L"b", L"1"}},
+    {tempDirPath / "a/b/2.png", {L"b", L"2"}},
+    {tempDirPath / "a/d/1.png", {L"d", L"1"}}};
+  QVERIFY(sortedPatternMatches(*results[0]) == expectedMatches);
+  QCOMPARE(directories, (std::vector<fs::path>{tempDirPath / "a", tempDirPath / "a/b",
+                                               tempDirPath / "a/d"}));
+  QCOMPARE(stamps.size(), directories.size());
+}
+
 void TestPatternMatching::runTest(QString pattern, const std::vector<fs::path>& objects,
                                   PatternMatchingResult expectedResult)
 {
@@ -32,6 +32,14 @@ private slots:
   void twoAsterisks();
   void threeQuestionMarks();
   void noMatches();
+  void greedyAsterisks();
+  void recursiveWildcard();
+  void probing();
+  void probingWithFallback();
+  void traversalLimits();
+  void progressAndCancellation();
+  void searchedDirectories();
+  void matchingInChangedDirectories();
 
 private:
   void runTest(QString pattern, const std::vector<fs::path>& objects,